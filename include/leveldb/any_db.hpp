@@ -1,19 +1,101 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <memory>
+#include <utility>
+#include <vector>
 
+#include <leveldb/comparator.h>
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <leveldb/pinned_slice.hpp>
+
 namespace leveldb
 {
+    /// Default order of keys: octet by octet as leveldb's default
+    /// comparator does.
+    ///
+    /// Layers that keep their own ordered containers (MemoryDB, WhiteoutDB,
+    /// walkers over them) take order as a template parameter: a type with
+    /// static int compare(const Slice &, const Slice &) returning negative,
+    /// zero or positive value like Slice::compare(). It should agree with
+    /// comparator of underlying leveldb database if there is one (see
+    /// OrderComparator).
+    struct BytewiseOrder
+    {
+        static int compare(const Slice &a, const Slice &b)
+        { return a.compare(b); }
+    };
+
+    /// Order of 8-octet big-endian integer keys compared as uint64_t.
+    /// Same as BytewiseOrder (keys of other lengths are compared that way)
+    /// but without going through memcmp().
+    struct UInt64Order
+    {
+        static int compare(const Slice &a, const Slice &b)
+        {
+            if (a.size() != 8 || b.size() != 8) return a.compare(b);
+            uint64_t x, y;
+            std::memcpy(&x, a.data(), 8);
+            std::memcpy(&y, b.data(), 8);
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            x = __builtin_bswap64(x);
+            y = __builtin_bswap64(y);
+#endif
+            return x < y ? -1 : x > y ? 1 : 0;
+        }
+    };
+
+    /// Ordering of std::string keys that allows lookups by Slice without
+    /// building temporary strings.
+    template <typename KeyOrder>
+    struct KeyLess
+    {
+        using is_transparent = void;
+
+        bool operator()(const Slice &a, const Slice &b) const
+        { return KeyOrder::compare(a, b) < 0; }
+    };
+
+    using SliceLess = KeyLess<BytewiseOrder>;
+
+    /// Outcome of AnyDB::Lookup()
+    enum class GetResult { Found, NotFound, Failed };
+
     class AnyDB
     {
     public:
         virtual ~AnyDB() noexcept = default;
 
         virtual Status Get(const Slice &key, std::string &value) noexcept = 0;
+
+        /// Same as Get() but reports a plain miss without building Status.
+        /// Any non-OK Status allocates its message so prefer this one on hot
+        /// paths where misses are usual (i.e. lookups through overlays).
+        ///
+        /// \param status receives error only for GetResult::Failed
+        virtual GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept
+        {
+            Status s = Get(key, value);
+            if (s.ok()) return GetResult::Found;
+            if (s.IsNotFound()) return GetResult::NotFound;
+            status = s;
+            return GetResult::Failed;
+        }
+
+        /// Same as Get() but may borrow value from database instead of
+        /// copying it. See PinnedSlice for lifetime of borrowed values.
+        virtual Status GetPinned(const Slice &key, PinnedSlice &value) noexcept
+        {
+            Status s = Get(key, value.GetSelf());
+            if (s.ok()) value.PinSelf();
+            else value.Reset();
+            return s;
+        }
+
         virtual Status Put(const Slice &key, const Slice &value) noexcept = 0;
         virtual Status Delete(const Slice &key) noexcept = 0;
 
@@ -42,30 +124,221 @@ namespace leveldb
         }
     };
 
+    /// Key range [lower, upper) that restricts walker.
+    /// Empty upper stands for no upper limit.
+    template <typename KeyOrder = BytewiseOrder>
+    struct BasicBounds
+    {
+        std::string lower;
+        std::string upper;
+
+        bool below(const Slice &key) const
+        { return !lower.empty() && KeyOrder::compare(key, lower) < 0; }
+
+        bool above(const Slice &key) const
+        { return !upper.empty() && KeyOrder::compare(key, upper) >= 0; }
+
+        bool contains(const Slice &key) const
+        { return !below(key) && !above(key); }
+
+        void assign(const Slice &newLower, const Slice &newUpper)
+        {
+            lower.assign(newLower.data(), newLower.size());
+            upper.assign(newUpper.data(), newUpper.size());
+        }
+    };
+
+    using Bounds = BasicBounds<>;
+
+    template <typename DB>
+    auto approximateSize(DB &db, const Slice &lower, const Slice &upper, int)
+        -> decltype(uint64_t(db.GetApproximateSize(lower, upper)))
+    { return db.GetApproximateSize(lower, upper); }
+
+    template <typename DB>
+    uint64_t approximateSize(DB &, const Slice &, const Slice &, long)
+    { return 0; }
+
+    /// Approximate size in storage taken by key range [lower, upper) of
+    /// database (empty upper stands for no limit) or 0 if database doesn't
+    /// provide GetApproximateSize().
+    template <typename DB>
+    uint64_t approximateSize(DB &db, const Slice &lower, const Slice &upper)
+    { return approximateSize(db, lower, upper, 0); }
+
+    template <typename DB>
+    auto compactRange(DB &db, const Slice &lower, const Slice &upper, int)
+        -> decltype(db.CompactRange(lower, upper), void())
+    { db.CompactRange(lower, upper); }
+
+    template <typename DB>
+    void compactRange(DB &, const Slice &, const Slice &, long)
+    {}
+
+    /// Compact key range [lower, upper) of database (empty upper stands for
+    /// no limit) or do nothing if database doesn't provide CompactRange().
+    template <typename DB>
+    void compactRange(DB &db, const Slice &lower, const Slice &upper)
+    { compactRange(db, lower, upper, 0); }
+
+    /// Well-mixed 64-bit hash of key (FNV-1a with a final mix).
+    inline uint64_t hashKey(const Slice &key)
+    {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            h ^= static_cast<unsigned char>(key[i]);
+            h *= 0x100000001b3ull;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /// Entry filled in by NextBatch() of walkers.
+    struct KeyValue
+    {
+        Slice key;
+        Slice value;
+    };
+
+    /// Storage for entries emitted by NextBatch() of walkers that can't
+    /// reference their source after moving on (like leveldb iterators).
+    class BatchBuffer
+    {
+        std::string data;
+        std::vector<std::pair<size_t, size_t>> sizes;
+
+    public:
+        void clear()
+        {
+            data.clear();
+            sizes.clear();
+        }
+
+        void add(const Slice &key, const Slice &value)
+        {
+            data.append(key.data(), key.size());
+            data.append(value.data(), value.size());
+            sizes.emplace_back(key.size(), value.size());
+        }
+
+        /// Point entries to the copies made since last clear().
+        void fill(KeyValue *out) const
+        {
+            const char *p = data.data();
+            for (const auto &size : sizes)
+            {
+                out->key = Slice(p, size.first);
+                p += size.first;
+                out->value = Slice(p, size.second);
+                p += size.second;
+                ++out;
+            }
+        }
+    };
+
     /// Default implementation of iterator type for generic AnyDB.
     /// It's recommended to override in AnyDB implementation with a more
     /// specific and thus faster variant.
+    ///
+    /// Bounds are checked bytewise unless walker is given comparator of
+    /// underlying database (see SetComparator() and BottomDB::Walker).
     struct AnyDB::Walker : std::unique_ptr<Iterator>
     {
         using unique_ptr::unique_ptr;
         Walker(AnyDB &db) : unique_ptr(db.NewIterator())
         {}
 
+        /// Order keys for bounds the same way iterator does.
+        void SetComparator(const Comparator *c)
+        { comparator = c; }
+
         using unique_ptr::operator*;
         using unique_ptr::operator->;
 
-        bool Valid() const { return (*this)->Valid(); }
+        /// Whether key() and value() stay valid after moving walker.
+        static constexpr bool stable = false;
+
+        /// Restrict walker to range of keys [lower, upper).
+        /// Takes effect with next positioning (Seek, SeekToFirst etc).
+        void SetBounds(const Slice &lower, const Slice &upper)
+        { bounds.assign(lower, upper); }
+
+        /// Hint that all keys within bounds share first n octets.
+        /// Iterator compares keys on its own anyway.
+        void SetCommonPrefix(size_t) {}
 
-        void SeekToFirst() { (*this)->SeekToFirst(); }
-        void SeekToLast() { (*this)->SeekToLast(); }
-        void Seek(const Slice &target) { (*this)->Seek(target); }
+        /// Hint that value() won't be used.
+        /// Iterator loads values along with keys anyway.
+        void SetKeysOnly(bool) {}
 
-        void Next() { (*this)->Next(); }
-        void Prev() { (*this)->Prev(); }
+        bool Valid() const { return inRange && (*this)->Valid(); }
+
+        void SeekToFirst()
+        {
+            if (bounds.lower.empty()) (*this)->SeekToFirst();
+            else (*this)->Seek(bounds.lower);
+            CheckUpper();
+        }
+
+        void SeekToLast()
+        {
+            if (bounds.upper.empty()) (*this)->SeekToLast();
+            else
+            {
+                (*this)->Seek(bounds.upper);
+                if ((*this)->Valid()) (*this)->Prev();
+                else (*this)->SeekToLast();
+            }
+            CheckLower();
+        }
+
+        void Seek(const Slice &target)
+        {
+            (*this)->Seek(Below(target) ? Slice(bounds.lower) : target);
+            CheckUpper();
+        }
+
+        void Next() { (*this)->Next(); CheckUpper(); }
+        void Prev() { (*this)->Prev(); CheckLower(); }
+
+        /// Take up to n entries starting from current one and move past them.
+        /// Entries are valid till the next movement of this walker.
+        size_t NextBatch(KeyValue *out, size_t n)
+        {
+            batch.clear();
+            size_t k = 0;
+            for (; k < n && Valid(); ++k, Next()) batch.add(key(), value());
+            batch.fill(out);
+            return k;
+        }
 
         Slice key() const { return (*this)->key(); }
         Slice value() const { return (*this)->value(); }
         Status status() const { return (*this)->status(); }
+
+    private:
+        Bounds bounds;
+        const Comparator *comparator = nullptr; // bytewise if not set
+        bool inRange = true;
+        BatchBuffer batch;
+
+        int Compare(const Slice &a, const Slice &b) const
+        { return comparator ? comparator->Compare(a, b) : a.compare(b); }
+
+        bool Below(const Slice &key) const
+        { return !bounds.lower.empty() && Compare(key, bounds.lower) < 0; }
+
+        bool Above(const Slice &key) const
+        { return !bounds.upper.empty() && Compare(key, bounds.upper) >= 0; }
+
+        void CheckUpper()
+        { inRange = !(*this)->Valid() || !Above((*this)->key()); }
+
+        void CheckLower()
+        { inRange = !(*this)->Valid() || !Below((*this)->key()); }
     };
 
     template <typename T>
@@ -1,14 +1,41 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 
 #include <leveldb/db.h>
+#include <leveldb/comparator.h>
 
 #include <leveldb/any_db.hpp>
 #include <leveldb/walker.hpp>
 
 namespace leveldb
 {
+    /// leveldb comparator that orders keys by KeyOrder (see BytewiseOrder),
+    /// so layers above BottomDB can share its order.
+    ///
+    /// \note leveldb stores name of comparator and refuses to open database
+    ///       with other one, so name should stay the same for given order
+    template <typename KeyOrder>
+    class OrderComparator final : public Comparator
+    {
+        const char *name;
+
+    public:
+        explicit OrderComparator(const char *name) : name(name) {}
+
+        int Compare(const Slice &a, const Slice &b) const override
+        { return KeyOrder::compare(a, b); }
+
+        const char *Name() const override { return name; }
+
+        // keys are kept as is since shortening them would have to follow
+        // KeyOrder
+        void FindShortestSeparator(std::string *, const Slice &) const override {}
+        void FindShortSuccessor(std::string *) const override {}
+    };
+
     struct BottomDB final : std::unique_ptr<DB>, AnyDB
     {
         BottomDB() = default;
@@ -25,6 +52,22 @@ namespace leveldb
 
         Status Get(const Slice &key, std::string &value) noexcept override
         { return (*this)->Get(readOptions, key, &value); }
+
+        /// Serve value right from iterator's block without copying it.
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        {
+            std::unique_ptr<Iterator> it { (*this)->NewIterator(readOptions) };
+            it->Seek(key);
+            if (!it->Valid() || options.comparator->Compare(it->key(), key) != 0)
+            {
+                Status s = it->status();
+                value.Reset();
+                return s.ok() ? Status::NotFound(Slice()) : s;
+            }
+            const Slice v = it->value();
+            value.PinSlice(v, std::move(it));
+            return Status::OK();
+        }
         Status Put(const Slice &key, const Slice &value) noexcept override
         { return (*this)->Put(writeOptions, key, value); }
         Status Delete(const Slice &key) noexcept override
@@ -33,6 +76,14 @@ namespace leveldb
         std::unique_ptr<Iterator> NewIterator() noexcept override
         { return std::unique_ptr<Iterator>((*this)->NewIterator(readOptions)); }
 
+        /// Iterator based walker that checks bounds with comparator of this
+        /// database rather than bytewise.
+        struct Walker : AnyDB::Walker
+        {
+            Walker(BottomDB &db) : AnyDB::Walker(db)
+            { SetComparator(db.options.comparator); }
+        };
+
         Status Open(const std::string &name)
         {
             DB *raw_db;
@@ -44,5 +95,23 @@ namespace leveldb
 
         Status Write(WriteBatch &updates)
         { return (*this)->Write(writeOptions, &updates); }
+
+        /// Compact underlying storage for key range [lower, upper).
+        /// Empty upper stands for no upper limit.
+        void CompactRange(const Slice &lower, const Slice &upper)
+        { (*this)->CompactRange(&lower, upper.empty() ? nullptr : &upper); }
+
+        /// Approximate size in storage taken by key range [lower, upper).
+        /// Empty upper stands for no upper limit.
+        uint64_t GetApproximateSize(const Slice &lower, const Slice &upper)
+        {
+            // there is no unbounded range so use key that is greater than any
+            // key starting with lower
+            const std::string last(lower.size() + 1, '\xff');
+            const Range range { lower, upper.empty() ? Slice(last) : upper };
+            uint64_t size = 0;
+            (*this)->GetApproximateSizes(&range, 1, &size);
+            return size;
+        }
     };
 }
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <leveldb/write_batch.h>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/txn_db.hpp>
+
+namespace leveldb
+{
+    /// Write-behind buffer in front of some database under terms that Base
+    /// object outlives this one.
+    ///
+    /// Writes are collected in a transaction (so overwrites of the same key
+    /// coalesce and reads and walkers see them through Cover/Subtract) and
+    /// go to base as a single WriteBatch once buffered amount exceeds its
+    /// limit, once a write finds the oldest buffered one aged beyond its
+    /// limit, or on Flush().
+    ///
+    /// Age is checked on the next write only, it is not a time bound: the
+    /// last writes before a pause stay buffered until the next write,
+    /// Flush() or destruction. A timer would have to flush under walkers
+    /// that read buffers without locks, so call Flush() on idle instead.
+    ///
+    /// Put(), Delete() and Write() fail only if buffering itself does: a
+    /// failed flush they trigger is kept for status() and its batch is
+    /// retried by the next flush.
+    ///
+    /// With background flushing, batch is written to base by a separate
+    /// thread while new writes fill the other buffer. Buffer being flushed
+    /// still serves reads until the next flush finds its write completed.
+    /// Base should allow reads concurrent with Write() then (as leveldb
+    /// does). BufferedDB itself is meant to be used by a single thread.
+    ///
+    /// \note As with TxnDB::commit(), walkers should be re-positioned after
+    ///       flush, which may happen on any Put() or Delete().
+    template <typename Base = AnyDB>
+    class BufferedDB final : public AnyDB
+    {
+        using Flushing = TxnDB<Base>;
+        using Front = TxnDB<Flushing>;
+
+        Base &base;
+        Flushing flushing; // batch on its way to base
+        Front front; // writes since last flush
+
+        size_t limit;
+        std::chrono::steady_clock::duration ageOnWrite;
+        bool background;
+
+        size_t pending = 0; // buffered bytes (including overwritten ones)
+        std::chrono::steady_clock::time_point since; // of the first one
+
+        std::thread flusher;
+        Status flushed; // result of writing flushing to base
+        Status failed; // of the last flush
+
+        // ensure that flushing reached base, retrying failed write
+        Status Settle()
+        {
+            if (flusher.joinable()) flusher.join();
+            if (!flushed.ok())
+            {
+                WriteBatch batch;
+                flushing.collect(batch);
+                flushed = base.Write(batch);
+                if (!flushed.ok()) return flushed;
+            }
+            flushing.reset();
+            return Status::OK();
+        }
+
+        // flush, retrying failed write first
+        Status Send(bool wait)
+        {
+            Status s = Settle();
+            if (!s.ok() || pending == 0) return s;
+
+            WriteBatch batch;
+            front.collect(batch);
+            s = flushing.Write(batch);
+            if (!s.ok()) return s;
+            front.reset();
+            pending = 0;
+
+            if (!background)
+            {
+                flushed = base.Write(batch);
+                s = Settle();
+            }
+            else
+            {
+                flusher = std::thread([this](WriteBatch updates) { flushed = base.Write(updates); },
+                                      std::move(batch));
+                if (wait) s = Settle();
+            }
+            return s;
+        }
+
+        Status Buffered(Status s, size_t bytes)
+        {
+            if (!s.ok()) return s;
+            if (pending == 0) since = std::chrono::steady_clock::now();
+            pending += bytes;
+            if (pending >= limit || std::chrono::steady_clock::now() - since >= ageOnWrite)
+            { failed = Send(false); }
+            return s;
+        }
+
+    public:
+        /// \param limit       flush once buffered keys and values take that
+        ///                    many bytes
+        /// \param ageOnWrite  flush on write that comes that much later
+        ///                    than the first buffered one (age is checked on
+        ///                    the next write, not by a timer)
+        /// \param background  write batches to base from a separate thread
+        BufferedDB(Base &origin, size_t limit = 4 << 20,
+                   std::chrono::milliseconds ageOnWrite = std::chrono::seconds(1),
+                   bool background = false) :
+            base(origin),
+            flushing(origin),
+            front(flushing),
+            limit(limit),
+            ageOnWrite(ageOnWrite),
+            background(background)
+        {}
+
+        /// Flushes buffer but drops errors; call Flush() to see them.
+        ~BufferedDB() noexcept override
+        { (void) Flush(); }
+
+        BufferedDB(const BufferedDB &) = delete;
+        BufferedDB &operator=(const BufferedDB &) = delete;
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        { return front.Get(key, value); }
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        { return front.Lookup(key, value, status); }
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        { return front.GetPinned(key, value); }
+
+        Status Put(const Slice &key, const Slice &value) noexcept override
+        { return Buffered(front.Put(key, value), key.size() + value.size()); }
+
+        Status Delete(const Slice &key) noexcept override
+        { return Buffered(front.Delete(key), key.size() + 1); }
+
+        Status Write(WriteBatch &updates)
+        {
+            Status s = front.Write(updates);
+            return Buffered(s, updates.ApproximateSize());
+        }
+
+        /// Send buffered writes to base.
+        ///
+        /// \param wait  whether to wait for background write to complete
+        ///              (always the case without background flushing)
+        Status Flush(bool wait = true)
+        { return failed = Send(wait); }
+
+        /// Result of the last flush, whether triggered by write or Flush().
+        /// Write of background flush still in flight is seen by the next one.
+        Status status() const { return failed; }
+
+        /// Amount of bytes waiting for the next flush.
+        size_t Pending() const { return pending; }
+
+        struct Walker : Front::Walker
+        {
+            Walker(BufferedDB<Base> &origin) :
+                Front::Walker(origin.front)
+            {}
+        };
+
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return front.NewIterator(); }
+    };
+}
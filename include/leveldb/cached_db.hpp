@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <leveldb/write_batch.h>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/walker.hpp>
+
+namespace leveldb
+{
+    /// Counters of CachedDB lookups.
+    struct CacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0; ///< lookups that went down to base
+        uint64_t evictions = 0;
+        uint64_t rejections = 0; ///< misses not admitted by frequency
+    };
+
+    /// Read-through cache of decoded entries in front of some database
+    /// under terms that Base object outlives this one.
+    ///
+    /// Entries (including "not found" answers) live in shards guarded by
+    /// own locks and are evicted with CLOCK once shard is over its share of
+    /// capacity. New entry replaces CLOCK victim only if it was requested
+    /// more often recently (TinyLFU), so one-off scans don't wash out hot
+    /// keys.
+    ///
+    /// Put(), Delete() and Write() go to base and drop affected entries.
+    /// Walkers go straight to base. Concurrent reads are fine as long as
+    /// base allows them.
+    template <typename Base = AnyDB>
+    class CachedDB final : public AnyDB
+    {
+        static constexpr size_t overhead = 64; // charged per entry
+
+        struct Entry
+        {
+            std::string key;
+            std::string value;
+            uint64_t hash = 0;
+            bool found = false;
+            bool used = false;
+            bool referenced = false;
+        };
+
+        // identity since keys are hashed already
+        struct Identity
+        {
+            size_t operator()(uint64_t x) const { return static_cast<size_t>(x); }
+        };
+
+        struct Shard
+        {
+            std::mutex lock;
+            std::vector<Entry> slots;
+            std::vector<size_t> unused;
+            std::unordered_multimap<uint64_t, size_t, Identity> index;
+            size_t hand = 0;
+            size_t charge = 0;
+            uint64_t epoch = 0; // bumped by every invalidation
+
+            // count-min sketch of 4 rows with 4-bit saturating counters
+            std::vector<uint8_t> sketch;
+            size_t width = 0; // power of two
+            size_t increments = 0;
+
+            size_t find(const Slice &key, uint64_t hash) const
+            {
+                auto range = index.equal_range(hash);
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if (Slice(slots[it->second].key) == key) return it->second;
+                }
+                return slots.size();
+            }
+
+            size_t cell(uint64_t hash, size_t row) const
+            {
+                static constexpr uint64_t seeds[4] = {
+                    0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full,
+                    0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull,
+                };
+                return row * width + static_cast<size_t>((hash * seeds[row]) >> 40) % width;
+            }
+
+            unsigned frequency(uint64_t hash) const
+            {
+                unsigned f = 15;
+                for (size_t row = 0; row < 4; ++row) f = std::min<unsigned>(f, sketch[cell(hash, row)]);
+                return f;
+            }
+
+            void touch(uint64_t hash)
+            {
+                for (size_t row = 0; row < 4; ++row)
+                {
+                    uint8_t &c = sketch[cell(hash, row)];
+                    if (c < 15) ++c;
+                }
+                // age counters so that popularity fades away
+                if (++increments >= width * 10)
+                {
+                    for (auto &c : sketch) c = static_cast<uint8_t>(c / 2);
+                    increments = 0;
+                }
+            }
+
+            void erase(size_t slot)
+            {
+                Entry &e = slots[slot];
+                auto range = index.equal_range(e.hash);
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if (it->second == slot)
+                    {
+                        index.erase(it);
+                        break;
+                    }
+                }
+                charge -= e.key.size() + e.value.size() + overhead;
+                e = Entry();
+                unused.push_back(slot);
+            }
+
+            // next entry to evict according to CLOCK
+            size_t victim()
+            {
+                for (;;)
+                {
+                    if (hand >= slots.size()) hand = 0;
+                    Entry &e = slots[hand];
+                    if (e.used && !e.referenced) return hand++;
+                    e.referenced = false;
+                    ++hand;
+                }
+            }
+        };
+
+        Base &base;
+        size_t shardCapacity;
+        std::unique_ptr<Shard[]> shards;
+        size_t shardMask;
+
+        std::atomic<uint64_t> hits { 0 };
+        std::atomic<uint64_t> misses { 0 };
+        std::atomic<uint64_t> evictions { 0 };
+        std::atomic<uint64_t> rejections { 0 };
+
+        Shard &shardOf(uint64_t hash)
+        { return shards[static_cast<size_t>(hash >> 32) & shardMask]; }
+
+        // serve from cache or tell epoch to pass to Admit() after reading base
+        bool Cached(const Slice &key, uint64_t hash, std::string &value, bool &found, uint64_t &epoch)
+        {
+            Shard &shard = shardOf(hash);
+            std::lock_guard<std::mutex> guard { shard.lock };
+            shard.touch(hash);
+            const size_t slot = shard.find(key, hash);
+            if (slot == shard.slots.size())
+            {
+                epoch = shard.epoch;
+                ++misses;
+                return false;
+            }
+            Entry &e = shard.slots[slot];
+            e.referenced = true;
+            found = e.found;
+            if (found) value = e.value;
+            ++hits;
+            return true;
+        }
+
+        void Admit(const Slice &key, uint64_t hash, const Slice &value, bool found, uint64_t epoch)
+        {
+            const size_t charge = key.size() + (found ? value.size() : 0) + overhead;
+            if (charge > shardCapacity) return;
+
+            Shard &shard = shardOf(hash);
+            std::lock_guard<std::mutex> guard { shard.lock };
+            if (shard.epoch != epoch) return; // base changed meanwhile
+            if (shard.find(key, hash) != shard.slots.size()) return; // raced
+
+            const unsigned frequency = shard.frequency(hash);
+            while (shard.charge + charge > shardCapacity)
+            {
+                const size_t v = shard.victim();
+                if (frequency <= shard.frequency(shard.slots[v].hash))
+                {
+                    ++rejections;
+                    return;
+                }
+                shard.erase(v);
+                ++evictions;
+            }
+
+            size_t slot;
+            if (!shard.unused.empty())
+            {
+                slot = shard.unused.back();
+                shard.unused.pop_back();
+            }
+            else
+            {
+                slot = shard.slots.size();
+                shard.slots.emplace_back();
+            }
+            Entry &e = shard.slots[slot];
+            e.key.assign(key.data(), key.size());
+            if (found) e.value.assign(value.data(), value.size());
+            e.hash = hash;
+            e.found = found;
+            e.used = true;
+            shard.index.emplace(hash, slot);
+            shard.charge += charge;
+        }
+
+        void Invalidate(const Slice &key)
+        {
+            const uint64_t hash = hashKey(key);
+            Shard &shard = shardOf(hash);
+            std::lock_guard<std::mutex> guard { shard.lock };
+            ++shard.epoch;
+            const size_t slot = shard.find(key, hash);
+            if (slot != shard.slots.size()) shard.erase(slot);
+        }
+
+    public:
+        /// \param capacity  bytes of keys and values to keep (plus some
+        ///                  overhead per entry)
+        /// \param shardBits log2 of amount of independently locked shards
+        CachedDB(Base &origin, size_t capacity = 64 << 20, unsigned shardBits = 4) :
+            base(origin),
+            shardCapacity(capacity >> shardBits),
+            shards(new Shard[size_t(1) << shardBits]),
+            shardMask((size_t(1) << shardBits) - 1)
+        {
+            // counters for about as many keys as fit in shard
+            size_t width = 64;
+            while (width < shardCapacity / overhead && width < (size_t(1) << 20)) width <<= 1;
+            for (size_t i = 0; i <= shardMask; ++i)
+            {
+                shards[i].width = width;
+                shards[i].sketch.assign(width * 4, 0);
+            }
+        }
+
+        ~CachedDB() noexcept override = default;
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        {
+            Status s;
+            switch (Lookup(key, value, s))
+            {
+            case GetResult::Found: return Status::OK();
+            case GetResult::NotFound: return Status::NotFound("key not found", key);
+            default: return s;
+            }
+        }
+
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        {
+            const uint64_t hash = hashKey(key);
+            bool found = false;
+            uint64_t epoch = 0;
+            if (Cached(key, hash, value, found, epoch))
+            { return found ? GetResult::Found : GetResult::NotFound; }
+
+            const GetResult r = base.Lookup(key, value, status);
+            if (r != GetResult::Failed) Admit(key, hash, value, r == GetResult::Found, epoch);
+            return r;
+        }
+
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        {
+            Status s = Get(key, value.GetSelf());
+            if (s.ok()) value.PinSelf();
+            else value.Reset();
+            return s;
+        }
+
+        Status Put(const Slice &key, const Slice &value) noexcept override
+        {
+            Status s = base.Put(key, value);
+            Invalidate(key);
+            return s;
+        }
+
+        Status Delete(const Slice &key) noexcept override
+        {
+            Status s = base.Delete(key);
+            Invalidate(key);
+            return s;
+        }
+
+        Status Write(WriteBatch &updates)
+        {
+            struct Invalidator : WriteBatch::Handler
+            {
+                CachedDB &db;
+                Invalidator(CachedDB &origin) : db(origin) {}
+
+                void Put(const Slice &key, const Slice &) override
+                { db.Invalidate(key); }
+
+                void Delete(const Slice &key) override
+                { db.Invalidate(key); }
+
+            } handler { *this };
+            Status s = base.Write(updates);
+            Status si = updates.Iterate(&handler);
+            return s.ok() ? si : s;
+        }
+
+        struct Walker : Base::Walker
+        {
+            Walker(CachedDB<Base> &origin) :
+                Base::Walker(origin.base)
+            {}
+        };
+
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return base.NewIterator(); }
+
+        /// Drop all cached entries (i.e. after changing base behind our back).
+        void Clear()
+        {
+            for (size_t i = 0; i <= shardMask; ++i)
+            {
+                Shard &shard = shards[i];
+                std::lock_guard<std::mutex> guard { shard.lock };
+                ++shard.epoch;
+                shard.slots.clear();
+                shard.unused.clear();
+                shard.index.clear();
+                shard.hand = 0;
+                shard.charge = 0;
+            }
+        }
+
+        CacheStats cacheStats() const
+        {
+            CacheStats stats;
+            stats.hits = hits;
+            stats.misses = misses;
+            stats.evictions = evictions;
+            stats.rejections = rejections;
+            return stats;
+        }
+
+        template <typename T = Base>
+        auto CompactRange(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().CompactRange(lower, upper))
+        { return base.CompactRange(lower, upper); }
+
+        template <typename T = Base>
+        auto GetApproximateSize(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().GetApproximateSize(lower, upper))
+        { return base.GetApproximateSize(lower, upper); }
+    };
+}
@@ -0,0 +1,475 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+#include <leveldb/write_batch.h>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/walker.hpp>
+
+namespace leveldb
+{
+    /// Build compression dictionary of up to size octets out of sample
+    /// values (see CompressedDB).
+    ///
+    /// Picks segments of samples that cover most of 8-octet strings shared
+    /// between different samples. Most valuable segments go to the end of
+    /// dictionary where deflate reaches them with shorter distances.
+    ///
+    /// \note Every compression hashes the whole dictionary, so bigger ones
+    ///       give better ratio for slower writes (reads don't care).
+    inline std::string trainDictionary(const std::vector<std::string> &samples, size_t size = 8 << 10)
+    {
+        static constexpr size_t gram = 8;
+        static constexpr size_t segment = 64;
+
+        auto gramAt = [](const char *p) {
+            uint64_t g;
+            std::memcpy(&g, p, gram);
+            return g;
+        };
+
+        // amount of samples each string occurs in
+        struct Count
+        {
+            uint32_t samples = 0;
+            uint32_t last = 0; // sample that was counted last (1-based)
+        };
+        std::unordered_map<uint64_t, Count> counts;
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            const std::string &sample = samples[i];
+            for (size_t p = 0; p + gram <= sample.size(); ++p)
+            {
+                Count &c = counts[gramAt(&sample[p])];
+                if (c.last == i + 1) continue;
+                c.last = static_cast<uint32_t>(i + 1);
+                ++c.samples;
+            }
+        }
+
+        struct Candidate
+        {
+            uint64_t score;
+            size_t sample;
+            size_t offset;
+            size_t length;
+
+            bool operator<(const Candidate &other) const { return score < other.score; }
+        };
+
+        // strings of a single sample don't help others and picked ones are
+        // zeroed, so overlapping segments lose their value
+        auto score = [&](const Candidate &c) {
+            uint64_t total = 0;
+            const char *p = samples[c.sample].data() + c.offset;
+            for (size_t i = 0; i + gram <= c.length; ++i)
+            {
+                const uint32_t n = counts[gramAt(p + i)].samples;
+                if (n > 1) total += n;
+            }
+            return total;
+        };
+
+        std::priority_queue<Candidate> queue;
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            const size_t n = samples[i].size();
+            for (size_t offset = 0; offset + gram <= n; offset += gram)
+            {
+                Candidate c { 0, i, offset, std::min(segment, n - offset) };
+                c.score = score(c);
+                if (c.score > 0) queue.push(c);
+            }
+        }
+
+        // lazy greedy: re-score the best candidate and take it only if it
+        // still beats the rest
+        std::vector<Candidate> picked;
+        size_t total = 0;
+        while (!queue.empty() && total < size)
+        {
+            Candidate c = queue.top();
+            queue.pop();
+            c.score = score(c);
+            if (c.score == 0) continue;
+            if (!queue.empty() && c.score < queue.top().score)
+            {
+                queue.push(c);
+                continue;
+            }
+            const char *p = samples[c.sample].data() + c.offset;
+            for (size_t i = 0; i + gram <= c.length; ++i) counts[gramAt(p + i)].samples = 0;
+            picked.push_back(c);
+            total += c.length;
+        }
+
+        std::string dict;
+        dict.reserve(total);
+        for (auto it = picked.rbegin(); it != picked.rend(); ++it)
+        { dict.append(samples[it->sample], it->offset, it->length); }
+        if (dict.size() > size) dict.erase(0, dict.size() - size);
+        return dict;
+    }
+
+    /// Compression of each value on its own with deflate (zlib) in front of
+    /// some database under terms that Base object outlives this one.
+    ///
+    /// Small values that look alike compress well only against a preset
+    /// dictionary (see trainDictionary()). Dictionary can be kept per
+    /// SandwichDB part with Part::SetDictionary():
+    ///
+    ///     std::string dict;
+    ///     Status s = part.Dictionary(dict);
+    ///     if (s.IsNotFound()) s = part.SetDictionary(dict = trainDictionary(samples));
+    ///     CompressedDB<decltype(part)> db { part, dict };
+    ///
+    /// Stored values start with a tag: 0 for value as is (when compression
+    /// doesn't pay off), 1 for deflate stream, 2 for deflate stream against
+    /// dictionary. Compressed ones have varint size of value after the tag.
+    ///
+    /// Walkers decompress values only when asked for them, so keys-only
+    /// scans don't pay for decompression.
+    template <typename Base = AnyDB>
+    class CompressedDB final : public AnyDB
+    {
+        static constexpr char storedTag = '\0';
+        static constexpr char deflateTag = '\x01';
+        static constexpr char dictionaryTag = '\x02';
+        static constexpr size_t minSize = 16; // don't try with smaller ones
+        static constexpr uint64_t maxRatio = 1032; // the best deflate can do
+
+        struct Deflater
+        {
+            z_stream z {};
+            bool ok;
+            Deflater(int level) : ok(deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK) {}
+            ~Deflater() { if (ok) deflateEnd(&z); }
+        };
+
+        struct Inflater
+        {
+            z_stream z {};
+            bool ok;
+            Inflater() : ok(inflateInit2(&z, -15) == Z_OK) {}
+            ~Inflater() { if (ok) inflateEnd(&z); }
+        };
+
+        // streams are costly to set up, so they are reused between calls
+        // (possibly from different threads)
+        template <typename T>
+        class Pool
+        {
+            std::mutex lock;
+            std::vector<std::unique_ptr<T>> idle;
+
+        public:
+            template <typename... Args>
+            std::unique_ptr<T> acquire(Args &&... args)
+            {
+                {
+                    std::lock_guard<std::mutex> guard { lock };
+                    if (!idle.empty())
+                    {
+                        auto t = std::move(idle.back());
+                        idle.pop_back();
+                        return t;
+                    }
+                }
+                return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
+            }
+
+            void release(std::unique_ptr<T> t)
+            {
+                std::lock_guard<std::mutex> guard { lock };
+                idle.push_back(std::move(t));
+            }
+        };
+
+        Base &base;
+        std::string dict;
+        int level;
+        mutable Pool<Deflater> deflaters;
+        mutable Pool<Inflater> inflaters;
+
+        static Bytef *bytes(const char *p)
+        { return reinterpret_cast<Bytef *>(const_cast<char *>(p)); }
+
+        static void putVarint(std::string &out, uint64_t x)
+        {
+            for (; x >= 0x80; x >>= 7) out.push_back(static_cast<char>((x & 0x7f) | 0x80));
+            out.push_back(static_cast<char>(x));
+        }
+
+        static bool getVarint(Slice &in, uint64_t &x)
+        {
+            x = 0;
+            for (unsigned shift = 0; shift < 64 && !in.empty(); shift += 7)
+            {
+                const auto octet = static_cast<unsigned char>(in[0]);
+                in.remove_prefix(1);
+                x |= uint64_t(octet & 0x7f) << shift;
+                if (!(octet & 0x80)) return true;
+            }
+            return false;
+        }
+
+        Status Compress(const Slice &value, std::string &stored) const
+        {
+            stored.clear();
+            if (value.size() >= minSize && value.size() <= UINT_MAX)
+            {
+                auto d = deflaters.acquire(level);
+                if (!d->ok) return Status::IOError("Failed to set up deflate");
+                stored.push_back(dict.empty() ? deflateTag : dictionaryTag);
+                putVarint(stored, value.size());
+                const size_t header = stored.size();
+
+                z_stream &z = d->z;
+                int r = deflateReset(&z);
+                if (r == Z_OK && !dict.empty())
+                { r = deflateSetDictionary(&z, bytes(dict.data()), static_cast<uInt>(dict.size())); }
+                if (r == Z_OK)
+                {
+                    // no point in output that is not shorter than value
+                    // stored as is (with tag)
+                    stored.resize(value.size());
+                    z.next_in = bytes(value.data());
+                    z.avail_in = static_cast<uInt>(value.size());
+                    z.next_out = bytes(&stored[header]);
+                    z.avail_out = static_cast<uInt>(value.size() - header);
+                    r = deflate(&z, Z_FINISH);
+                }
+                const size_t produced = z.total_out;
+                const std::string error = z.msg ? z.msg : "";
+                deflaters.release(std::move(d));
+                if (r == Z_STREAM_END)
+                {
+                    stored.resize(header + produced);
+                    return Status::OK();
+                }
+                if (r != Z_OK && r != Z_BUF_ERROR) return Status::IOError("Deflate failed", error);
+                stored.clear();
+            }
+            stored.push_back(storedTag);
+            stored.append(value.data(), value.size());
+            return Status::OK();
+        }
+
+        Status Decompress(const Slice &key, Slice stored, std::string &value) const
+        {
+            if (stored.empty()) return Status::Corruption("Empty compressed value", key);
+            const char tag = stored[0];
+            stored.remove_prefix(1);
+            if (tag == storedTag)
+            {
+                value.assign(stored.data(), stored.size());
+                return Status::OK();
+            }
+            uint64_t size;
+            if ((tag != deflateTag && tag != dictionaryTag) || !getVarint(stored, size) || size > UINT_MAX)
+            { return Status::Corruption("Bad compressed value", key); }
+            // size comes from disk, so don't allocate more than stream can hold
+            if (size > stored.size() * maxRatio)
+            { return Status::Corruption("Bad compressed value", key); }
+            if (tag == dictionaryTag && dict.empty())
+            { return Status::Corruption("Missing compression dictionary", key); }
+
+            auto i = inflaters.acquire();
+            if (!i->ok) return Status::IOError("Failed to set up inflate");
+            z_stream &z = i->z;
+            value.resize(size);
+            int r = inflateReset(&z);
+            if (r == Z_OK && tag == dictionaryTag)
+            { r = inflateSetDictionary(&z, bytes(dict.data()), static_cast<uInt>(dict.size())); }
+            if (r == Z_OK)
+            {
+                z.next_in = bytes(stored.data());
+                z.avail_in = static_cast<uInt>(stored.size());
+                z.next_out = bytes(&value[0]);
+                z.avail_out = static_cast<uInt>(size);
+                r = inflate(&z, Z_FINISH);
+            }
+            const bool complete = r == Z_STREAM_END && z.avail_out == 0 && z.avail_in == 0;
+            inflaters.release(std::move(i));
+            if (!complete)
+            {
+                value.clear();
+                return Status::Corruption("Bad compressed value", key);
+            }
+            return Status::OK();
+        }
+
+    public:
+        /// \param dict   preset dictionary (see trainDictionary()), same one
+        ///               should be used for all values of base
+        /// \param level  zlib compression level
+        CompressedDB(Base &origin, std::string dict = {}, int level = Z_DEFAULT_COMPRESSION) :
+            base(origin),
+            dict(std::move(dict)),
+            level(level)
+        {}
+
+        ~CompressedDB() noexcept override = default;
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        {
+            std::string stored;
+            Status s = base.Get(key, stored);
+            if (!s.ok()) return s;
+            return Decompress(key, stored, value);
+        }
+
+        Status Put(const Slice &key, const Slice &value) noexcept override
+        {
+            std::string stored;
+            Status s = Compress(value, stored);
+            if (!s.ok()) return s;
+            return base.Put(key, stored);
+        }
+
+        Status Delete(const Slice &key) noexcept override
+        { return base.Delete(key); }
+
+        Status Write(WriteBatch &updates)
+        {
+            struct Compressor : WriteBatch::Handler
+            {
+                const CompressedDB &db;
+                WriteBatch batch;
+                Status status;
+                std::string stored;
+                Compressor(const CompressedDB &origin) : db(origin) {}
+
+                void Put(const Slice &key, const Slice &value) override
+                {
+                    if (!status.ok()) return;
+                    status = db.Compress(value, stored);
+                    batch.Put(key, stored);
+                }
+
+                void Delete(const Slice &key) override
+                { batch.Delete(key); }
+
+            } compressor { *this };
+            Status s = updates.Iterate(&compressor);
+            if (s.ok()) s = compressor.status;
+            if (!s.ok()) return s;
+            return base.Write(compressor.batch);
+        }
+
+        class Walker
+        {
+            const CompressedDB *db;
+            typename Base::Walker impl;
+            bool keysOnly = false;
+            mutable bool decoded = false; // whether current value is in buffer
+            mutable std::string buffer;
+            mutable Status error;
+            std::vector<std::string> values; // of the last batch
+
+        public:
+            /// Whether key() and value() stay valid after moving walker.
+            static constexpr bool stable = false;
+
+            Walker(CompressedDB<Base> &origin) :
+                db(&origin), impl(origin.base)
+            {}
+
+            /// Restrict walker to range of keys [lower, upper).
+            /// Takes effect with next positioning (Seek, SeekToFirst etc).
+            void SetBounds(const Slice &lower, const Slice &upper)
+            { impl.SetBounds(lower, upper); }
+
+            /// Hint that all keys within bounds share first n octets.
+            void SetCommonPrefix(size_t n)
+            { impl.SetCommonPrefix(n); }
+
+            /// Hint that value() won't be used, so NextBatch() doesn't
+            /// decompress values.
+            void SetKeysOnly(bool only)
+            {
+                keysOnly = only;
+                impl.SetKeysOnly(only);
+            }
+
+            bool Valid() const { return impl.Valid(); }
+            Slice key() const { return impl.key(); }
+
+            /// Value decompressed on first request. Errors are reported
+            /// with status().
+            Slice value() const
+            {
+                const Slice stored = impl.value();
+                if (!stored.empty() && stored[0] == storedTag)
+                { return Slice(stored.data() + 1, stored.size() - 1); }
+                if (!decoded)
+                {
+                    Status s = db->Decompress(key(), stored, buffer);
+                    if (!s.ok()) error = s;
+                    decoded = true;
+                }
+                return buffer;
+            }
+
+            Status status() const { return error.ok() ? impl.status() : error; }
+
+            void SeekToFirst() { decoded = false; impl.SeekToFirst(); }
+            void SeekToLast() { decoded = false; impl.SeekToLast(); }
+            void Seek(const Slice &target) { decoded = false; impl.Seek(target); }
+            void Next() { decoded = false; impl.Next(); }
+            void Prev() { decoded = false; impl.Prev(); }
+
+            /// Take up to n entries starting from current one and move past
+            /// them.
+            size_t NextBatch(KeyValue *out, size_t n)
+            {
+                decoded = false;
+                const size_t k = impl.NextBatch(out, n);
+                if (keysOnly) return k;
+                if (values.size() < k) values.resize(k);
+                for (size_t i = 0; i < k; ++i)
+                {
+                    Slice &stored = out[i].value;
+                    if (!stored.empty() && stored[0] == storedTag)
+                    {
+                        stored.remove_prefix(1);
+                        continue;
+                    }
+                    Status s = db->Decompress(out[i].key, stored, values[i]);
+                    if (!s.ok())
+                    {
+                        error = s;
+                        return i;
+                    }
+                    stored = values[i];
+                }
+                return k;
+            }
+        };
+
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return asIterator(Walker(*this)); }
+
+        template <typename T = Base>
+        auto CompactRange(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().CompactRange(lower, upper))
+        { return base.CompactRange(lower, upper); }
+
+        template <typename T = Base>
+        auto GetApproximateSize(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().GetApproximateSize(lower, upper))
+        { return base.GetApproximateSize(lower, upper); }
+    };
+}
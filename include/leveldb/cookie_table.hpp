@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <leveldb/slice.h>
+
+namespace leveldb
+{
+    /// Hash table of names to cookies with lookups by Slice.
+    /// Meant to be shared so any number of threads may probe it while a
+    /// single writer changes it in place, as long as table has room for
+    /// new names (see full()). Growing is only allowed on a table that isn't
+    /// shared yet, so a full shared table is replaced by a bigger copy.
+    ///
+    /// Erased names stay in table as dead entries (to be revived by the
+    /// same name) until table is copied.
+    template <typename T>
+    class CookieTable
+    {
+        struct Entry
+        {
+            std::string name;
+            std::atomic<T> cookie;
+            std::atomic<bool> live { false };
+
+            void set(T value)
+            {
+                cookie.store(value, std::memory_order_relaxed);
+                live.store(true, std::memory_order_release);
+            }
+        };
+
+        std::unique_ptr<Entry[]> entries;
+        size_t capacity = 0;
+        size_t used = 0;
+        // index of entry + 1, 0 for empty slot; twice as many as entries
+        // so load factor stays below 1/2
+        std::unique_ptr<std::atomic<size_t>[]> slots;
+        size_t mask = 0;
+
+        static size_t hash(const Slice &s)
+        {
+            // FNV-1a
+            uint64_t h = 14695981039346656037ull;
+            for (size_t i = 0; i < s.size(); ++i)
+            {
+                h ^= static_cast<uint64_t>(static_cast<unsigned char>(s[i]));
+                h *= 1099511628211ull;
+            }
+            return static_cast<size_t>(h);
+        }
+
+        // entry is filled before its slot is published
+        void place(size_t index)
+        {
+            size_t n = hash(entries[index].name) & mask;
+            while (slots[n].load(std::memory_order_relaxed) != 0) n = (n + 1) & mask;
+            slots[n].store(index + 1, std::memory_order_release);
+        }
+
+        void reserve(size_t n)
+        {
+            size_t newCapacity = 16;
+            while (newCapacity < n) newCapacity *= 2;
+
+            std::unique_ptr<Entry[]> moved { new Entry[newCapacity] };
+            for (size_t i = 0; i < used; ++i)
+            {
+                moved[i].name = std::move(entries[i].name);
+                moved[i].cookie.store(entries[i].cookie.load(std::memory_order_relaxed),
+                                      std::memory_order_relaxed);
+                moved[i].live.store(entries[i].live.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+            }
+            entries = std::move(moved);
+            capacity = newCapacity;
+        }
+
+        void rehash()
+        {
+            slots.reset(new std::atomic<size_t>[2 * capacity]);
+            for (size_t n = 0; n < 2 * capacity; ++n) slots[n].store(0, std::memory_order_relaxed);
+            mask = 2 * capacity - 1;
+            for (size_t i = 0; i < used; ++i) place(i);
+        }
+
+        // index of entry + 1 or 0 if there is no such name
+        size_t lookup(const Slice &name) const
+        {
+            if (!slots) return 0;
+            for (size_t n = hash(name) & mask;; n = (n + 1) & mask)
+            {
+                const size_t index = slots[n].load(std::memory_order_acquire);
+                if (index == 0 || Slice(entries[index - 1].name) == name) return index;
+            }
+        }
+
+    public:
+        CookieTable() = default;
+
+        /// Copy live entries of other table with room for at least capacity
+        /// names.
+        CookieTable(const CookieTable &other, size_t capacity)
+        {
+            reserve(capacity > other.used ? capacity : other.used);
+            for (size_t i = 0; i < other.used; ++i)
+            {
+                const Entry &e = other.entries[i];
+                if (!e.live.load(std::memory_order_acquire)) continue;
+                entries[used].name = e.name;
+                entries[used++].set(e.cookie.load(std::memory_order_relaxed));
+            }
+            rehash();
+        }
+
+        /// Add entry unless name is already there (dead one is revived).
+        /// \note table grows if it is full, which is allowed only for table
+        ///       that isn't shared yet
+        void add(const Slice &name, T cookie)
+        {
+            const size_t index = lookup(name);
+            if (index != 0)
+            {
+                if (!entries[index - 1].live.load(std::memory_order_relaxed))
+                { entries[index - 1].set(cookie); }
+                return;
+            }
+            if (full())
+            {
+                reserve(2 * capacity);
+                rehash();
+            }
+            entries[used].name = name.ToString();
+            entries[used].set(cookie);
+            place(used++);
+        }
+
+        /// Set cookie of name whether it is known or not.
+        void assign(const Slice &name, T cookie)
+        {
+            const size_t index = lookup(name);
+            if (index == 0) add(name, cookie);
+            else entries[index - 1].set(cookie);
+        }
+
+        /// Mark entry as dead if it is there.
+        void erase(const Slice &name)
+        {
+            const size_t index = lookup(name);
+            if (index != 0) entries[index - 1].live.store(false, std::memory_order_release);
+        }
+
+        bool find(const Slice &name, T &cookie) const
+        {
+            const size_t index = lookup(name);
+            if (index == 0 || !entries[index - 1].live.load(std::memory_order_acquire)) return false;
+            cookie = entries[index - 1].cookie.load(std::memory_order_relaxed);
+            return true;
+        }
+
+        /// Whether next add() of a new name has to grow table.
+        bool full() const { return used == capacity; }
+
+        /// Amount of entries including dead ones.
+        size_t size() const { return used; }
+    };
+}
@@ -4,7 +4,9 @@
 
 namespace leveldb
 {
-    template <typename Base, typename Overlay>
+    /// Source for walking over overlay entries that hide base ones with the
+    /// same key. Both should be ordered by KeyOrder.
+    template <typename Base, typename Overlay, typename KeyOrder = BytewiseOrder>
     struct Cover
     {
         typename WalkSource<Base>::Embed base;
@@ -13,14 +15,18 @@ namespace leveldb
         class Walker;
     };
 
-    template <typename Base, typename Overlay>
-    class Cover<Base, Overlay>::Walker
+    template <typename Base, typename Overlay, typename KeyOrder>
+    class Cover<Base, Overlay, KeyOrder>::Walker
     {
         typename Base::Walker i;
         typename Overlay::Walker j;
 
         enum { Both, FwdLeft, FwdRight, RevLeft, RevRight } state;
 
+        BasicBounds<KeyOrder> bounds; // to ignore notifications about changes outside
+        size_t common = 0; // octets shared by all keys within bounds
+        BatchBuffer batch;
+
         bool useOverlay() const
         {
             switch (state)
@@ -49,7 +55,7 @@ namespace leveldb
                 state = fwd ? FwdRight : RevRight;
                 return;
             }
-            switch (compare(i.key(), j.key()))
+            switch (compare<KeyOrder>(i.key(), j.key(), common))
             {
             case Order::EQ:
                 state = Both;
@@ -63,8 +69,19 @@ namespace leveldb
             }
         }
 
+        template <typename W>
+        void Emit(KeyValue *out, size_t &k, const W &w)
+        {
+            if (stable) out[k] = { w.key(), w.value() };
+            else batch.add(w.key(), w.value());
+            ++k;
+        }
+
     public:
-        Walker(Cover<Base, Overlay> op) :
+        /// Whether key() and value() stay valid after moving walker.
+        static constexpr bool stable = Base::Walker::stable && Overlay::Walker::stable;
+
+        Walker(Cover<Base, Overlay, KeyOrder> op) :
             i(op.base),
             j(op.overlay)
         {
@@ -73,6 +90,32 @@ namespace leveldb
             SeekToFirst();
         }
 
+        /// Restrict walker to range of keys [lower, upper).
+        /// Takes effect with next positioning (Seek, SeekToFirst etc).
+        void SetBounds(const Slice &lower, const Slice &upper)
+        {
+            bounds.assign(lower, upper);
+            i.SetBounds(lower, upper);
+            j.SetBounds(lower, upper);
+        }
+
+        /// Hint that all keys within bounds share first n octets so
+        /// comparisons of base and overlay keys may skip them.
+        /// Caller is responsible for bounds that guarantee this.
+        void SetCommonPrefix(size_t n)
+        {
+            common = n;
+            i.SetCommonPrefix(n);
+            j.SetCommonPrefix(n);
+        }
+
+        /// Hint that value() won't be used.
+        void SetKeysOnly(bool keysOnly)
+        {
+            i.SetKeysOnly(keysOnly);
+            j.SetKeysOnly(keysOnly);
+        }
+
         bool Valid() const { return useOverlay() ? j.Valid() : i.Valid(); }
         Slice key() const { return useOverlay() ? j.key() : i.key(); }
         Slice value() const { return useOverlay() ? j.value() : i.value(); }
@@ -115,7 +158,7 @@ namespace leveldb
                     if (!j.Valid())
                     { i.Next(); state = FwdLeft; return; }
                 }
-                if (i.key().compare(j.key()) >= 0) j.Next();
+                if (compare<KeyOrder>(i.key(), j.key(), common) != Order::LT) j.Next();
                 i.Next();
                 break;
 
@@ -126,7 +169,7 @@ namespace leveldb
                     if (!i.Valid())
                     { j.Next(); state = FwdRight; return; }
                 }
-                if (i.key().compare(j.key()) <= 0) i.Next();
+                if (compare<KeyOrder>(i.key(), j.key(), common) != Order::GT) i.Next();
                 j.Next();
                 break;
             }
@@ -167,15 +210,54 @@ namespace leveldb
             Activate(false);
         }
 
+        /// Take up to n entries starting from current one and move past them.
+        /// Runs of entries coming from one side are taken without switching
+        /// between sides.
+        size_t NextBatch(KeyValue *out, size_t n)
+        {
+            batch.clear();
+            size_t k = 0;
+            while (k < n && Valid())
+            {
+                switch (state)
+                {
+                case FwdLeft:
+                    // run of base entries preceding next overlay entry
+                    do { Emit(out, k, i); i.Next(); }
+                    while (k < n && i.Valid() &&
+                           (!j.Valid() || compare<KeyOrder>(i.key(), j.key(), common) == Order::LT));
+                    Activate();
+                    break;
+
+                case FwdRight:
+                    // run of overlay entries preceding next base entry
+                    do { Emit(out, k, j); j.Next(); }
+                    while (k < n && j.Valid() &&
+                           (!i.Valid() || compare<KeyOrder>(i.key(), j.key(), common) == Order::GT));
+                    Activate();
+                    break;
+
+                default:
+                    if (useOverlay()) Emit(out, k, j);
+                    else Emit(out, k, i);
+                    Next();
+                    break;
+                }
+            }
+            if (!stable) batch.fill(out);
+            return k;
+        }
+
     protected:
         void overlayPut(const Slice &key)
         {
             if (!Valid()) return; // do not bother
+            if (!bounds.contains(key)) return; // never visible for us
             switch (state)
             {
             case FwdLeft:
                 // check range
-                switch (compare(i.key(), key))
+                switch (compare<KeyOrder>(i.key(), key))
                 {
                 case Order::EQ:
                     j.Seek(key);
@@ -185,13 +267,13 @@ namespace leveldb
                 case Order::LT: break;
 
                 }
-                if (j.Valid() && j.key().compare(key) < 0) return;
+                if (j.Valid() && compare<KeyOrder>(j.key(), key) == Order::LT) return;
                 // ok this is scase when key inserted between current base and
                 // next cover
                 j.Seek(key);
                 break;
             case RevLeft:
-                switch (compare(i.key(), key))
+                switch (compare<KeyOrder>(i.key(), key))
                 {
                 case Order::EQ:
                     j.Seek(key);
@@ -200,7 +282,7 @@ namespace leveldb
                 case Order::LT: return;
                 case Order::GT: break;
                 }
-                if (j.Valid() && j.key().compare(key) > 0) return;
+                if (j.Valid() && compare<KeyOrder>(j.key(), key) == Order::GT) return;
                 j.Seek(key); // exact match so no need to do Prev()
                 break;
             case Both:
@@ -215,16 +297,17 @@ namespace leveldb
         void overlayDelete(const Slice &key)
         {
             if (!Valid()) return;
+            if (!bounds.contains(key)) return;
             switch (state)
             {
             case FwdLeft:
                 // check if we already pointing to this record
-                if (!j.Valid() || j.key().compare(key) != 0) return;
+                if (!j.Valid() || compare<KeyOrder>(j.key(), key) != Order::EQ) return;
                 j.Seek(key); // we know that this record exists
                 j.Next();
                 break;
             case RevLeft:
-                if (!j.Valid() || j.key().compare(key) != 0) return;
+                if (!j.Valid() || compare<KeyOrder>(j.key(), key) != Order::EQ) return;
                 j.Seek(key);
                 j.Prev();
                 break;
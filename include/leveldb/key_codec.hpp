@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+
+#include <leveldb/slice.h>
+
+namespace leveldb
+{
+    /// Mapping of scalar type to unsigned bits that compare as values do.
+    template <typename T, typename Enable = void>
+    struct key_bits;
+
+    template <typename T>
+    struct key_bits<T, typename std::enable_if<std::is_unsigned<T>::value &&
+                                               !std::is_same<T, bool>::value>::type>
+    {
+        using type = T;
+        static constexpr type encode(T x) { return x; }
+        static constexpr T decode(type b) { return b; }
+    };
+
+    template <>
+    struct key_bits<bool>
+    {
+        using type = unsigned char;
+        static constexpr type encode(bool x) { return x ? 1 : 0; }
+        static constexpr bool decode(type b) { return b != 0; }
+    };
+
+    // two's complement with flipped sign bit sorts as unsigned
+    template <typename T>
+    struct key_bits<T, typename std::enable_if<std::is_signed<T>::value &&
+                                               std::is_integral<T>::value>::type>
+    {
+        using type = typename std::make_unsigned<T>::type;
+        static constexpr type sign = type(type(1) << (sizeof(T) * 8 - 1));
+        static constexpr type encode(T x) { return type(type(x) ^ sign); }
+        static constexpr T decode(type b) { return static_cast<T>(type(b ^ sign)); }
+    };
+
+    // IEEE 754: flip sign bit of positive values and all bits of negative
+    // ones, so -0.0 goes right before +0.0 and NaNs go to the edges
+    template <typename T>
+    struct key_bits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only IEEE 754 float and double");
+        using type = typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type;
+        static constexpr type sign = type(type(1) << (sizeof(T) * 8 - 1));
+
+        static type encode(T x)
+        {
+            type b;
+            std::memcpy(&b, &x, sizeof(b));
+            return (b & sign) ? type(~b) : type(b | sign);
+        }
+
+        static T decode(type b)
+        {
+            b = (b & sign) ? type(b & ~sign) : type(~b);
+            T x;
+            std::memcpy(&x, &b, sizeof(x));
+            return x;
+        }
+    };
+
+    /// Fixed-size encoding of integers, floats and bools that sorts bytewise
+    /// in the same order as values do (big-endian, see key_bits).
+    /// Counterpart of host_order for keys that are scanned in value order.
+    template <typename T>
+    class key_order
+    {
+        using Bits = typename key_bits<T>::type;
+        char octets[sizeof(Bits)];
+
+    public:
+        key_order() = default;
+        constexpr key_order(T x) : octets{} { *this = x; }
+        key_order(const Slice &x) { *this = x; }
+
+        constexpr key_order &operator=(T x)
+        {
+            const Bits b = key_bits<T>::encode(x);
+            for (size_t i = 0; i < sizeof(Bits); ++i)
+            { octets[i] = static_cast<char>((b >> ((sizeof(Bits) - 1 - i) * 8)) & 0xff); }
+            return *this;
+        }
+        key_order &operator=(const Slice &s)
+        {
+            assert( !corrupted(s) );
+            std::memcpy(octets, s.data(), size());
+            return *this;
+        }
+
+        constexpr operator T() const
+        {
+            Bits b = 0;
+            for (size_t i = 0; i < sizeof(Bits); ++i)
+            { b = static_cast<Bits>((uint64_t(b) << 8) | static_cast<unsigned char>(octets[i])); }
+            return key_bits<T>::decode(b);
+        }
+        operator Slice() const { return Slice(data(), size()); }
+
+        static constexpr size_t size()
+        { return sizeof(Bits); }
+        constexpr const char *data() const
+        { return octets; }
+        static bool corrupted(const Slice &s)
+        { return s.size() != size(); }
+    };
+
+    /// Amount of octets taken by encoding of fixed-size components.
+    template <typename... T>
+    constexpr size_t fixedKeySize()
+    {
+        size_t n = 0;
+        for (size_t x : { size_t(0), key_order<T>::size()... }) n += x;
+        return n;
+    }
+
+    /// Builds key of several components in a buffer of N octets without
+    /// allocations. Encoded keys compare bytewise as tuples of components.
+    ///
+    /// Scalars are written as key_order<T>. Strings are written with 0x00
+    /// escaped as 0x00 0xff and terminated with 0x00 0x01, so no string is
+    /// a prefix of other one while order is kept ("a" < "a\0" < "ab").
+    ///
+    /// Overflowing buffer is sticky: component that doesn't fit and all the
+    /// following ones are dropped and ok() turns false.
+    template <size_t N = 256>
+    class KeyWriter
+    {
+        char octets[N];
+        size_t length = 0;
+        bool overflow = false;
+
+        char *reserve(size_t n)
+        {
+            if (overflow || n > N - length)
+            {
+                overflow = true;
+                return nullptr;
+            }
+            char *p = octets + length;
+            length += n;
+            return p;
+        }
+
+        // write escaped string (without terminator), nothing on overflow
+        void escape(const Slice &s)
+        {
+            const size_t mark = length;
+            const char *p = s.data(), *end = p + s.size();
+            while (p != end)
+            {
+                const char *z = static_cast<const char *>(std::memchr(p, 0, size_t(end - p)));
+                const size_t n = size_t((z ? z : end) - p);
+                char *out = reserve(z ? n + 2 : n);
+                if (!out)
+                {
+                    length = mark;
+                    return;
+                }
+                std::memcpy(out, p, n);
+                if (!z) break;
+                out[n] = '\0';
+                out[n + 1] = '\xff';
+                p = z + 1;
+            }
+        }
+
+    public:
+        KeyWriter() = default;
+
+        template <typename... T>
+        explicit KeyWriter(const T &... components)
+        { add(components...); }
+
+        /// Append scalar component.
+        template <typename T>
+        typename std::enable_if<std::is_arithmetic<T>::value, KeyWriter &>::type
+        add(T x)
+        {
+            const key_order<T> k { x };
+            if (char *out = reserve(k.size())) std::memcpy(out, k.data(), k.size());
+            return *this;
+        }
+
+        /// Append string component.
+        KeyWriter &add(const Slice &s)
+        {
+            const size_t mark = length;
+            escape(s);
+            if (char *out = reserve(2))
+            {
+                out[0] = '\0';
+                out[1] = '\x01';
+            }
+            else length = mark;
+            return *this;
+        }
+
+        template <typename T1, typename T2, typename... Rest>
+        KeyWriter &add(const T1 &first, const T2 &second, const Rest &... rest)
+        {
+            add(first);
+            return add(second, rest...);
+        }
+
+        KeyWriter &add() { return *this; }
+
+        /// Append beginning of string component. Keys with strings starting
+        /// with s share the resulting key as prefix (see successor()).
+        KeyWriter &addPrefix(const Slice &s)
+        {
+            escape(s);
+            return *this;
+        }
+
+        /// Turn key into the least one that follows all keys prefixed with
+        /// it. Returns false if there is no such key (all octets are 0xff)
+        /// and empty upper bound should be used instead.
+        bool successor()
+        {
+            while (length > 0 && octets[length - 1] == '\xff') --length;
+            if (length == 0) return false;
+            ++octets[length - 1];
+            return true;
+        }
+
+        void clear()
+        {
+            length = 0;
+            overflow = false;
+        }
+
+        bool ok() const { return !overflow; }
+        size_t size() const { return length; }
+        const char *data() const { return octets; }
+        operator Slice() const { return Slice(octets, length); }
+        std::string ToString() const { return std::string(octets, length); }
+    };
+
+    /// Parses components written by KeyWriter, i.e. directly from
+    /// Walker::key(). Every read returns false on truncated or corrupted
+    /// input and leaves the rest of key untouched.
+    class KeyReader
+    {
+        Slice rest;
+
+    public:
+        explicit KeyReader(const Slice &key) : rest(key) {}
+
+        template <typename T>
+        typename std::enable_if<std::is_arithmetic<T>::value, bool>::type
+        read(T &x)
+        {
+            constexpr size_t n = key_order<T>::size();
+            if (rest.size() < n) return false;
+            x = key_order<T>(Slice(rest.data(), n));
+            rest.remove_prefix(n);
+            return true;
+        }
+
+        bool read(std::string &s)
+        {
+            s.clear();
+            const char *p = rest.data(), *end = p + rest.size();
+            for (;;)
+            {
+                const char *z = static_cast<const char *>(std::memchr(p, 0, size_t(end - p)));
+                if (!z || z + 1 == end) return false;
+                s.append(p, size_t(z - p));
+                if (z[1] == '\x01')
+                {
+                    rest.remove_prefix(size_t(z + 2 - rest.data()));
+                    return true;
+                }
+                if (z[1] != '\xff') return false;
+                s.push_back('\0');
+                p = z + 2;
+            }
+        }
+
+        template <typename T1, typename T2, typename... Rest>
+        bool read(T1 &first, T2 &second, Rest &... others)
+        { return read(first) && read(second, others...); }
+
+        bool read() { return true; }
+
+        bool done() const { return rest.empty(); }
+        Slice remaining() const { return rest; }
+    };
+
+    /// Parse key that consists exactly of given components.
+    template <typename... T>
+    bool decodeKey(const Slice &key, T &... components)
+    {
+        KeyReader reader { key };
+        return reader.read(components...) && reader.done();
+    }
+}
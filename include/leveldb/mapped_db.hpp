@@ -0,0 +1,523 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <leveldb/write_batch.h>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/sequence.hpp>
+#include <leveldb/walker.hpp>
+
+namespace leveldb
+{
+    /// Layout of files served by MappedDB. Entries go in key order, every
+    /// interval-th of them is referenced from sparse index:
+    ///
+    ///     entries:  varint key size | varint value size | key | value
+    ///     padding:  up to 7 zero octets to align index
+    ///     index:    uint64 offset of entry
+    ///     footer:   uint64 index offset | uint64 entries | uint32 interval |
+    ///               uint32 version | uint64 magic
+    ///
+    /// Sizes are varint_order, other integers are in host order.
+    struct MappedFormat
+    {
+        static constexpr uint64_t magic = 0x50414d4c5442444cull; // "LDBTLMAP" on little-endian hosts
+        static constexpr uint32_t version = 1;
+        static constexpr size_t footerSize = 32;
+
+        using Size = varint_order<uint32_t>;
+    };
+
+    /// Writes sorted file for MappedDB entry by entry. File shows up under
+    /// its name only after successful Finish().
+    class MappedBuilder
+    {
+        std::string path;
+        std::string temp;
+        FILE *file = nullptr;
+        uint32_t interval;
+        uint64_t offset = 0;
+        uint64_t entries = 0;
+        std::vector<uint64_t> index;
+        std::string last;
+        Status failure;
+
+        Status Errno(const std::string &context)
+        { return failure = Status::IOError(context, std::strerror(errno)); }
+
+        Status Append(const void *data, size_t size)
+        {
+            if (size > 0 && std::fwrite(data, 1, size, file) != size) return Errno(temp);
+            offset += size;
+            return Status::OK();
+        }
+
+    public:
+        /// \param interval  amount of entries per index entry (bigger ones
+        ///                  give smaller index for longer scans on lookup)
+        MappedBuilder(std::string path, uint32_t interval = 16) :
+            path(std::move(path)),
+            temp(this->path + ".tmp"),
+            interval(interval > 0 ? interval : 1)
+        {
+            file = std::fopen(temp.c_str(), "wb");
+            if (!file) (void) Errno(temp);
+        }
+
+        /// Drops unfinished file.
+        ~MappedBuilder()
+        {
+            if (!file) return;
+            std::fclose(file);
+            std::remove(temp.c_str());
+        }
+
+        MappedBuilder(const MappedBuilder &) = delete;
+        MappedBuilder &operator=(const MappedBuilder &) = delete;
+
+        /// Append entry with key greater than any previous one.
+        Status Add(const Slice &key, const Slice &value)
+        {
+            if (!failure.ok()) return failure;
+            if (entries > 0 && key.compare(last) <= 0)
+            { return failure = Status::InvalidArgument("Keys of mapped table should ascend", key); }
+            if (key.size() > UINT32_MAX || value.size() > UINT32_MAX)
+            { return failure = Status::InvalidArgument("Entry is too big for mapped table", key); }
+
+            if (entries % interval == 0) index.push_back(offset);
+            const MappedFormat::Size k { static_cast<uint32_t>(key.size()) };
+            const MappedFormat::Size v { static_cast<uint32_t>(value.size()) };
+            Status s = Append(k.data(), k.size());
+            if (s.ok()) s = Append(v.data(), v.size());
+            if (s.ok()) s = Append(key.data(), key.size());
+            if (s.ok()) s = Append(value.data(), value.size());
+            if (!s.ok()) return s;
+            last.assign(key.data(), key.size());
+            ++entries;
+            return s;
+        }
+
+        /// Append all entries of walker (within its bounds).
+        template <typename W>
+        Status AddAll(W &w)
+        {
+            for (w.SeekToFirst(); w.Valid(); w.Next())
+            {
+                Status s = Add(w.key(), w.value());
+                if (!s.ok()) return s;
+            }
+            Status s = w.status();
+            return s.IsNotFound() ? Status::OK() : s;
+        }
+
+        /// Write index, sync file and put it in place.
+        Status Finish()
+        {
+            if (!failure.ok()) return failure;
+            static const char padding[sizeof(uint64_t)] = {};
+            Status s = Append(padding, (sizeof(uint64_t) - offset % sizeof(uint64_t)) % sizeof(uint64_t));
+            const uint64_t indexOffset = offset;
+            if (s.ok()) s = Append(index.data(), index.size() * sizeof(uint64_t));
+
+            const uint32_t version = MappedFormat::version;
+            const uint64_t magic = MappedFormat::magic;
+            char footer[MappedFormat::footerSize];
+            std::memcpy(footer, &indexOffset, 8);
+            std::memcpy(footer + 8, &entries, 8);
+            std::memcpy(footer + 16, &interval, 4);
+            std::memcpy(footer + 20, &version, 4);
+            std::memcpy(footer + 24, &magic, 8);
+            if (s.ok()) s = Append(footer, sizeof(footer));
+            if (!s.ok()) return s;
+
+            if (std::fflush(file) != 0 || ::fsync(::fileno(file)) != 0) return Errno(temp);
+            const int r = std::fclose(file);
+            file = nullptr;
+            if (r != 0) return Errno(temp);
+            if (std::rename(temp.c_str(), path.c_str()) != 0) return Errno(path);
+            failure = Status::InvalidArgument("Mapped table is finished already", path);
+            return Status::OK();
+        }
+    };
+
+    /// Write all entries of walker into file for MappedDB.
+    template <typename W>
+    Status buildMapped(W &w, const std::string &path, uint32_t interval = 16)
+    {
+        MappedBuilder builder { path, interval };
+        Status s = builder.AddAll(w);
+        return s.ok() ? builder.Finish() : s;
+    }
+
+    /// Read-only database over memory-mapped file written by MappedBuilder.
+    ///
+    /// Opening takes only mmap() and check of footer. Lookups do binary
+    /// search over sparse index and short scan of entries after it. Keys
+    /// and values are served right from the mapping, so they stay valid as
+    /// long as this object does.
+    ///
+    /// Changes are refused with NotSupported, but it serves fine as a base
+    /// for TxnDB or Cover that keep changes elsewhere.
+    class MappedDB final : public AnyDB
+    {
+        const char *map = nullptr;
+        size_t mapSize = 0;
+        const char *entriesEnd = nullptr; // start of index
+        const uint64_t *index = nullptr;
+        uint64_t indexSize = 0;
+        uint64_t entries = 0;
+        uint32_t interval = 1;
+
+        // entry at some offset
+        struct Entry
+        {
+            Slice key;
+            Slice value;
+            const char *next = nullptr;
+        };
+
+        static bool ParseSize(const char *&p, const char *end, uint32_t &size)
+        {
+            const Slice rest { p, size_t(end - p) };
+            const size_t n = MappedFormat::Size::prefix_size(rest);
+            if (n == 0 || MappedFormat::Size::corrupted(Slice(p, n))) return false;
+            size = MappedFormat::Size(Slice(p, n));
+            p += n;
+            return true;
+        }
+
+        bool Parse(const char *p, Entry &entry) const
+        {
+            uint32_t k, v;
+            if (!ParseSize(p, entriesEnd, k) || !ParseSize(p, entriesEnd, v)) return false;
+            if (uint64_t(entriesEnd - p) < uint64_t(k) + v) return false;
+            entry.key = Slice(p, k);
+            entry.value = Slice(p + k, v);
+            entry.next = p + k + v;
+            return true;
+        }
+
+        const char *Block(uint64_t i) const
+        { return map + index[i]; }
+
+        static Status Broken()
+        { return Status::Corruption("Broken mapped table entry"); }
+
+        // first entry with key not less than target; ordinal is set to
+        // entries if there is no such one
+        Status Find(const Slice &target, Entry &entry, uint64_t &ordinal) const
+        {
+            // last block that starts with key not greater than target
+            uint64_t lo = 0, hi = indexSize;
+            while (lo < hi)
+            {
+                const uint64_t mid = lo + (hi - lo) / 2;
+                Entry e;
+                if (!Parse(Block(mid), e)) return Broken();
+                if (e.key.compare(target) <= 0) lo = mid + 1;
+                else hi = mid;
+            }
+            const uint64_t block = lo > 0 ? lo - 1 : 0;
+            ordinal = block * interval;
+            const char *p = indexSize > 0 ? Block(block) : entriesEnd;
+            for (; ordinal < entries; ++ordinal, p = entry.next)
+            {
+                if (!Parse(p, entry)) return Broken();
+                if (entry.key.compare(target) >= 0) break;
+            }
+            return Status::OK();
+        }
+
+        static Status Errno(const std::string &context)
+        { return Status::IOError(context, std::strerror(errno)); }
+
+    public:
+        MappedDB() = default;
+        ~MappedDB() noexcept override { Close(); }
+
+        MappedDB(const MappedDB &) = delete;
+        MappedDB &operator=(const MappedDB &) = delete;
+
+        /// Map file written by MappedBuilder.
+        Status Open(const std::string &path)
+        {
+            Close();
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return Errno(path);
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                Status s = Errno(path);
+                ::close(fd);
+                return s;
+            }
+            const size_t size = static_cast<size_t>(st.st_size);
+            if (size < MappedFormat::footerSize)
+            {
+                ::close(fd);
+                return Status::Corruption("Not a mapped table", path);
+            }
+            void *m = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            Status s = m == MAP_FAILED ? Errno(path) : Status::OK();
+            ::close(fd); // mapping keeps file alive
+            if (!s.ok()) return s;
+            map = static_cast<const char *>(m);
+            mapSize = size;
+
+            const char *footer = map + size - MappedFormat::footerSize;
+            uint64_t indexOffset, magic;
+            uint32_t version;
+            std::memcpy(&indexOffset, footer, 8);
+            std::memcpy(&entries, footer + 8, 8);
+            std::memcpy(&interval, footer + 16, 4);
+            std::memcpy(&version, footer + 20, 4);
+            std::memcpy(&magic, footer + 24, 8);
+            const uint64_t indexBytes = size - MappedFormat::footerSize - indexOffset;
+            if (magic != MappedFormat::magic || version != MappedFormat::version ||
+                interval == 0 || indexOffset > size - MappedFormat::footerSize ||
+                indexBytes % sizeof(uint64_t) != 0 ||
+                indexOffset % sizeof(uint64_t) != 0 ||
+                indexBytes / sizeof(uint64_t) != (entries + interval - 1) / interval)
+            {
+                Close();
+                return Status::Corruption("Not a mapped table", path);
+            }
+            entriesEnd = map + indexOffset;
+            index = reinterpret_cast<const uint64_t *>(entriesEnd);
+            indexSize = indexBytes / sizeof(uint64_t);
+            for (uint64_t i = 0; i < indexSize; ++i)
+            {
+                if (index[i] >= indexOffset)
+                {
+                    Close();
+                    return Status::Corruption("Broken mapped table index", path);
+                }
+            }
+            return Status::OK();
+        }
+
+        /// Unmap file (if any).
+        void Close()
+        {
+            if (map) ::munmap(const_cast<char *>(map), mapSize);
+            map = nullptr;
+            mapSize = 0;
+            entriesEnd = nullptr;
+            index = nullptr;
+            indexSize = 0;
+            entries = 0;
+        }
+
+        bool IsOpen() const { return map != nullptr; }
+
+        /// Amount of entries.
+        uint64_t size() const { return entries; }
+
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        {
+            Entry entry;
+            uint64_t ordinal;
+            status = Find(key, entry, ordinal);
+            if (!status.ok()) return GetResult::Failed;
+            if (ordinal == entries || entry.key != key) return GetResult::NotFound;
+            value.assign(entry.value.data(), entry.value.size());
+            return GetResult::Found;
+        }
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        {
+            Status s;
+            switch (Lookup(key, value, s))
+            {
+            case GetResult::Found: return Status::OK();
+            case GetResult::NotFound: return Status::NotFound("key not found", key);
+            default: return s;
+            }
+        }
+
+        /// Borrow value right from the mapping.
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        {
+            Entry entry;
+            uint64_t ordinal;
+            Status s = Find(key, entry, ordinal);
+            if (s.ok() && (ordinal == entries || entry.key != key)) s = Status::NotFound("key not found", key);
+            if (!s.ok())
+            {
+                value.Reset();
+                return s;
+            }
+            value.PinSlice(entry.value);
+            return s;
+        }
+
+        Status Put(const Slice &key, const Slice &) noexcept override
+        { return Status::NotSupported("MappedDB is read-only", key); }
+
+        Status Delete(const Slice &key) noexcept override
+        { return Status::NotSupported("MappedDB is read-only", key); }
+
+        Status Write(WriteBatch &)
+        { return Status::NotSupported("MappedDB is read-only"); }
+
+        /// Size of file part taken by key range [lower, upper).
+        uint64_t GetApproximateSize(const Slice &lower, const Slice &upper)
+        {
+            auto locate = [this](const Slice &key, const char *unbound) {
+                if (key.empty()) return unbound;
+                Entry entry;
+                uint64_t ordinal;
+                if (!Find(key, entry, ordinal).ok() || ordinal == entries) return entriesEnd;
+                return entry.key.data();
+            };
+            const char *from = locate(lower, map), *to = locate(upper, entriesEnd);
+            return from < to ? uint64_t(to - from) : 0;
+        }
+
+        class Walker
+        {
+            const MappedDB *db;
+            Bounds bounds;
+            Entry entry;
+            uint64_t ordinal; // of current entry (entries when invalid)
+            Status error;
+
+            void Invalidate() { ordinal = db->entries; }
+
+            // position at ordinal within block that holds it
+            void Load(uint64_t target)
+            {
+                if (target >= db->entries) return Invalidate();
+                const char *p = db->Block(target / db->interval);
+                for (ordinal = target - target % db->interval; ; ++ordinal, p = entry.next)
+                {
+                    if (!db->Parse(p, entry)) return Fail();
+                    if (ordinal == target) return;
+                }
+            }
+
+            void Fail()
+            {
+                error = Broken();
+                Invalidate();
+            }
+
+            void ClampUpper()
+            { if (Valid() && bounds.above(entry.key)) Invalidate(); }
+
+            void ClampLower()
+            { if (Valid() && bounds.below(entry.key)) Invalidate(); }
+
+            void SeekImpl(const Slice &target)
+            {
+                Status s = db->Find(target, entry, ordinal);
+                if (!s.ok())
+                {
+                    error = s;
+                    Invalidate();
+                }
+            }
+
+        public:
+            /// Whether key() and value() stay valid after moving walker.
+            static constexpr bool stable = true;
+
+            Walker(const MappedDB &origin) :
+                db(&origin), ordinal(origin.entries)
+            {}
+
+            bool Valid() const { return ordinal < db->entries; }
+
+            /// Restrict walker to range of keys [lower, upper).
+            /// Takes effect with next positioning (Seek, SeekToFirst etc).
+            void SetBounds(const Slice &lower, const Slice &upper)
+            { bounds.assign(lower, upper); }
+
+            /// Hint that all keys within bounds share first n octets.
+            /// Keys are compared as is anyway.
+            void SetCommonPrefix(size_t) {}
+
+            /// Hint that value() won't be used.
+            /// Values are never touched before value() call anyway.
+            void SetKeysOnly(bool) {}
+
+            void SeekToFirst()
+            {
+                if (bounds.lower.empty()) Load(0);
+                else SeekImpl(bounds.lower);
+                ClampUpper();
+            }
+
+            void SeekToLast()
+            {
+                if (bounds.upper.empty()) Load(db->entries - 1);
+                else
+                {
+                    SeekImpl(bounds.upper);
+                    if (!error.ok()) return;
+                    if (ordinal == 0) Invalidate();
+                    else Load(ordinal - 1);
+                }
+                ClampLower();
+            }
+
+            void Seek(const Slice &target)
+            {
+                SeekImpl(bounds.below(target) ? Slice(bounds.lower) : target);
+                ClampUpper();
+            }
+
+            void Next()
+            {
+                if (++ordinal >= db->entries) return Invalidate();
+                if (!db->Parse(entry.next, entry)) return Fail();
+                ClampUpper();
+            }
+
+            void Prev()
+            {
+                if (!Valid()) return SeekToLast();
+                if (ordinal == 0) return Invalidate();
+                Load(ordinal - 1);
+                ClampLower();
+            }
+
+            /// Take up to n entries starting from current one and move past
+            /// them. Entries stay valid as long as database does.
+            size_t NextBatch(KeyValue *out, size_t n)
+            {
+                size_t k = 0;
+                for (; k < n && Valid(); ++k)
+                {
+                    out[k] = { entry.key, entry.value };
+                    Next();
+                }
+                return k;
+            }
+
+            Slice key() const { return entry.key; }
+            Slice value() const { return entry.value; }
+
+            Status status() const
+            {
+                if (!error.ok()) return error;
+                return Valid() ? Status::OK() : Status::NotFound("invalid iterator");
+            }
+        };
+
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return asIterator(Walker(*this)); }
+    };
+}
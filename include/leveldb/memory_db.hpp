@@ -9,27 +9,58 @@
 
 namespace leveldb
 {
-    class MemoryDB final : private std::map<std::string, std::string>, public AnyDB
+    /// In-memory database with keys ordered by KeyOrder (see BytewiseOrder).
+    template <typename KeyOrder = BytewiseOrder>
+    class BasicMemoryDB final :
+        private std::map<std::string, std::string, KeyLess<KeyOrder>>,
+        public AnyDB
     {
+        using Map = std::map<std::string, std::string, KeyLess<KeyOrder>>;
+        using Map::emplace;
+        using Map::erase;
+        using Map::clear;
+
         size_t rev = 0;
     public:
-        using map::map;
+        using Map::Map;
+        using typename Map::iterator;
 
-        ~MemoryDB() noexcept override = default;
+        ~BasicMemoryDB() noexcept override = default;
 
-        using map::size;
-        using map::begin;
-        using map::end;
-        using map::empty;
+        using Map::size;
+        using Map::begin;
+        using Map::end;
+        using Map::empty;
+        using Map::find;
 
         Status Get(const Slice &key, std::string &value) noexcept override
         {
-            auto it = find(key.ToString());
+            auto it = find(key);
             if (it == end()) return Status::NotFound("key not found", key);
             value = it->second;
             return Status::OK();
         }
 
+        GetResult Lookup(const Slice &key, std::string &value, Status &) noexcept override
+        {
+            auto it = find(key);
+            if (it == end()) return GetResult::NotFound;
+            value = it->second;
+            return GetResult::Found;
+        }
+
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        {
+            auto it = find(key);
+            if (it == end())
+            {
+                value.Reset();
+                return Status::NotFound("key not found", key);
+            }
+            value.PinSlice(it->second);
+            return Status::OK();
+        }
+
         Status Put(const Slice &key, const Slice &value) noexcept override
         {
             auto v = value.ToString();
@@ -40,7 +71,10 @@ namespace leveldb
 
         Status Delete(const Slice &key) noexcept override
         {
-            if (erase(key.ToString()) > 0) ++rev;
+            auto it = find(key);
+            if (it == end()) return Status::OK();
+            erase(it);
+            ++rev;
             return Status::OK();
         }
 
@@ -53,13 +87,15 @@ namespace leveldb
 
         class Walker
         {
-            MemoryDB *rows;
-            MemoryDB::iterator impl; // may change after container change
+            BasicMemoryDB *rows;
+            iterator impl; // may change after container change
 
             // in case of deletion in container
             size_t rev;
             std::string savepoint;
 
+            BasicBounds<KeyOrder> bounds;
+
             // re-sync with container if needed
             bool Sync()
             {
@@ -83,11 +119,20 @@ namespace leveldb
                 { savepoint = impl->first; }
             }
 
-            void SeekImpl(const std::string &target)
+            void SeekImpl(const Slice &target)
             { impl = rows->lower_bound(target); }
 
+            // invalidate position that went out of bounds
+            void ClampUpper()
+            { if (Valid() && bounds.above(impl->first)) impl = rows->end(); }
+            void ClampLower()
+            { if (Valid() && bounds.below(impl->first)) impl = rows->end(); }
+
         public:
-            Walker(MemoryDB &origin) :
+            /// Whether key() and value() stay valid after moving walker.
+            static constexpr bool stable = true;
+
+            Walker(BasicMemoryDB &origin) :
                 rows(&origin),
                 rev(origin.rev)
             {}
@@ -103,32 +148,84 @@ namespace leveldb
             ///       be called and any movement must be performed before.
             bool Valid() const { return impl != rows->end(); }
 
-            void SeekToFirst() { impl = rows->begin(); Synced(); }
+            /// Restrict walker to range of keys [lower, upper).
+            /// Takes effect with next positioning (Seek, SeekToFirst etc).
+            void SetBounds(const Slice &lower, const Slice &upper)
+            { bounds.assign(lower, upper); }
+
+            /// Hint that all keys within bounds share first n octets.
+            /// Comparisons are left to the container.
+            void SetCommonPrefix(size_t) {}
+
+            /// Hint that value() won't be used.
+            /// Values are never touched before value() call anyway.
+            void SetKeysOnly(bool) {}
+
+            void SeekToFirst()
+            {
+                impl = bounds.lower.empty() ? rows->begin() : rows->lower_bound(bounds.lower);
+                ClampUpper();
+                Synced();
+            }
 
             void SeekToLast()
             {
-                impl = rows->end();
+                impl = bounds.upper.empty() ? rows->end() : rows->lower_bound(bounds.upper);
                 if (impl != rows->begin()) --impl;
+                else impl = rows->end();
+                ClampLower();
                 Synced();
             }
 
-            void Seek(const Slice &target) { SeekImpl(target.ToString()); Synced(); }
+            void Seek(const Slice &target)
+            {
+                SeekImpl(bounds.below(target) ? Slice(bounds.lower) : target);
+                ClampUpper();
+                Synced();
+            }
 
             void Next()
             {
-                if (Sync()) return; // already pointing to next record
+                if (Sync()) // already pointing to next record
+                {
+                    ClampUpper();
+                    return;
+                }
                 ++impl;
+                ClampUpper();
                 Synced();
             }
             void Prev() {
                 (void) Sync();
                 // no matter if Sync() automatically moved us forward or not we
                 // should move backward to get previous record
+                if (!Valid()) { SeekToLast(); return; }
                 if (impl == rows->begin()) impl = rows->end();
                 else --impl;
+                ClampLower();
                 Synced();
             }
 
+            /// Take up to n entries starting from current one and move past
+            /// them. Entries are valid till the change of container.
+            size_t NextBatch(KeyValue *out, size_t n)
+            {
+                (void) Sync(); // either pointing to current or next record
+                size_t k = 0;
+                for (; k < n && Valid(); ++k, ++impl)
+                {
+                    if (bounds.above(impl->first))
+                    {
+                        impl = rows->end();
+                        break;
+                    }
+                    out[k] = { impl->first, impl->second };
+                }
+                ClampUpper();
+                Synced();
+                return k;
+            }
+
             Slice key() const { return impl->first; }
             Slice value() const { return impl->second; }
 
@@ -140,5 +237,7 @@ namespace leveldb
 
         using AnyDB::Write;
     };
+
+    using MemoryDB = BasicMemoryDB<>;
 }
 
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/subtract_walker.hpp>
+
+namespace leveldb
+{
+    /// Walker over union of entries from several walkers in key order.
+    /// Entries with the same key are all visited in order of their sources.
+    ///
+    /// Keeps a heap of sources so each step costs O(log n) comparisons of
+    /// keys (as sources see them, i.e. without sandwich prefixes).
+    template <typename W, typename KeyOrder = BytewiseOrder>
+    class MergeWalker
+    {
+        std::vector<W> sources;
+        std::vector<size_t> heap; // valid sources with current on top
+        bool forward = true;
+        BatchBuffer batch;
+        size_t common = 0; // octets shared by all keys within bounds
+
+        // whether entry of source a goes before entry of source b
+        bool before(size_t a, size_t b) const
+        {
+            const Order r = compare<KeyOrder>(sources[a].key(), sources[b].key(), common);
+            return r == Order::LT || (r == Order::EQ && a < b);
+        }
+
+        void Rebuild(bool isForward)
+        {
+            forward = isForward;
+            heap.clear();
+            for (size_t i = 0; i < sources.size(); ++i)
+            {
+                if (sources[i].Valid()) heap.push_back(i);
+            }
+            std::make_heap(heap.begin(), heap.end(), heapOrder());
+        }
+
+        struct HeapOrder
+        {
+            // std heap keeps greatest element on top
+            const MergeWalker *self;
+            bool operator()(size_t a, size_t b) const
+            { return self->forward ? self->before(b, a) : self->before(a, b); }
+        };
+        HeapOrder heapOrder() const { return { this }; }
+
+        void Step()
+        {
+            std::pop_heap(heap.begin(), heap.end(), heapOrder());
+            const size_t i = heap.back();
+            if (forward) sources[i].Next();
+            else sources[i].Prev();
+            if (sources[i].Valid()) std::push_heap(heap.begin(), heap.end(), heapOrder());
+            else heap.pop_back();
+        }
+
+    public:
+        /// Whether key() and value() stay valid after moving walker.
+        static constexpr bool stable = W::stable;
+
+        MergeWalker(std::vector<W> &&walkers) :
+            sources(std::move(walkers))
+        {}
+
+        /// Restrict all sources to range of keys [lower, upper).
+        /// Takes effect with next positioning (Seek, SeekToFirst etc).
+        void SetBounds(const Slice &lower, const Slice &upper)
+        { for (auto &w : sources) w.SetBounds(lower, upper); }
+
+        /// Hint that all keys within bounds share first n octets so heap
+        /// comparisons may skip them.
+        void SetCommonPrefix(size_t n)
+        {
+            common = n;
+            for (auto &w : sources) w.SetCommonPrefix(n);
+        }
+
+        /// Hint that value() won't be used.
+        void SetKeysOnly(bool keysOnly)
+        { for (auto &w : sources) w.SetKeysOnly(keysOnly); }
+
+        bool Valid() const { return !heap.empty(); }
+
+        /// Index of walker (as passed to constructor) current entry comes
+        /// from.
+        size_t source() const { return heap.front(); }
+
+        Slice key() const { return sources[source()].key(); }
+        Slice value() const { return sources[source()].value(); }
+
+        Status status() const
+        {
+            for (const auto &w : sources)
+            {
+                Status s = w.status();
+                if (!s.ok() && !s.IsNotFound()) return s;
+            }
+            return Valid() ? Status::OK() : Status::NotFound("Merged walker is out of range");
+        }
+
+        void SeekToFirst()
+        {
+            for (auto &w : sources) w.SeekToFirst();
+            Rebuild(true);
+        }
+
+        void SeekToLast()
+        {
+            for (auto &w : sources) w.SeekToLast();
+            Rebuild(false);
+        }
+
+        void Seek(const Slice &target)
+        {
+            for (auto &w : sources) w.Seek(target);
+            Rebuild(true);
+        }
+
+        void Next()
+        {
+            assert( Valid() );
+            if (!forward)
+            {
+                // move others to the first entry after current one
+                const size_t c = source();
+                const std::string k = key().ToString();
+                for (size_t i = 0; i < sources.size(); ++i)
+                {
+                    if (i == c) continue;
+                    auto &w = sources[i];
+                    w.Seek(k);
+                    if (w.Valid() && i < c && compare<KeyOrder>(w.key(), k) == Order::EQ) w.Next();
+                }
+                Rebuild(true);
+                assert( source() == c );
+            }
+            Step();
+        }
+
+        void Prev()
+        {
+            assert( Valid() );
+            if (forward)
+            {
+                // move others to the last entry before current one
+                const size_t c = source();
+                const std::string k = key().ToString();
+                for (size_t i = 0; i < sources.size(); ++i)
+                {
+                    if (i == c) continue;
+                    auto &w = sources[i];
+                    w.Seek(k);
+                    if (!w.Valid()) w.SeekToLast();
+                    else if (compare<KeyOrder>(w.key(), k) == Order::GT || i > c) w.Prev();
+                }
+                Rebuild(false);
+                assert( source() == c );
+            }
+            Step();
+        }
+
+        /// Take up to n entries starting from current one and move past them.
+        size_t NextBatch(KeyValue *out, size_t n)
+        {
+            batch.clear();
+            size_t k = 0;
+            for (; k < n && Valid(); ++k)
+            {
+                if (stable) out[k] = { key(), value() };
+                else batch.add(key(), value());
+                Next();
+            }
+            if (!stable) batch.fill(out);
+            return k;
+        }
+    };
+}
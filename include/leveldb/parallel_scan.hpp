@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/walker.hpp>
+
+namespace leveldb
+{
+    namespace detail
+    {
+        // first octet where a and b of length n differ (n if there is none)
+        inline size_t mismatch(const char *a, const char *b, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                uint64_t x, y;
+                std::memcpy(&x, a + i, 8);
+                std::memcpy(&y, b + i, 8);
+                if (x == y) continue;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                return i + static_cast<size_t>(__builtin_ctzll(x ^ y)) / 8;
+#else
+                break; // find it octet by octet
+#endif
+            }
+            while (i < n && a[i] == b[i]) ++i;
+            return i;
+        }
+    }
+
+    /// Split key range [lower, upper) of database into at most n subranges
+    /// holding roughly equal amount of data.
+    ///
+    /// Split points are interpolated between the first and the last key in
+    /// range and weighted with approximateSize() when database can tell it.
+    /// Otherwise keys are assumed to be spread evenly.
+    ///
+    /// \param ranges  receives subranges in key order (nothing for an empty
+    ///                range); empty upper stands for no limit as in Bounds
+    template <typename DB>
+    Status splitRange(DB &db, const Slice &lower, const Slice &upper, size_t n,
+                      std::vector<Bounds> &ranges)
+    {
+        ranges.clear();
+
+        std::string first, last;
+        {
+            auto w = walkKeys(db);
+            w.SetBounds(lower, upper);
+            w.SeekToFirst();
+            if (!w.Valid())
+            {
+                Status s = w.status();
+                return s.ok() || s.IsNotFound() ? Status::OK() : s;
+            }
+            first = w.key().ToString();
+            w.SeekToLast();
+            if (!w.Valid()) return w.status();
+            last = w.key().ToString();
+        }
+
+        // interpolate over 8 octets that follow common prefix
+        const size_t common = detail::mismatch(first.data(), last.data(),
+                                               std::min(first.size(), last.size()));
+        auto load = [common](const std::string &key) {
+            uint64_t x = 0;
+            for (size_t i = 0; i < 8; ++i)
+            {
+                const size_t j = common + i;
+                x = (x << 8) | (j < key.size() ? static_cast<unsigned char>(key[j]) : 0u);
+            }
+            return x;
+        };
+        const uint64_t a = load(first), b = load(last);
+
+        // oversample to let weights balance pieces
+        std::vector<std::string> bounds { lower.ToString() };
+        const uint64_t m = n > 1 ? uint64_t(n) * 8 : 1;
+        const uint64_t step = (b - a) / m, rest = (b - a) % m;
+        for (uint64_t i = 1; i < m && a < b; ++i)
+        {
+            const uint64_t x = a + step * i + rest * i / m;
+            std::string key = first.substr(0, common);
+            for (int shift = 56; shift >= 0; shift -= 8)
+            { key.push_back(static_cast<char>((x >> shift) & 0xff)); }
+            if (Slice(key).compare(first) > 0 && Slice(key).compare(bounds.back()) > 0)
+            { bounds.push_back(std::move(key)); }
+        }
+        bounds.push_back(upper.ToString());
+
+        std::vector<uint64_t> weights(bounds.size() - 1);
+        uint64_t total = 0;
+        for (size_t i = 0; i < weights.size(); ++i)
+        { total += weights[i] = approximateSize(db, bounds[i], bounds[i + 1]); }
+        if (total == 0)
+        {
+            std::fill(weights.begin(), weights.end(), 1);
+            total = weights.size();
+        }
+
+        // greedily group intervals into pieces of equal weight
+        ranges.push_back(Bounds { bounds.front(), std::string() });
+        uint64_t acc = 0;
+        for (size_t i = 0; i + 1 < weights.size(); ++i)
+        {
+            acc += weights[i];
+            if (ranges.size() < n && acc * n >= total * ranges.size())
+            {
+                ranges.back().upper = bounds[i + 1];
+                ranges.push_back(Bounds { bounds[i + 1], std::string() });
+            }
+        }
+        ranges.back().upper = bounds.back();
+        return Status::OK();
+    }
+
+    /// Walk over key range [lower, upper) of database with several threads
+    /// calling f(key, value) for each entry.
+    ///
+    /// Range is split into more pieces than there are threads and each
+    /// thread picks up the next piece as soon as it is done with previous
+    /// one, so a dense piece doesn't keep other threads idle.
+    ///
+    /// \param threads  amount of threads (0 for amount of cores)
+    /// \note f is called concurrently and in no particular order (see
+    ///       orderedScan() for the other case)
+    /// \note walkers are created and destroyed on calling thread since some
+    ///       of them register within their database (i.e. TxnDB), so only
+    ///       reading through them has to be thread-safe
+    template <typename DB, typename F>
+    Status parallelScan(DB &db, const Slice &lower, const Slice &upper, size_t threads, F &&f)
+    {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::vector<Bounds> ranges;
+        Status s = splitRange(db, lower, upper, threads * 4, ranges);
+        if (!s.ok() || ranges.empty()) return s;
+
+        // one walker per thread reused for each piece it picks up
+        std::deque<typename DB::Walker> walkers;
+        for (size_t i = 0; i < std::min(threads, ranges.size()); ++i) walkers.emplace_back(db);
+
+        std::atomic<size_t> next { 0 };
+        std::atomic<bool> failed { false };
+        std::mutex lock; // guards s
+
+        auto work = [&](typename DB::Walker &w) {
+            KeyValue entries[64];
+            for (size_t i; !failed && (i = next++) < ranges.size(); )
+            {
+                w.SetBounds(ranges[i].lower, ranges[i].upper);
+                w.SeekToFirst();
+                while (size_t k = w.NextBatch(entries, 64))
+                {
+                    for (size_t j = 0; j < k; ++j) f(entries[j].key, entries[j].value);
+                    if (failed) return;
+                }
+                Status ws = w.status();
+                if (!ws.ok() && !ws.IsNotFound())
+                {
+                    std::lock_guard<std::mutex> guard { lock };
+                    if (!failed) s = ws;
+                    failed = true;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < walkers.size(); ++i) workers.emplace_back(work, std::ref(walkers[i]));
+        work(walkers.front());
+        for (auto &worker : workers) worker.join();
+        return s;
+    }
+
+    /// Walk over key range [lower, upper) of database with several threads
+    /// reading ahead while f(key, value) is called from calling thread in
+    /// key order.
+    ///
+    /// \param threads  amount of threads (0 for amount of cores)
+    /// \param chunk    amount of entries handed over to f at once; each
+    ///                 thread keeps at most two chunks ahead
+    /// \note walkers are created on calling thread as in parallelScan()
+    template <typename DB, typename F>
+    Status orderedScan(DB &db, const Slice &lower, const Slice &upper, size_t threads, F &&f,
+                       size_t chunk = 1024)
+    {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::vector<Bounds> ranges;
+        Status s = splitRange(db, lower, upper, threads * 4, ranges);
+        if (!s.ok()) return s;
+
+        using Chunk = std::vector<std::pair<std::string, std::string>>;
+        struct Piece
+        {
+            std::deque<Chunk> chunks;
+            bool done = false;
+            Status status;
+        };
+        std::vector<Piece> pieces(ranges.size());
+        std::mutex lock;
+        std::condition_variable changed;
+        bool stopping = false;
+        std::atomic<size_t> next { 0 };
+
+        std::deque<typename DB::Walker> walkers;
+        for (size_t i = 0; i < std::min(threads, ranges.size()); ++i) walkers.emplace_back(db);
+
+        // pieces are taken in order so the one consumed now is always
+        // either done or in progress
+        auto work = [&](typename DB::Walker &w) {
+            KeyValue entries[64];
+            for (size_t i; (i = next++) < ranges.size(); )
+            {
+                w.SetBounds(ranges[i].lower, ranges[i].upper);
+                w.SeekToFirst();
+                Chunk ready;
+                for (;;)
+                {
+                    const size_t k = w.NextBatch(entries, 64);
+                    for (size_t j = 0; j < k; ++j)
+                    { ready.emplace_back(entries[j].key.ToString(), entries[j].value.ToString()); }
+                    if (k > 0 && ready.size() < chunk) continue;
+
+                    std::unique_lock<std::mutex> guard { lock };
+                    changed.wait(guard, [&] { return stopping || pieces[i].chunks.size() < 2; });
+                    if (stopping) return;
+                    if (!ready.empty()) pieces[i].chunks.push_back(std::move(ready));
+                    ready.clear();
+                    if (k == 0)
+                    {
+                        pieces[i].done = true;
+                        pieces[i].status = w.status();
+                    }
+                    changed.notify_all();
+                    if (k == 0) break;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (auto &w : walkers) workers.emplace_back(work, std::ref(w));
+
+        for (auto &piece : pieces)
+        {
+            for (;;)
+            {
+                Chunk current;
+                {
+                    std::unique_lock<std::mutex> guard { lock };
+                    changed.wait(guard, [&] { return piece.done || !piece.chunks.empty(); });
+                    if (piece.chunks.empty())
+                    {
+                        if (!piece.status.ok() && !piece.status.IsNotFound()) s = piece.status;
+                        break;
+                    }
+                    current = std::move(piece.chunks.front());
+                    piece.chunks.pop_front();
+                    changed.notify_all();
+                }
+                for (const auto &entry : current) f(Slice(entry.first), Slice(entry.second));
+            }
+            if (!s.ok()) break;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard { lock };
+            stopping = true;
+        }
+        changed.notify_all();
+        for (auto &worker : workers) worker.join();
+        return s;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <leveldb/iterator.h>
+
+namespace leveldb
+{
+    /// Value obtained through AnyDB::GetPinned().
+    ///
+    /// Either borrows memory of underlying database (optionally kept alive by
+    /// an iterator it holds) or owns a copy of value in its own buffer.
+    ///
+    /// \note borrowed memory of in-memory databases stays valid only till
+    ///       the next change of that entry, while iterator pinned memory
+    ///       holds leveldb resources so release it as soon as possible
+    class PinnedSlice : public Slice
+    {
+        std::string buffer;
+        std::unique_ptr<Iterator> pin;
+        bool self = false;
+
+    public:
+        PinnedSlice() = default;
+
+        PinnedSlice(const PinnedSlice &) = delete;
+        PinnedSlice &operator=(const PinnedSlice &) = delete;
+
+        PinnedSlice(PinnedSlice &&origin) { *this = std::move(origin); }
+
+        PinnedSlice &operator=(PinnedSlice &&origin)
+        {
+            buffer = std::move(origin.buffer);
+            pin = std::move(origin.pin);
+            self = origin.self;
+            if (self) Slice::operator=(buffer);
+            else Slice::operator=(origin);
+            origin.Reset();
+            return *this;
+        }
+
+        /// Borrow memory that is kept valid by holder (if any).
+        void PinSlice(const Slice &value, std::unique_ptr<Iterator> &&holder = nullptr)
+        {
+            pin = std::move(holder);
+            self = false;
+            Slice::operator=(value);
+        }
+
+        /// Own a copy of value.
+        void PinSelf(const Slice &value)
+        {
+            GetSelf().assign(value.data(), value.size());
+            PinSelf();
+        }
+
+        /// Access own buffer for filling it in and then calling PinSelf().
+        std::string &GetSelf()
+        {
+            pin.reset();
+            return buffer;
+        }
+
+        /// Use own buffer filled through GetSelf().
+        void PinSelf()
+        {
+            self = true;
+            Slice::operator=(buffer);
+        }
+
+        /// Release any pinned resources.
+        void Reset()
+        {
+            pin.reset();
+            buffer.clear();
+            self = false;
+            clear();
+        }
+
+        bool IsPinned() const { return !self; }
+    };
+}
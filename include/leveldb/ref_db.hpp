@@ -1,5 +1,7 @@
 #pragma once
 
+#include <utility>
+
 #include <leveldb/any_db.hpp>
 #include <leveldb/walker.hpp>
 
@@ -19,6 +21,10 @@ namespace leveldb
 
         Status Get(const Slice &key, std::string &value) noexcept override
         { return impl.Get(key, value); }
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        { return impl.Lookup(key, value, status); }
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        { return impl.GetPinned(key, value); }
         Status Put(const Slice &key, const Slice &value) noexcept override
         { return impl.Put(key, value); }
         Status Delete(const Slice &key) noexcept override
@@ -36,5 +42,15 @@ namespace leveldb
 
         Status Write(WriteBatch &updates)
         { return impl.Write(updates); }
+
+        template <typename T = Impl>
+        auto CompactRange(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().CompactRange(lower, upper))
+        { return impl.CompactRange(lower, upper); }
+
+        template <typename T = Impl>
+        auto GetApproximateSize(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().GetApproximateSize(lower, upper))
+        { return impl.GetApproximateSize(lower, upper); }
     };
 }
@@ -1,32 +1,118 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include <leveldb/any_db.hpp>
+#include <leveldb/cookie_table.hpp>
+#include <leveldb/merge_walker.hpp>
 #include <leveldb/ref_db.hpp>
 #include <leveldb/walker.hpp>
 #include <leveldb/sequence.hpp>
 
 namespace leveldb
 {
-    template <typename Base, typename Prefix = unsigned short>
+    /// Statistics of a SandwichDB part.
+    struct PartStats
+    {
+        uint64_t keys = 0;
+        uint64_t bytes = 0; ///< sum of key and value sizes within part
+        uint64_t physical = 0; ///< approximate size in underlying storage
+    };
+
+    /// Multiple AnyDB in one by prefixing keys of each part with a cookie.
+    ///
+    /// \typeparam Encoding of cookies in keys. Default host_order keeps
+    ///             layout of existing databases while varint_order gives short
+    ///             and ordered prefixes (see migrate() for switching).
+    /// \note Base should keep keys in BytewiseOrder: ranges of parts and of
+    ///       internal entries are built from cookies octet by octet.
+    template <typename Base, typename Prefix = unsigned short,
+              template <typename> class Encoding = host_order>
     class SandwichDB final
     {
+        template <typename, typename, template <typename> class>
+        friend class SandwichDB;
+
     public:
         class Part;
+        class MergedWalker;
 
     private:
         Base base;
         Part meta { *this };
         Sequence<Prefix> seq { meta, Slice() };
 
+        // name to cookie mapping loaded from meta part (null if not loaded
+        // yet); changed in place and replaced by a bigger copy once full
+        struct Names
+        {
+            CookieTable<Prefix> table;
+            std::atomic<uint64_t> generation; // of mapping in meta part it reflects
+
+            explicit Names(uint64_t generation) : generation(generation) {}
+            Names(const Names &other, size_t capacity) :
+                table(other.table, capacity), generation(other.generation.load())
+            {}
+        };
+        std::shared_ptr<Names> cookies;
+        std::mutex cookiesLock; // serializes changes of cookies
+
+        // bumped on drop, truncate, rename and swap through any of sandwiches
+        // created with ref() from each other so they drop stale tables
+        std::shared_ptr<std::atomic<uint64_t>> generation =
+            std::make_shared<std::atomic<uint64_t>>(0);
+        bool remapped = false; // names were changed through this sandwich
+
+        // changes of part statistics not stored in meta part yet
+        struct StatsDelta
+        {
+            int64_t keys = 0;
+            int64_t bytes = 0;
+        };
+        std::unordered_map<Prefix, StatsDelta> statsDeltas;
+        std::mutex statsLock;
+        std::atomic<bool> tracking { false };
+
     public:
-        SandwichDB(SandwichDB<Base,Prefix> &&orig) :
-            base(std::move(orig.base))
-        {}
+        SandwichDB(SandwichDB<Base, Prefix, Encoding> &&orig) :
+            base(std::move(orig.base)),
+            cookies(std::move(orig.cookies)),
+            generation(orig.generation),
+            remapped(orig.remapped),
+            tracking(orig.tracking.load())
+        {
+            orig.remapped = false;
+            std::lock_guard<std::mutex> guard { orig.statsLock };
+            statsDeltas = std::move(orig.statsDeltas);
+            orig.statsDeltas.clear();
+        }
 
         template <typename... Args>
         SandwichDB(Args &&... args) : base(std::forward<Args>(args)...)
         {}
 
+        ~SandwichDB()
+        {
+            // pending stats would be lost otherwise (errors have nowhere to
+            // go here, call Sync() to see them)
+            (void) SyncStats();
+
+            // changes made through a transaction reach other sandwiches
+            // only on commit, which usually happens before this point
+            if (remapped) generation->fetch_add(1);
+        }
+
         Base &operator*() { return base; }
         Base *operator->() { return &base; }
 
@@ -35,15 +121,21 @@ namespace leveldb
         /// \typeparam T refers to embeded database type that can be
         /// constructed out of reference to current one.
         ///
-        /// Usually used to create transaction/refs
+        /// Usually used to create transaction/refs. Drop, truncate, rename
+        /// and swap of parts through any of such sandwiches are seen by the
+        /// others (for transactions once its sandwich is destroyed).
         template <typename T = RefDB<Base>>
-        SandwichDB<T, Prefix> ref()
-        { return base; }
+        SandwichDB<T, Prefix, Encoding> ref()
+        {
+            SandwichDB<T, Prefix, Encoding> other { base };
+            other.generation = generation;
+            return other;
+        }
         template <template<typename> class T>
-        SandwichDB<T<Base>, Prefix> ref()
-        { return base; }
+        SandwichDB<T<Base>, Prefix, Encoding> ref()
+        { return ref<T<Base>>(); }
 
-        using Cookie = host_order<Prefix>;
+        using Cookie = Encoding<Prefix>;
 
         /// Obtain part of sandwich
         Part use(Cookie cookie)
@@ -54,39 +146,497 @@ namespace leveldb
         /// \param result  ref to memory cell that receives cookie if status is
         ///                success
         ///
-        /// \note this call should be a pretty rare because it actually does
-        ///       lookup for an entry in database
+        /// \note known names are resolved through in-memory table without
+        ///       taking cookiesLock, so this is safe and cheap to call from
+        ///       many threads (std::atomic_load of shared_ptr may still use
+        ///       a short internal lock in standard library)
         Status cook(const Slice &name, Cookie &cookie)
         {
-            Status s;
-            assert( !name.empty() );
+            assert( !internal(name) );
 
+            Prefix known;
+            const auto names = std::atomic_load(&cookies);
+            if (names && names->generation == generation->load() &&
+                names->table.find(name, known))
+            {
+                cookie = known;
+                return Status::OK();
+            }
+            return cookSlow(name, cookie);
+        }
+
+    private:
+        // meta entries that aren't names of parts: empty key for sequence
+        // and keys starting with '\0' followed by a tag and a cookie
+        static bool internal(const Slice &name)
+        { return name.empty() || name[0] == '\0'; }
+
+        static constexpr char retiredTag = 'r';
+        static constexpr char statsTag = 's';
+        static constexpr char dictionaryTag = 'd';
+
+        static std::string internalKey(char tag, const Cookie &cookie)
+        {
+            std::string key { '\0', tag };
+            key.append(cookie.data(), cookie.size());
+            return key;
+        }
+
+        // shortest key that follows any key with given prefix (empty for
+        // the last possible prefix)
+        static std::string successor(const Cookie &cookie)
+        {
+            std::string key(cookie.data(), cookie.size());
+            while (!key.empty() && key.back() == '\xff') key.pop_back();
+            if (!key.empty()) ++key.back();
+            return key;
+        }
+
+        static void decodeStats(const std::string &v, PartStats &stats)
+        {
+            if (v.size() < 2 * sizeof(uint64_t)) return;
+            (void) memcpy(&stats.keys, v.data(), sizeof(uint64_t));
+            (void) memcpy(&stats.bytes, v.data() + sizeof(uint64_t), sizeof(uint64_t));
+        }
+
+        static std::string encodeStats(const PartStats &stats)
+        {
+            std::string v(2 * sizeof(uint64_t), '\0');
+            (void) memcpy(&v[0], &stats.keys, sizeof(uint64_t));
+            (void) memcpy(&v[sizeof(uint64_t)], &stats.bytes, sizeof(uint64_t));
+            return v;
+        }
+
+        static uint64_t apply(uint64_t stored, int64_t delta)
+        {
+            // clamp inconsistent results (i.e. after crash without Sync)
+            if (delta < 0 && stored < uint64_t(-delta)) return 0;
+            return stored + uint64_t(delta);
+        }
+
+        Status LoadStats(const Cookie &cookie, PartStats &stats)
+        {
+            std::string v;
+            Status s = meta.Get(internalKey(statsTag, cookie), v);
+            if (s.IsNotFound()) return Status::OK();
+            if (s.ok()) decodeStats(v, stats);
+            return s;
+        }
+
+        void account(Prefix cookie, int64_t keys, int64_t bytes)
+        {
+            std::lock_guard<std::mutex> guard { statsLock };
+            auto &delta = statsDeltas[cookie];
+            delta.keys += keys;
+            delta.bytes += bytes;
+        }
+
+        Status SyncStats()
+        {
+            // stored entry by entry so this also works over databases
+            // without Write() (needed on destruction) and a failure keeps
+            // only changes not stored yet
+            std::lock_guard<std::mutex> guard { statsLock };
+            for (auto it = statsDeltas.begin(); it != statsDeltas.end(); it = statsDeltas.erase(it))
+            {
+                const Cookie cookie { it->first };
+                PartStats stats;
+                Status s = LoadStats(cookie, stats);
+                if (!s.ok()) return s;
+                stats.keys = apply(stats.keys, it->second.keys);
+                stats.bytes = apply(stats.bytes, it->second.bytes);
+                s = meta.Put(internalKey(statsTag, cookie), encodeStats(stats));
+                if (!s.ok()) return s;
+            }
+            return Status::OK();
+        }
+
+        Status allocate(Cookie &cookie)
+        {
+            Status s = seq.Next(cookie);
+            if (s.ok() && cookie == Prefix(0)) s = seq.Next(cookie); // skip meta part
+            return s;
+        }
+
+        // move cookie of a part to retired ones and optionally give a fresh
+        // one to its name in a single update of meta part
+        Status retire(const Slice &name, bool renew)
+        {
+            assert( !internal(name) );
+            std::lock_guard<std::mutex> guard { cookiesLock };
+
+            Cookie cookie;
+            Status s = Known(name, cookie);
+            if (s.IsNotFound()) return Status::OK(); // nothing to retire
+            if (!s.ok()) return s;
+
+            WriteBatch batch;
+            batch.Put(internalKey(retiredTag, cookie), name);
+            batch.Delete(internalKey(statsTag, cookie));
+            batch.Delete(internalKey(dictionaryTag, cookie));
+            Cookie fresh;
+            if (renew)
+            {
+                s = allocate(fresh);
+                if (!s.ok()) return s;
+                batch.Put(name, fresh);
+            }
+            else
+            {
+                batch.Delete(name);
+            }
+            s = meta.Write(batch);
+            if (!s.ok()) return s;
+
+            {
+                std::lock_guard<std::mutex> statsGuard { statsLock };
+                (void) statsDeltas.erase(cookie);
+            }
+
+            // forget old mapping
+            Patch(Remapped(), [&](CookieTable<Prefix> &table) {
+                if (renew) table.assign(name, fresh);
+                else table.erase(name);
+            });
+            return Status::OK();
+        }
+
+        Status Known(const Slice &name, Cookie &cookie)
+        {
             std::string v;
-            s = meta.Get(name, v);
+            Status s = meta.Get(name, v);
+            if (!s.ok()) return s;
+            if (Cookie::corrupted(v))
+            { return Status::Corruption("Invalid sandwich mapping entry"); }
+            cookie = Slice(v);
+            return s;
+        }
+
+        // let other sandwiches know their tables are stale
+        // \return generation this change is based on
+        uint64_t Remapped()
+        {
+            remapped = true;
+            return generation->fetch_add(1);
+        }
+
+        // apply change f in place to table that was up to date before the
+        // change instead of scanning whole meta part again; readers see
+        // generation bumped by Remapped() meanwhile and wait in cookSlow()
+        template <typename F>
+        void Patch(uint64_t seen, F &&f)
+        {
+            if (!cookies || cookies->generation != seen) return; // reloaded by cookSlow()
+            if (cookies->table.full()) Grow(); // room for a new name
+            f(cookies->table);
+            cookies->generation = seen + 1;
+        }
+
+        // replace full table with a copy of double capacity (without dead
+        // entries), so adding n names costs O(n) overall
+        void Grow()
+        {
+            std::atomic_store(&cookies, std::make_shared<Names>(*cookies, 2 * cookies->table.size()));
+        }
+
+        Status LoadCookies()
+        {
+            // generation is taken before scan so concurrent change of meta
+            // part leaves this table stale rather than wrong
+            auto names = std::make_shared<Names>(generation->load());
+            typename Part::Walker w { meta };
+            for (w.SeekToFirst(); w.Valid(); w.Next())
+            {
+                // skip internal entries and leave broken ones to cookSlow()
+                if (internal(w.key()) || Cookie::corrupted(w.value())) continue;
+                names->table.add(w.key(), Cookie(w.value()));
+            }
+            Status s = w.status();
+            if (!s.ok() && !s.IsNotFound()) return s;
+
+            std::atomic_store(&cookies, std::move(names));
+            return Status::OK();
+        }
+
+        // new names go into shared table in place while it has room
+        void Remember(const Slice &name, Prefix cookie)
+        {
+            if (cookies->table.full()) Grow();
+            cookies->table.add(name, cookie);
+        }
+
+        // lookup for an entry in database and allocate new one if missing
+        Status cookSlow(const Slice &name, Cookie &cookie)
+        {
+            std::lock_guard<std::mutex> guard { cookiesLock };
+
+            Status s;
+            if (!cookies || cookies->generation != generation->load())
+            {
+                s = LoadCookies();
+                if (!s.ok()) return s;
+
+                Prefix known;
+                if (cookies->table.find(name, known))
+                {
+                    cookie = known;
+                    return s;
+                }
+            }
+
+            // entry may be added through another sandwich over the same base
+            s = Known(name, cookie);
             if (s.ok())
             {
-                if (Cookie::corrupted(v))
-                { return Status::Corruption("Invalid sandwich mapping entry"); }
-                cookie = v;
+                Remember(name, cookie);
                 return s;
             }
             else if (s.IsNotFound())
             {
                 Cookie nextCookie;
-                s = seq.Next(nextCookie);
-                if (s.ok() && nextCookie == 0) s = seq.Next(nextCookie); // skip meta part
+                s = allocate(nextCookie);
                 if (s.ok()) s = meta.Put(name, nextCookie);
-                if (s.ok()) cookie = nextCookie;
+                if (s.ok())
+                {
+                    cookie = nextCookie;
+                    Remember(name, cookie);
+                }
                 return s;
             }
             else
             { return s; }
         }
 
+    public:
+        /// Call f(name, cookie) for each part known in this sandwich.
+        template <typename F>
+        Status forEachPart(F &&f)
+        {
+            typename Part::Walker w { meta };
+            for (w.SeekToFirst(); w.Valid(); w.Next())
+            {
+                if (internal(w.key())) continue;
+                if (Cookie::corrupted(w.value()))
+                { return Status::Corruption("Invalid sandwich mapping entry"); }
+                f(w.key(), Cookie(w.value()));
+            }
+            Status s = w.status();
+            return s.IsNotFound() ? Status::OK() : s;
+        }
+
+        /// Drop part with specified name without touching its keys.
+        /// Name becomes free for a fresh part right away while keys of the
+        /// dropped one are left for reclaim().
+        ///
+        /// \note Part objects obtained for this name before shouldn't be
+        ///       used anymore
+        Status drop(const Slice &name)
+        { return retire(name, false); }
+
+        /// Make part with specified name empty in the same way as drop()
+        /// does by switching its name to a fresh cookie.
+        Status truncate(const Slice &name)
+        { return retire(name, true); }
+
+        /// Give part another name in place without touching its keys.
+        ///
+        /// \note Part objects obtained before stay bound to the same keys
+        ///       rather than to the name
+        Status rename(const Slice &from, const Slice &to)
+        {
+            assert( !internal(from) && !internal(to) );
+            std::lock_guard<std::mutex> guard { cookiesLock };
+
+            Cookie cookie, existing;
+            Status s = Known(from, cookie);
+            if (!s.ok()) return s;
+            s = Known(to, existing);
+            if (s.ok()) return Status::InvalidArgument("Sandwich part already exists", to);
+            if (!s.IsNotFound()) return s;
+
+            WriteBatch batch;
+            batch.Delete(from);
+            batch.Put(to, cookie);
+            s = meta.Write(batch);
+            if (!s.ok()) return s;
+            Patch(Remapped(), [&](CookieTable<Prefix> &table) {
+                table.erase(from);
+                table.assign(to, cookie);
+            });
+            return Status::OK();
+        }
+
+        /// Exchange names of two parts atomically.
+        /// Allows to fill a shadow part and replace contents of the live one
+        /// with it at once (and then drop the shadow one).
+        ///
+        /// \note Part objects obtained before stay bound to the same keys
+        ///       rather than to the name
+        Status swap(const Slice &a, const Slice &b)
+        {
+            assert( !internal(a) && !internal(b) );
+            std::lock_guard<std::mutex> guard { cookiesLock };
+
+            Cookie ca, cb;
+            Status s = Known(a, ca);
+            if (s.ok()) s = Known(b, cb);
+            if (!s.ok()) return s;
+
+            WriteBatch batch;
+            batch.Put(a, cb);
+            batch.Put(b, ca);
+            s = meta.Write(batch);
+            if (!s.ok()) return s;
+            Patch(Remapped(), [&](CookieTable<Prefix> &table) {
+                table.assign(a, cb);
+                table.assign(b, ca);
+            });
+            return Status::OK();
+        }
+
+        /// Delete up to limit keys left by dropped and truncated parts.
+        /// Underlying database is asked to compact range of each part once
+        /// it is cleaned up completely.
+        ///
+        /// Meant to be called repeatedly with pauses (see Reclaimer) to
+        /// throttle load on underlying database.
+        ///
+        /// \return NotFound if there is nothing left to reclaim
+        Status reclaim(size_t limit = 1024)
+        {
+            typename Part::Walker r { meta };
+            const char range[] = { '\0', retiredTag, '\0', char(retiredTag + 1) };
+            r.SetBounds(Slice(range, 2), Slice(range + 2, 2));
+            r.SeekToFirst();
+            if (!r.Valid())
+            {
+                Status s = r.status();
+                return s.ok() || s.IsNotFound() ? Status::NotFound("Nothing to reclaim") : s;
+            }
+
+            const std::string retiredKey = r.key().ToString();
+            const Slice encoded { retiredKey.data() + 2, retiredKey.size() - 2 };
+            if (Cookie::corrupted(encoded))
+            { return Status::Corruption("Invalid retired sandwich entry"); }
+            const Cookie cookie { encoded };
+            const std::string lower { cookie.data(), cookie.size() };
+            const std::string upper = successor(cookie);
+
+            WriteBatch batch;
+            size_t n = 0;
+            typename Base::Walker w { base };
+            w.SetBounds(lower, upper);
+            w.SetKeysOnly(true);
+            for (w.SeekToFirst(); w.Valid() && n < limit; w.Next(), ++n)
+            { batch.Delete(w.key()); }
+            if (!w.Valid())
+            {
+                Status s = w.status();
+                if (!s.ok() && !s.IsNotFound()) return s;
+            }
+
+            Status s;
+            if (n > 0) s = base.Write(batch);
+            if (s.ok() && n < limit) // whole range is deleted
+            {
+                compactRange(base, lower, upper);
+                s = meta.Delete(retiredKey);
+            }
+            return s;
+        }
+
+        /// Keep key counts and sizes of parts up to date on each update.
+        /// That costs a lookup of previous value on each Put/Delete/Write
+        /// so it is off by default. Use recount() for parts that were
+        /// updated while tracking was off.
+        ///
+        /// \note counts are exact as long as same key isn't updated
+        ///       concurrently
+        void trackStats(bool enable = true)
+        { tracking = enable; }
+
+        bool trackingStats() const
+        { return tracking; }
+
+        /// Statistics of a part without scanning it.
+        /// Changes are stored in meta part on Sync() or on destruction.
+        Status stats(const Cookie &cookie, PartStats &stats)
+        {
+            stats = PartStats();
+            Status s = LoadStats(cookie, stats);
+            if (!s.ok()) return s;
+            {
+                std::lock_guard<std::mutex> guard { statsLock };
+                auto it = statsDeltas.find(cookie);
+                if (it != statsDeltas.end())
+                {
+                    stats.keys = apply(stats.keys, it->second.keys);
+                    stats.bytes = apply(stats.bytes, it->second.bytes);
+                }
+            }
+            const std::string lower { cookie.data(), cookie.size() };
+            stats.physical = approximateSize(base, lower, successor(cookie));
+            return s;
+        }
+
+        /// Calculate statistics of a part by scanning it.
+        Status recount(const Slice &name)
+        {
+            Cookie cookie;
+            Status s = cook(name, cookie);
+            if (!s.ok()) return s;
+
+            PartStats stats;
+            auto part = use(cookie);
+            typename Part::Walker w { part };
+            for (w.SeekToFirst(); w.Valid(); w.Next())
+            {
+                ++stats.keys;
+                stats.bytes += w.key().size() + w.value().size();
+            }
+            s = w.status();
+            if (!s.ok() && !s.IsNotFound()) return s;
+
+            std::lock_guard<std::mutex> guard { statsLock };
+            s = meta.Put(internalKey(statsTag, cookie), encodeStats(stats));
+            if (s.ok()) (void) statsDeltas.erase(cookie);
+            return s;
+        }
+
+        /// Compression dictionary of a part (see CompressedDB).
+        /// NotFound if none was set.
+        Status dictionary(const Cookie &cookie, std::string &dict)
+        { return meta.Get(internalKey(dictionaryTag, cookie), dict); }
+
+        /// Store compression dictionary of a part. Values compressed with
+        /// it don't refer to it, so once set it can't be replaced by other
+        /// one (fill a fresh part and swap() instead).
+        Status setDictionary(const Cookie &cookie, const Slice &dict)
+        {
+            const std::string key = internalKey(dictionaryTag, cookie);
+            std::string stored;
+            Status s = meta.Get(key, stored);
+            if (s.ok())
+            {
+                return Slice(stored) == dict ? s
+                    : Status::InvalidArgument("Sandwich part has other dictionary already");
+            }
+            if (!s.IsNotFound()) return s;
+            return meta.Put(key, dict);
+        }
+
+        /// Write batch prepared for a part into underlying database.
+        Status Write(typename Part::Batch &batch)
+        { return base.Write(batch.updates); }
+
         /// Synchronize meta-data back to underground layer.
         /// This should be done before destroying object
         Status Sync()
-        { return seq.Sync(); }
+        {
+            Status s = seq.Sync();
+            if (s.ok()) s = SyncStats();
+            return s;
+        }
 
         /// Just an easy interface around cookie()
         Part use(const Slice &name)
@@ -99,13 +649,13 @@ namespace leveldb
         }
     };
 
-    template <typename Base, typename Prefix>
-    class SandwichDB<Base, Prefix>::Part final : public AnyDB
+    template <typename Base, typename Prefix, template <typename> class Encoding>
+    class SandwichDB<Base, Prefix, Encoding>::Part final : public AnyDB
     {
         SandwichDB *sandwich;
-        host_order<Prefix> prefix;
+        SandwichDB::Cookie prefix;
 
-        friend class SandwichDB<Base, Prefix>;
+        friend class SandwichDB<Base, Prefix, Encoding>;
 
         Part(SandwichDB &origin, Prefix prefix = 0) :
             sandwich(&origin), prefix(prefix)
@@ -117,23 +667,50 @@ namespace leveldb
         /// structure.
         ///
         /// Usually used to ref part for transaction/refs backed sandwich
-        template <template <typename> class T>
-        typename SandwichDB<T<Base>, Prefix>::Part ref(SandwichDB<T<Base>, Prefix> &origin)
+        template <typename Other>
+        typename SandwichDB<Other, Prefix, Encoding>::Part ref(SandwichDB<Other, Prefix, Encoding> &origin)
         { return origin.use(prefix); }
 
         bool Valid() const { return sandwich; }
         SandwichDB::Cookie Cookie() const { return prefix; }
 
+    private:
+        // whether updates should be accounted in statistics
+        bool Tracked() const
+        { return sandwich->tracking && !(prefix == Prefix(0)); }
+
+    public:
+
         Status Get(const Slice &key, std::string &value) noexcept override
         {
             assert( Valid() );
             const size_t buf_size = prefix.size() + key.size();
             char buf[buf_size];
             (void) memcpy(buf, prefix.data(), prefix.size());
-            (void) memcpy(buf + sizeof(prefix), key.data(), key.size());
+            (void) memcpy(buf + prefix.size(), key.data(), key.size());
             return sandwich->base.Get(Slice(buf, buf_size), value);
         }
 
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        {
+            assert( Valid() );
+            const size_t buf_size = prefix.size() + key.size();
+            char buf[buf_size];
+            (void) memcpy(buf, prefix.data(), prefix.size());
+            (void) memcpy(buf + prefix.size(), key.data(), key.size());
+            return sandwich->base.Lookup(Slice(buf, buf_size), value, status);
+        }
+
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        {
+            assert( Valid() );
+            const size_t buf_size = prefix.size() + key.size();
+            char buf[buf_size];
+            (void) memcpy(buf, prefix.data(), prefix.size());
+            (void) memcpy(buf + prefix.size(), key.data(), key.size());
+            return sandwich->base.GetPinned(Slice(buf, buf_size), value);
+        }
+
         Status Put(const Slice &key, const Slice &value) noexcept override
         {
             assert( Valid() );
@@ -141,7 +718,20 @@ namespace leveldb
             char buf[buf_size];
             (void) memcpy(buf, prefix.data(), prefix.size());
             (void) memcpy(buf + prefix.size(), key.data(), key.size());
-            return sandwich->base.Put(Slice(buf, buf_size), value);
+            const Slice k { buf, buf_size };
+            if (!Tracked()) return sandwich->base.Put(k, value);
+
+            std::string old;
+            Status s;
+            const GetResult r = sandwich->base.Lookup(k, old, s);
+            if (r == GetResult::Failed) return s;
+            s = sandwich->base.Put(k, value);
+            if (!s.ok()) return s;
+            if (r == GetResult::Found)
+            { sandwich->account(prefix, 0, int64_t(value.size()) - int64_t(old.size())); }
+            else
+            { sandwich->account(prefix, 1, int64_t(key.size() + value.size())); }
+            return s;
         }
         Status Delete(const Slice &key) noexcept override
         {
@@ -150,7 +740,139 @@ namespace leveldb
             char buf[prefix.size() + key.size()];
             (void) memcpy(buf, prefix.data(), prefix.size());
             (void) memcpy(buf + prefix.size(), key.data(), key.size());
-            return sandwich->base.Delete(Slice(buf, buf_size));
+            const Slice k { buf, buf_size };
+            if (!Tracked()) return sandwich->base.Delete(k);
+
+            std::string old;
+            Status s;
+            const GetResult r = sandwich->base.Lookup(k, old, s);
+            if (r == GetResult::Failed) return s;
+            s = sandwich->base.Delete(k);
+            if (s.ok() && r == GetResult::Found)
+            { sandwich->account(prefix, -1, -int64_t(key.size() + old.size())); }
+            return s;
+        }
+
+        /// Apply batch of updates with keys relative to this part.
+        /// Atomic as long as underlying database Write() is.
+        Status Write(WriteBatch &updates)
+        {
+            assert( Valid() );
+            struct PrefixHandler : WriteBatch::Handler
+            {
+                const SandwichDB::Cookie &prefix;
+                WriteBatch batch;
+                std::string buf;
+
+                // statistics accounting (only if base is set)
+                Base *base;
+                std::map<std::string, int64_t> seen; // entry size or -1
+                int64_t keys = 0;
+                int64_t bytes = 0;
+                Status failure;
+
+                PrefixHandler(const SandwichDB::Cookie &prefix, Base *base) :
+                    prefix(prefix), base(base)
+                {}
+
+                Slice prefixed(const Slice &key)
+                {
+                    buf.assign(prefix.data(), prefix.size());
+                    buf.append(key.data(), key.size());
+                    return buf;
+                }
+
+                // account change of entry in buf to specified size
+                void track(int64_t size)
+                {
+                    if (!base || !failure.ok()) return;
+                    int64_t before = -1;
+                    auto it = seen.find(buf);
+                    if (it != seen.end())
+                    { before = it->second; }
+                    else
+                    {
+                        std::string old;
+                        Status s;
+                        switch (base->Lookup(buf, old, s))
+                        {
+                        case GetResult::Found:
+                            before = int64_t(buf.size() - prefix.size() + old.size());
+                            break;
+                        case GetResult::NotFound:
+                            break;
+                        case GetResult::Failed:
+                            failure = s;
+                            return;
+                        }
+                    }
+                    seen[buf] = size;
+                    if (before >= 0) { --keys; bytes -= before; }
+                    if (size >= 0) { ++keys; bytes += size; }
+                }
+
+                void Put(const Slice &key, const Slice &value) override
+                {
+                    (void) prefixed(key);
+                    track(int64_t(key.size() + value.size()));
+                    batch.Put(buf, value);
+                }
+
+                void Delete(const Slice &key) override
+                {
+                    (void) prefixed(key);
+                    track(-1);
+                    batch.Delete(buf);
+                }
+
+            } handler { prefix, Tracked() ? &sandwich->base : nullptr };
+            Status s = updates.Iterate(&handler);
+            if (s.ok()) s = handler.failure;
+            if (!s.ok()) return s;
+            s = sandwich->base.Write(handler.batch);
+            if (s.ok() && handler.base)
+            { sandwich->account(prefix, handler.keys, handler.bytes); }
+            return s;
+        }
+
+        class Batch;
+
+        /// Approximate size in storage taken by key range [lower, upper)
+        /// of this part (empty upper stands for the end of part).
+        uint64_t GetApproximateSize(const Slice &lower, const Slice &upper)
+        {
+            assert( Valid() );
+            std::string l { prefix.data(), prefix.size() };
+            l.append(lower.data(), lower.size());
+            std::string u;
+            if (upper.empty()) u = successor(prefix);
+            else
+            {
+                u.assign(prefix.data(), prefix.size());
+                u.append(upper.data(), upper.size());
+            }
+            return approximateSize(sandwich->base, l, u);
+        }
+
+        /// Statistics of this part (see SandwichDB::trackStats()).
+        Status Stats(PartStats &stats)
+        {
+            assert( Valid() );
+            return sandwich->stats(prefix, stats);
+        }
+
+        /// Compression dictionary of this part (see SandwichDB::dictionary()).
+        Status Dictionary(std::string &dict)
+        {
+            assert( Valid() );
+            return sandwich->dictionary(prefix, dict);
+        }
+
+        /// Set compression dictionary (see SandwichDB::setDictionary()).
+        Status SetDictionary(const Slice &dict)
+        {
+            assert( Valid() );
+            return sandwich->setDictionary(prefix, dict);
         }
 
         class Walker;
@@ -162,18 +884,123 @@ namespace leveldb
         }
     };
 
-    template <typename Base, typename Prefix>
-    class SandwichDB<Base, Prefix>::Part::Walker
+    /// Walker over union of several parts in key order that tells which
+    /// part each entry comes from.
+    template <typename Base, typename Prefix, template <typename> class Encoding>
+    class SandwichDB<Base, Prefix, Encoding>::MergedWalker :
+        public MergeWalker<typename SandwichDB<Base, Prefix, Encoding>::Part::Walker>
     {
-        host_order<Prefix> prefix;
+        using Walker = typename Part::Walker;
+
+        std::vector<Cookie> cookies;
+
+        static std::vector<Walker> walkers(SandwichDB &origin, const std::vector<Cookie> &cookies)
+        {
+            std::vector<Walker> ws;
+            ws.reserve(cookies.size());
+            for (const auto &cookie : cookies)
+            {
+                auto part = origin.use(cookie);
+                ws.emplace_back(part);
+            }
+            return ws;
+        }
+
+    public:
+        MergedWalker(SandwichDB &origin, std::vector<Cookie> cookies) :
+            MergeWalker<Walker>(walkers(origin, cookies)),
+            cookies(std::move(cookies))
+        {}
+
+        /// Cookie of part current entry comes from.
+        Cookie cookie() const
+        { return cookies[this->source()]; }
+    };
+
+    /// Batch of updates for a part with keys prefixed as they are added.
+    /// May be filled in by one thread and written with SandwichDB::Write()
+    /// by another one.
+    ///
+    /// \note such updates are not accounted in part statistics
+    template <typename Base, typename Prefix, template <typename> class Encoding>
+    class SandwichDB<Base, Prefix, Encoding>::Part::Batch
+    {
+        SandwichDB::Cookie prefix;
+        WriteBatch updates;
+        std::string buf;
+
+        friend class SandwichDB<Base, Prefix, Encoding>;
+
+        Slice prefixed(const Slice &key)
+        {
+            buf.assign(prefix.data(), prefix.size());
+            buf.append(key.data(), key.size());
+            return buf;
+        }
+
+    public:
+        Batch(const SandwichDB<Base, Prefix, Encoding>::Part &origin) :
+            prefix{ origin.prefix }
+        { assert( origin.Valid() ); }
+
+        void Put(const Slice &key, const Slice &value)
+        { updates.Put(prefixed(key), value); }
+
+        void Delete(const Slice &key)
+        { updates.Delete(prefixed(key)); }
+
+        void Clear()
+        { updates.Clear(); }
+
+        size_t ApproximateSize() const
+        { return updates.ApproximateSize(); }
+    };
+
+    template <typename Base, typename Prefix, template <typename> class Encoding>
+    class SandwichDB<Base, Prefix, Encoding>::Part::Walker
+    {
+        SandwichDB::Cookie prefix;
         typename Base::Walker impl;
 
     public:
-        Walker(SandwichDB<Base, Prefix>::Part &origin) :
+        /// Whether key() and value() stay valid after moving walker.
+        static constexpr bool stable = Base::Walker::stable;
+
+        Walker(SandwichDB<Base, Prefix, Encoding>::Part &origin) :
             prefix{ origin.prefix }, impl{ origin.sandwich->base }
-        {}
+        {
+            SetBounds(Slice(), Slice());
+            SetCommonPrefix(0);
+        }
+
+        /// Restrict walker to range of keys [lower, upper) within this part.
+        /// Takes effect with next positioning (Seek, SeekToFirst etc).
+        void SetBounds(const Slice &lower, const Slice &upper)
+        {
+            std::string l(prefix.data(), prefix.size());
+            l.append(lower.data(), lower.size());
+            if (!upper.empty())
+            {
+                std::string u(prefix.data(), prefix.size());
+                u.append(upper.data(), upper.size());
+                impl.SetBounds(l, u);
+            }
+            else
+            {
+                impl.SetBounds(l, successor(prefix)); // empty for the last part
+            }
+        }
+
+        /// Hint that all keys within bounds share first n octets besides
+        /// prefix of this part (which every key within part shares anyway).
+        void SetCommonPrefix(size_t n)
+        { impl.SetCommonPrefix(prefix.size() + n); }
+
+        /// Hint that value() won't be used.
+        void SetKeysOnly(bool keysOnly)
+        { impl.SetKeysOnly(keysOnly); }
 
-        bool Valid() const { return impl.Valid() && impl.key().starts_with(prefix); }
+        bool Valid() const { return impl.Valid(); }
         Slice key() const
         {
             Slice k = impl.key();
@@ -188,34 +1015,157 @@ namespace leveldb
             return s;
         }
 
-        void SeekToFirst() { impl.Seek(prefix); }
-        void SeekToLast()
-        {
-            auto p = prefix;
-            if (p == p.max())
-            {
-                impl.SeekToLast();
-            }
-            else
-            {
-                p.next_net();;
-                impl.Seek(p);
-                if (impl.Valid())
-                { impl.Prev(); }
-                else
-                { impl.SeekToLast(); }
-            }
-        }
+        void SeekToFirst() { impl.SeekToFirst(); }
+        void SeekToLast() { impl.SeekToLast(); }
         void Next() { impl.Next(); }
         void Prev() { impl.Prev(); }
 
+        /// Take up to n entries starting from current one and move past them.
+        size_t NextBatch(KeyValue *out, size_t n)
+        {
+            const size_t k = impl.NextBatch(out, n);
+            for (size_t x = 0; x < k; ++x) out[x].key.remove_prefix(prefix.size());
+            return k;
+        }
+
         void Seek(const Slice &target)
         {
             const size_t buf_size = prefix.size() + target.size();
             char buf[buf_size];
             (void) memcpy(buf, prefix.data(), prefix.size());
-            (void) memcpy(buf + sizeof(prefix), target.data(), target.size());
+            (void) memcpy(buf + prefix.size(), target.data(), target.size());
             impl.Seek(Slice(buf, buf_size));
         }
     };
+
+    /// Background thread that reclaims keys of dropped and truncated parts
+    /// of a sandwich in batches with pauses between them.
+    ///
+    /// \note underlying database should allow concurrent access (like
+    ///       BottomDB does)
+    template <typename Sandwich>
+    class Reclaimer final
+    {
+        Sandwich &sandwich;
+        const size_t limit;
+        const std::chrono::milliseconds pause;
+        const std::chrono::milliseconds recheck;
+
+        std::mutex lock;
+        std::condition_variable wakeup;
+        bool stopping = false;
+        bool pending = false;
+        bool drained = false; // nothing left by last reclaim()
+        Status failure;
+
+        std::thread worker;
+
+        void Run()
+        {
+            std::unique_lock<std::mutex> guard { lock };
+            while (!stopping)
+            {
+                pending = false;
+                guard.unlock();
+                Status s = sandwich.reclaim(limit);
+                guard.lock();
+
+                drained = s.IsNotFound() && !pending;
+                if (s.ok())
+                { (void) wakeup.wait_for(guard, pause, [this] { return stopping; }); }
+                else if (s.IsNotFound())
+                { (void) wakeup.wait_for(guard, recheck, [this] { return stopping || pending; }); }
+                else
+                {
+                    failure = s;
+                    return;
+                }
+            }
+        }
+
+    public:
+        /// \param limit    amount of keys deleted at once
+        /// \param pause    delay between batches
+        /// \param recheck  delay between checks when there is nothing to reclaim
+        Reclaimer(Sandwich &sandwich, size_t limit = 1024,
+                  std::chrono::milliseconds pause = std::chrono::milliseconds(10),
+                  std::chrono::milliseconds recheck = std::chrono::milliseconds(1000)) :
+            sandwich(sandwich), limit(limit), pause(pause), recheck(recheck),
+            worker([this] { Run(); })
+        {}
+
+        Reclaimer(const Reclaimer &) = delete;
+        Reclaimer &operator=(const Reclaimer &) = delete;
+
+        ~Reclaimer()
+        {
+            {
+                std::lock_guard<std::mutex> guard { lock };
+                stopping = true;
+            }
+            wakeup.notify_all();
+            worker.join();
+        }
+
+        /// Hint that something was dropped so there is no need to wait for
+        /// idle check.
+        void wake()
+        {
+            {
+                std::lock_guard<std::mutex> guard { lock };
+                pending = true;
+                drained = false;
+            }
+            wakeup.notify_all();
+        }
+
+        /// Whether everything was reclaimed by the time of last check and
+        /// there were no wake() calls since then.
+        bool idle()
+        {
+            std::lock_guard<std::mutex> guard { lock };
+            return drained;
+        }
+
+        /// Error that stopped reclaiming (OK while it runs).
+        Status status()
+        {
+            std::lock_guard<std::mutex> guard { lock };
+            return failure;
+        }
+    };
+
+    /// Copy all parts of one sandwich into another one keeping their names.
+    /// That's a migration path for existing databases to other cookie
+    /// encoding (i.e. from host_order to varint_order) or prefix type.
+    template <typename From, typename To>
+    Status migrate(From &from, To &to)
+    {
+        std::vector<std::pair<std::string, typename From::Cookie>> parts;
+        Status s = from.forEachPart([&parts](const Slice &name, typename From::Cookie cookie) {
+            parts.emplace_back(name.ToString(), cookie);
+        });
+        if (!s.ok()) return s;
+
+        for (const auto &part : parts)
+        {
+            typename To::Cookie cookie;
+            s = to.cook(part.first, cookie);
+            if (!s.ok()) return s;
+
+            auto source = from.use(part.second);
+            auto target = to.use(cookie);
+            std::string dict;
+            s = source.Dictionary(dict);
+            if (s.ok()) s = target.SetDictionary(dict);
+            if (!s.ok() && !s.IsNotFound()) return s;
+            typename From::Part::Walker w { source };
+            for (w.SeekToFirst(); w.Valid(); w.Next())
+            {
+                s = target.Put(w.key(), w.value());
+                if (!s.ok()) return s;
+            }
+        }
+        return to.Sync();
+    }
 }
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <limits>
+#include <mutex>
+#include <type_traits>
 
 #include <leveldb/any_db.hpp>
 
@@ -66,13 +72,118 @@ namespace leveldb
         { return s.size() != size(); }
     };
 
+    /// Order-preserving variable-length encoding of unsigned integers.
+    ///
+    /// Number of leading one bits in the first octet tells how many octets
+    /// follow it and the rest is a big-endian value biased by the amount of
+    /// values representable with shorter encodings:
+    ///
+    ///     0xxxxxxx                    0 .. 127
+    ///     10xxxxxx xxxxxxxx           128 .. 16511
+    ///     110xxxxx xxxxxxxx xxxxxxxx  16512 .. 2113663
+    ///     ...
+    ///     11111111 (8 octets)
+    ///
+    /// Encoded values sort bytewise in the same order as numbers and no
+    /// encoding is a prefix of another one, so they are suitable as key
+    /// prefixes (i.e. SandwichDB cookies).
+    template <typename T>
+    class varint_order
+    {
+        static_assert(std::is_unsigned<T>::value && sizeof(T) <= sizeof(uint64_t),
+                      "only unsigned integers up to 64 bits are supported");
+
+        T value;
+        unsigned char length;
+        char octets[sizeof(T) + 1];
+
+        // amount of values representable with less than n extra octets
+        static constexpr uint64_t bias(size_t n)
+        { return n == 0 ? 0 : bias(n - 1) + (uint64_t(1) << (7 * n)); }
+
+        static constexpr size_t extra(unsigned char first)
+        { return (first & 0x80) == 0 ? 0 : 1 + extra(static_cast<unsigned char>(first << 1)); }
+
+    public:
+        varint_order() : varint_order(T(0)) {}
+        varint_order(T x) { *this = x; }
+        varint_order(const Slice &x) { *this = x; }
+
+        varint_order &operator=(T x)
+        {
+            value = x;
+            uint64_t v = x;
+            size_t n = 0;
+            for (; n < 8 && v >= (uint64_t(1) << (7 * (n + 1))); ++n)
+            { v -= uint64_t(1) << (7 * (n + 1)); }
+
+            length = static_cast<unsigned char>(n + 1);
+            for (size_t i = n; i > 0; --i, v >>= 8)
+            { octets[i] = static_cast<char>(v & 0xff); }
+            const unsigned marker = (0xff00u >> n) & 0xffu;
+            octets[0] = static_cast<char>(marker | unsigned(v));
+            return *this;
+        }
+
+        varint_order &operator=(const Slice &s)
+        {
+            assert( !corrupted(s) );
+            const size_t n = s.size() - 1;
+            uint64_t v = static_cast<unsigned char>(s[0]) & (0x7fu >> n);
+            for (size_t i = 1; i <= n; ++i)
+            { v = (v << 8) | static_cast<unsigned char>(s[i]); }
+            value = static_cast<T>(v + bias(n));
+            length = static_cast<unsigned char>(s.size());
+            memcpy(octets, s.data(), s.size());
+            return *this;
+        }
+
+        operator T() const { return value; }
+        operator Slice() const { return Slice(data(), size()); }
+
+        template <typename T1>
+        bool operator==(T1 &&other) const
+        { return value == std::forward<T1>(other); }
+
+        template <typename T1>
+        bool operator!=(T1 &&other) const
+        { return value != std::forward<T1>(other); }
+
+        static varint_order<T> max()
+        { return std::numeric_limits<T>::max(); }
+
+        size_t size() const { return length; }
+        const char *data() const { return octets; }
+
+        /// Size of encoded value in the beginning of s (0 if there is none).
+        static size_t prefix_size(const Slice &s)
+        {
+            if (s.empty()) return 0;
+            const size_t n = extra(static_cast<unsigned char>(s[0]));
+            return n < s.size() && n < sizeof(octets) ? n + 1 : 0;
+        }
+
+        static bool corrupted(const Slice &s)
+        {
+            if (s.empty() || prefix_size(s) != s.size()) return true;
+            // check that value fits into T
+            const size_t n = s.size() - 1;
+            uint64_t v = static_cast<unsigned char>(s[0]) & (0x7fu >> n);
+            for (size_t i = 1; i <= n; ++i)
+            { v = (v << 8) | static_cast<unsigned char>(s[i]); }
+            return v > uint64_t(std::numeric_limits<T>::max()) - bias(n);
+        }
+    };
+
     template <typename T, T PAGE_SIZE = 10>
     class Sequence
     {
         AnyDB &base;
         Slice key;
-        T next = 0;
-        host_order<T> allocated = next;
+        std::atomic<T> next { 0 };
+        // end of reserved page (0 - nothing reserved yet)
+        std::atomic<T> allocated { 0 };
+        std::mutex reserving; // single writer of sequence entry
 
     public:
         /// Construct from specific entry of AnyDB.
@@ -100,60 +211,84 @@ namespace leveldb
         Sequence(Sequence<T> &&sequence) :
             base(sequence.base),
             key(sequence.key),
-            next(sequence.next),
-            allocated(sequence.allocated)
+            next(sequence.next.load()),
+            allocated(sequence.allocated.load())
         {
             // we'll take care about calling Sync()
-            sequence.allocated = sequence.next;
+            sequence.allocated = sequence.next.load();
         }
 
         /// Request next value in sequence.
+        /// Safe to call from many threads. Values are taken from reserved
+        /// page with atomic increment and only reservation of the next page
+        /// goes through underlying database.
         /// \typeparam T1 specifies output type compatible with T
         template <typename T1>
         Status Next(T1 &value)
         {
-            assert( allocated == 0 || next <= allocated );
-
-            if (allocated == 0) // noting allocated yet
+            for (;;)
             {
+                T v = next.load();
+                while (v < allocated.load())
+                {
+                    if (next.compare_exchange_weak(v, T(v + 1)))
+                    {
+                        value = v;
+                        return Status::OK();
+                    }
+                }
+
+                // reached end of reserved page
+                std::lock_guard<std::mutex> guard { reserving };
+
+                // somebody else might reserve a page while we were waiting
+                if (next.load() < allocated.load()) continue;
+
+                const bool last = allocated == std::numeric_limits<T>::max();
                 Status s = AllocPage();
-                if (!s.ok()) return s;
-            }
+                if (s.ok()) continue;
 
-            if (next == allocated)
-            {
-                value = next++;
-                (void) AllocPage(); // pre-allocate next page for next request
-            }
-            else
-            {
-                value = next++;
+                if (last && s.IsNotFound()) // hand out the very last value
+                {
+                    v = next.load();
+                    value = v;
+                    next = T(v + 1);
+                    return Status::OK();
+                }
+                return s;
             }
-            return Status::OK();
         }
 
     private:
         Status AllocPage()
         {
+            host_order<T> current = allocated.load();
             std::string v;
             Status s = base.Get(key, v);
             if (s.ok())
             {
-                if (allocated.corrupted(v))
+                if (current.corrupted(v))
                 { return Status::Corruption("Invalid sequence entry (value size mismatch)"); }
 
-                if (allocated == 0) // initial (need to load prev value)
+                const host_order<T> stored { v };
+                if (current == T(0)) // initial (need to load prev value)
                 {
-                    allocated = v;
-                    if (allocated == 0) return Status::NotFound("sequence overflow");
-                    next = allocated;
+                    if (stored == T(0)) return Status::NotFound("sequence overflow");
+                    next = stored;
                 }
-                else if (allocated != host_order<T>{v})
+                else if (T(stored) < T(current))
                 { return Status::Corruption("Concurrent sequence entry change (value mismatch)"); }
+                else if (stored != current)
+                {
+                    // other sequence over same entry reserved pages after us
+                    // so we continue right after them
+                    next = stored;
+                }
+                current = stored;
             }
             else if (s.IsNotFound())
             {
-                if (allocated != 0) // not an initial state?
+                if (current != T(0)) // not an initial state?
                 { return Status::Corruption("Concurrent sequence entry change (missing value)"); }
             }
             else // other errors
@@ -163,8 +298,8 @@ namespace leveldb
 
             // to avoid overflow we'll use:
             // min(max, x + p) ~ min(max - p, x) + p
-            const host_order<T> nextAllocated = T(std::min(T(allocated.max() - PAGE_SIZE), T(allocated)) + PAGE_SIZE);
-            if (nextAllocated == allocated) // overflow
+            const host_order<T> nextAllocated = T(std::min(T(current.max() - PAGE_SIZE), T(current)) + PAGE_SIZE);
+            if (nextAllocated == current) // overflow
             {
                 (void) base.Put(key, host_order<T>{0}); // mark as overflow
                 allocated = 0;
@@ -180,31 +315,31 @@ namespace leveldb
         /// This operation should be done before releasing object.
         Status Sync()
         {
+            std::lock_guard<std::mutex> guard { reserving };
             assert(next <= allocated);
 
-            if (next < allocated)
-            {
-                std::string v;
-                Status s = base.Get(key, v);
-
-                if (s.IsNotFound())
-                { return Status::Corruption("Concurrent sequence entry change (missing value)"); }
-
-                if (allocated.corrupted(v))
-                { return Status::Corruption("Invalid sequence entry (value size mismatch)"); }
-
-                if (allocated != host_order<T>{v})
-                { return Status::Corruption("Concurrent sequence entry change (value mismatch)"); }
-
-                const host_order<T> nextAllocated = next;
+            // close the page for Next() first: value it loaded before that
+            // can't be taken anymore, so nothing is handed out past the
+            // point we store
+            const T end = allocated.load();
+            const host_order<T> nextAllocated = next.exchange(end);
+            if (nextAllocated == end) return Status::OK();
 
-                s = base.Put(key, nextAllocated);
-                if (!s.ok()) return s;
+            std::string v;
+            Status s = base.Get(key, v);
 
-                allocated = nextAllocated;
-            }
+            if (s.IsNotFound())
+            { s = Status::Corruption("Concurrent sequence entry change (missing value)"); }
+            else if (s.ok() && host_order<T>::corrupted(v))
+            { s = Status::Corruption("Invalid sequence entry (value size mismatch)"); }
+            else if (s.ok() && end != T(host_order<T>{v}))
+            { s = Status::Corruption("Concurrent sequence entry change (value mismatch)"); }
 
-            return Status::OK();
+            if (s.ok()) s = base.Put(key, nextAllocated);
+            if (s.ok()) allocated = nextAllocated;
+            // reopen the rest of page (or none of it after storing)
+            next = nextAllocated;
+            return s;
         }
     };
 }
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <leveldb/write_batch.h>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/bottom_db.hpp>
+#include <leveldb/merge_walker.hpp>
+
+namespace leveldb
+{
+    /// Database with keys spread over several shards (i.e. BottomDB
+    /// instances each with own writer and compaction) under terms that
+    /// shards outlive this object.
+    ///
+    /// Keys go to shards either by hash or by ranges split at given keys.
+    /// Walker merges walkers of all shards so keys come in global order.
+    /// Write() splits batch per shard and writes them in parallel, so batch
+    /// is atomic only within each shard. Batch for a single shard is written
+    /// from calling thread, others go through a writer thread per shard
+    /// started with the first Write() that spans several shards.
+    template <typename Shard = BottomDB>
+    class ShardedDB final : public AnyDB
+    {
+        // batches of one Write() handed to writers
+        struct Round
+        {
+            std::mutex lock;
+            std::condition_variable done;
+            size_t left;
+        };
+
+        struct Job
+        {
+            WriteBatch *batch;
+            Status *result;
+            Round *round;
+        };
+
+        class Writer
+        {
+            Shard &shard;
+            std::mutex lock;
+            std::condition_variable wakeup;
+            std::deque<Job> jobs;
+            bool stopping = false;
+            std::thread worker;
+
+            void Run()
+            {
+                std::unique_lock<std::mutex> guard { lock };
+                for (;;)
+                {
+                    wakeup.wait(guard, [this] { return stopping || !jobs.empty(); });
+                    if (jobs.empty()) return; // stopping
+                    const Job job = jobs.front();
+                    jobs.pop_front();
+                    guard.unlock();
+
+                    *job.result = shard.Write(*job.batch);
+                    {
+                        std::lock_guard<std::mutex> roundGuard { job.round->lock };
+                        if (--job.round->left == 0) job.round->done.notify_all();
+                    }
+                    guard.lock();
+                }
+            }
+
+        public:
+            explicit Writer(Shard &shard) :
+                shard(shard), worker([this] { Run(); })
+            {}
+
+            ~Writer()
+            {
+                {
+                    std::lock_guard<std::mutex> guard { lock };
+                    stopping = true;
+                }
+                wakeup.notify_all();
+                worker.join();
+            }
+
+            void post(const Job &job)
+            {
+                {
+                    std::lock_guard<std::mutex> guard { lock };
+                    jobs.push_back(job);
+                }
+                wakeup.notify_one();
+            }
+        };
+
+        struct Writers
+        {
+            std::once_flag started;
+            std::vector<std::unique_ptr<Writer>> all; // by shard
+        };
+
+        std::vector<Shard *> shards;
+        std::vector<std::string> splits; // empty for hash partitioning
+        std::unique_ptr<Writers> writers { new Writers };
+
+        Writer &writer(size_t i)
+        {
+            std::call_once(writers->started, [this] {
+                for (auto shard : shards) writers->all.emplace_back(new Writer(*shard));
+            });
+            return *writers->all[i];
+        }
+
+    public:
+        /// Partition keys by hash.
+        ShardedDB(std::vector<Shard *> origins) :
+            shards(std::move(origins))
+        { assert( !shards.empty() ); }
+
+        /// Partition keys by ranges: shard i holds keys in
+        /// [splits[i-1], splits[i]).
+        ///
+        /// \param splits  ascending keys, one less than shards
+        ShardedDB(std::vector<Shard *> origins, std::vector<std::string> splitKeys) :
+            shards(std::move(origins)),
+            splits(std::move(splitKeys))
+        {
+            assert( splits.size() + 1 == shards.size() );
+            assert( std::is_sorted(splits.begin(), splits.end()) );
+        }
+
+        ~ShardedDB() noexcept override = default;
+
+        ShardedDB(ShardedDB &&) = default;
+
+        size_t size() const { return shards.size(); }
+
+        /// Index of shard that holds key.
+        size_t shardOf(const Slice &key) const
+        {
+            if (shards.size() == 1) return 0;
+            if (splits.empty()) return static_cast<size_t>(hashKey(key) % shards.size());
+            auto it = std::upper_bound(splits.begin(), splits.end(), key,
+                [](const Slice &k, const std::string &split) { return k.compare(split) < 0; });
+            return static_cast<size_t>(it - splits.begin());
+        }
+
+        Shard &shard(size_t i) { return *shards[i]; }
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        { return shards[shardOf(key)]->Get(key, value); }
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        { return shards[shardOf(key)]->Lookup(key, value, status); }
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        { return shards[shardOf(key)]->GetPinned(key, value); }
+        Status Put(const Slice &key, const Slice &value) noexcept override
+        { return shards[shardOf(key)]->Put(key, value); }
+        Status Delete(const Slice &key) noexcept override
+        { return shards[shardOf(key)]->Delete(key); }
+
+        Status Write(WriteBatch &updates)
+        {
+            struct Splitter : WriteBatch::Handler
+            {
+                const ShardedDB &db;
+                std::vector<WriteBatch> batches;
+                std::vector<size_t> counts;
+                Splitter(const ShardedDB &origin) :
+                    db(origin), batches(origin.size()), counts(origin.size(), 0)
+                {}
+
+                void Put(const Slice &key, const Slice &value) override
+                {
+                    const size_t i = db.shardOf(key);
+                    batches[i].Put(key, value);
+                    ++counts[i];
+                }
+
+                void Delete(const Slice &key) override
+                {
+                    const size_t i = db.shardOf(key);
+                    batches[i].Delete(key);
+                    ++counts[i];
+                }
+
+            } splitter { *this };
+            Status s = updates.Iterate(&splitter);
+            if (!s.ok()) return s;
+
+            std::vector<size_t> touched;
+            for (size_t i = 0; i < shards.size(); ++i)
+            {
+                if (splitter.counts[i] > 0) touched.push_back(i);
+            }
+
+            if (touched.empty()) return Status::OK();
+            if (touched.size() == 1) return shards[touched[0]]->Write(splitter.batches[touched[0]]);
+
+            // the first batch goes from this thread
+            std::vector<Status> results(touched.size());
+            Round round;
+            round.left = touched.size() - 1;
+            for (size_t j = 1; j < touched.size(); ++j)
+            { writer(touched[j]).post({ &splitter.batches[touched[j]], &results[j], &round }); }
+            results[0] = shards[touched[0]]->Write(splitter.batches[touched[0]]);
+            {
+                std::unique_lock<std::mutex> guard { round.lock };
+                round.done.wait(guard, [&round] { return round.left == 0; });
+            }
+
+            for (const auto &r : results)
+            {
+                if (!r.ok()) return r;
+            }
+            return Status::OK();
+        }
+
+        /// Walker over all shards in key order.
+        struct Walker : MergeWalker<typename Shard::Walker>
+        {
+            Walker(ShardedDB<Shard> &origin) :
+                MergeWalker<typename Shard::Walker>(walkers(origin))
+            {}
+
+        private:
+            static std::vector<typename Shard::Walker> walkers(ShardedDB<Shard> &origin)
+            {
+                std::vector<typename Shard::Walker> result;
+                result.reserve(origin.shards.size());
+                for (auto shard : origin.shards) result.emplace_back(*shard);
+                return result;
+            }
+        };
+
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return asIterator(Walker(*this)); }
+
+        /// Compact key range [lower, upper) of every shard.
+        void CompactRange(const Slice &lower, const Slice &upper)
+        {
+            for (auto shard : shards) compactRange(*shard, lower, upper);
+        }
+
+        /// Approximate size in storage taken by key range [lower, upper).
+        uint64_t GetApproximateSize(const Slice &lower, const Slice &upper)
+        {
+            uint64_t size = 0;
+            for (auto shard : shards) size += approximateSize(*shard, lower, upper);
+            return size;
+        }
+    };
+}
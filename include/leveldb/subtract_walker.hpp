@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cassert>
+
 #include <leveldb/walker.hpp>
 #include <leveldb/whiteout_db.hpp>
 
@@ -10,8 +12,26 @@ namespace leveldb
     constexpr Order compare(int x) // compare with zero
     { return (x < 0) ? Order::LT : (x > 0) ? Order::GT : Order::EQ; }
 
+    template <typename KeyOrder = BytewiseOrder>
     inline Order compare(const Slice &a, const Slice &b)
-    { return compare(a.compare(b)); }
+    { return compare(KeyOrder::compare(a, b)); }
+
+    /// Compare keys known to share first skip octets.
+    /// Only bytewise order may skip them, others compare whole keys.
+    template <typename KeyOrder = BytewiseOrder>
+    inline Order compare(const Slice &a, const Slice &b, size_t skip)
+    {
+        (void) skip;
+        return compare<KeyOrder>(a, b);
+    }
+
+    template <>
+    inline Order compare<BytewiseOrder>(const Slice &a, const Slice &b, size_t skip)
+    {
+        assert( a.size() >= skip && b.size() >= skip );
+        return compare(Slice(a.data() + skip, a.size() - skip)
+                       .compare(Slice(b.data() + skip, b.size() - skip)));
+    }
 
     /// Traits of source for walking
     template <typename T>
@@ -19,20 +39,22 @@ namespace leveldb
     { typedef T &Embed; };
 
     /// Source for walking over data with whiteouts
-    template <typename Base>
+    template <typename Base, typename KeyOrder = BytewiseOrder>
     struct Subtract
     {
+        using Whiteout = BasicWhiteoutDB<KeyOrder>;
+
         typename WalkSource<Base>::Embed base;
-        typename WalkSource<WhiteoutDB>::Embed whiteout; // subset of base
+        typename WalkSource<Whiteout>::Embed whiteout; // subset of base
 
         class Walker;
     };
 
-    template <typename Base>
-    class Subtract<Base>::Walker
+    template <typename Base, typename KeyOrder>
+    class Subtract<Base, KeyOrder>::Walker
     {
         typename Base::Walker w_base;
-        typename WhiteoutDB::Walker w_whiteout;
+        typename Whiteout::Walker w_whiteout;
 
         void SkipNext()
         {
@@ -45,7 +67,7 @@ namespace leveldb
 
             for (;;)
             {
-                switch (compare(key(), w_whiteout.key()))
+                switch (compare<KeyOrder>(key(), w_whiteout.key()))
                 {
                 case Order::LT:
                     return;
@@ -73,7 +95,7 @@ namespace leveldb
 
             for (;;)
             {
-                switch (compare(key(), w_whiteout.key()))
+                switch (compare<KeyOrder>(key(), w_whiteout.key()))
                 {
                 case Order::GT:
                     return;
@@ -91,11 +113,28 @@ namespace leveldb
         }
 
     public:
-        Walker(Subtract<Base> op) :
+        /// Whether key() and value() stay valid after moving walker.
+        static constexpr bool stable = Base::Walker::stable;
+
+        Walker(Subtract<Base, KeyOrder> op) :
             w_base(op.base),
             w_whiteout(op.whiteout)
         {}
 
+        /// Restrict walker to range of keys [lower, upper).
+        /// Takes effect with next positioning (Seek, SeekToFirst etc).
+        void SetBounds(const Slice &lower, const Slice &upper)
+        { w_base.SetBounds(lower, upper); }
+
+        /// Hint that all keys within bounds share first n octets.
+        /// Whiteouts are not bounded and thus still compared in full.
+        void SetCommonPrefix(size_t n)
+        { w_base.SetCommonPrefix(n); }
+
+        /// Hint that value() won't be used.
+        void SetKeysOnly(bool keysOnly)
+        { w_base.SetKeysOnly(keysOnly); }
+
         bool Valid() const { return w_base.Valid(); }
         Slice key() const { return w_base.key(); }
         Slice value() const { return w_base.value(); }
@@ -139,13 +178,38 @@ namespace leveldb
             w_base.Prev();
             if (Valid()) SkipPrev();
         }
+
+        /// Take up to n entries starting from current one and move past them.
+        /// Batch of base is taken and filtered with whiteouts.
+        size_t NextBatch(KeyValue *out, size_t n)
+        {
+            size_t k = 0;
+            while (k == 0 && n > 0 && Valid())
+            {
+                const size_t got = w_base.NextBatch(out, n);
+
+                w_whiteout.Seek(out[0].key);
+                for (size_t x = 0; x < got; ++x)
+                {
+                    Order order = Order::GT;
+                    while (w_whiteout.Valid() &&
+                           (order = compare<KeyOrder>(w_whiteout.key(), out[x].key)) == Order::LT)
+                    { w_whiteout.Next(); }
+                    if (w_whiteout.Valid() && order == Order::EQ) continue; // deleted
+                    out[k++] = out[x];
+                }
+
+                if (Valid()) SkipNext();
+            }
+            return k;
+        }
     };
 
-    template <typename T>
-    struct WalkSource<Subtract<T>>
-    { typedef Subtract<T> Embed; };
+    template <typename T, typename KeyOrder>
+    struct WalkSource<Subtract<T, KeyOrder>>
+    { typedef Subtract<T, KeyOrder> Embed; };
 
-    template <typename Base>
-    constexpr Subtract<Base> subtract(Base &base, WhiteoutDB &whiteout)
+    template <typename Base, typename KeyOrder>
+    constexpr Subtract<Base, KeyOrder> subtract(Base &base, BasicWhiteoutDB<KeyOrder> &whiteout)
     { return {base, whiteout}; }
 }
@@ -10,50 +10,78 @@
 namespace leveldb
 {
     // note that Base object should outlive transaction
-    template<typename Base = AnyDB>
-    class TxnDB final : public AnyDB
+    // and have its keys ordered by KeyOrder
+    template<typename Base, typename KeyOrder = BytewiseOrder>
+    class BasicTxnDB final : public AnyDB
     {
     public:
         class Walker;
     private:
+        using Overlay = BasicMemoryDB<KeyOrder>;
+        using Whiteout = BasicWhiteoutDB<KeyOrder>;
+
         Base &base;
-        MemoryDB overlay;
-        WhiteoutDB whiteout;
+        Overlay overlay;
+        Whiteout whiteout;
         std::set<Walker *> walkers;
 
-        using Collection = Cover<Subtract<Base>, MemoryDB>;
+        using Collection = Cover<Subtract<Base, KeyOrder>, Overlay, KeyOrder>;
 
     public:
-        TxnDB(Base &origin) : base(origin)
+        BasicTxnDB(Base &origin) : base(origin)
         {}
 
-        TxnDB(TxnDB &&origin) :
+        BasicTxnDB(BasicTxnDB &&origin) :
             base(origin.base),
             overlay(std::move(origin.overlay)),
             whiteout(std::move(origin.whiteout)),
             walkers(std::move(origin.walkers))
         { for (auto walker : walkers) walker->parentChanged(this); }
 
-        TxnDB(const TxnDB &origin) :
+        BasicTxnDB(const BasicTxnDB &origin) :
             base(origin.base),
             overlay(origin.overlay),
             whiteout(origin.whiteout)
         {}
 
-        ~TxnDB() noexcept override = default;
+        ~BasicTxnDB() noexcept override = default;
 
-        TxnDB &operator=(const TxnDB &) = delete;
-        TxnDB &operator=(TxnDB &&) = delete;
+        BasicTxnDB &operator=(const BasicTxnDB &) = delete;
+        BasicTxnDB &operator=(BasicTxnDB &&) = delete;
 
         Status Get(const Slice &key, std::string &value) noexcept override
         {
             if (whiteout.Check(key))
             { return Status::NotFound("Deleted in transaction", key); }
-            auto s = overlay.Get(key, value);
-            if (s.ok()) return s;
+            Status s;
+            if (overlay.Lookup(key, value, s) == GetResult::Found) return s;
             return base.Get(key, value);
         }
 
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        {
+            if (whiteout.Check(key)) return GetResult::NotFound;
+            if (overlay.Lookup(key, value, status) == GetResult::Found)
+            { return GetResult::Found; }
+            return base.Lookup(key, value, status);
+        }
+
+        Status GetPinned(const Slice &key, PinnedSlice &value) noexcept override
+        {
+            if (whiteout.Check(key))
+            {
+                value.Reset();
+                return Status::NotFound("Deleted in transaction", key);
+            }
+            auto it = overlay.find(key);
+            if (it != overlay.end())
+            {
+                value.PinSlice(it->second);
+                return Status::OK();
+            }
+            return base.GetPinned(key, value);
+        }
+
         Status Put(const Slice &key, const Slice &value) noexcept override
         {
             (void) whiteout.Delete(key);
@@ -75,15 +103,15 @@ namespace leveldb
 
         class Walker : public Collection::Walker
         {
-            friend TxnDB;
-            TxnDB *txn;
+            friend BasicTxnDB;
+            BasicTxnDB *txn;
             typedef typename Collection::Walker Impl;
 
-            void parentChanged(TxnDB *parent = nullptr)
+            void parentChanged(BasicTxnDB *parent = nullptr)
             { txn = parent; }
 
         public:
-            Walker(TxnDB<Base> &origin) :
+            Walker(BasicTxnDB &origin) :
                 Impl({{origin.base, origin.whiteout}, origin.overlay}),
                 txn(&origin)
             { txn->walkers.insert(this); }
@@ -112,13 +140,19 @@ namespace leveldb
         std::unique_ptr<Iterator> NewIterator() noexcept override
         { return asIterator(Walker(*this)); }
 
+        /// Append pending changes to batch.
+        void collect(WriteBatch &batch) const
+        {
+            for (const auto &k : whiteout) batch.Delete(k);
+            for (const auto &kv : overlay) batch.Put(kv.first, kv.second);
+        }
+
         Status commit()
         {
             if (whiteout.empty() && overlay.empty()) return Status::OK();
 
             WriteBatch batch;
-            for (auto k : whiteout) batch.Delete(k);
-            for (auto kv : overlay) batch.Put(kv.first, kv.second);
+            collect(batch);
             Status s = base.Write(batch);
             if (s.ok())
             {
@@ -137,6 +171,10 @@ namespace leveldb
         using AnyDB::Write;
     };
 
+    // single parameter to fit SandwichDB::ref<TxnDB>()
+    template <typename Base = AnyDB>
+    using TxnDB = BasicTxnDB<Base>;
+
     template <typename Base>
     constexpr TxnDB<Base> transaction(Base &base)
     { return { base }; }
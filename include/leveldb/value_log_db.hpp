@@ -0,0 +1,689 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <leveldb/env.h>
+#include <leveldb/write_batch.h>
+
+#include <leveldb/any_db.hpp>
+#include <leveldb/walker.hpp>
+
+namespace leveldb
+{
+    /// CRC-32C (Castagnoli) of data continuing crc of preceding data.
+    inline uint32_t crc32c(const char *data, size_t n, uint32_t crc = 0)
+    {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> t {};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < n; ++i)
+        { crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8); }
+        return ~crc;
+    }
+
+    /// Key-value separation: values of at least threshold bytes go to an
+    /// append-only log of segment files while base keeps only small
+    /// pointers to them, so compactions of base don't rewrite big values.
+    ///
+    /// Values in base start with a tag: 0 for inline value, 1 for pointer
+    /// (segment, offset and length of log record). Log records are
+    ///
+    ///     crc32c | key size | value size | key | value
+    ///
+    /// with sizes in host order and checksum over everything after it.
+    /// Key lets Collect() tell live records from overwritten ones.
+    ///
+    /// Reads may run concurrently with each other and with writes as long
+    /// as base allows that. Collect() should not race with writers. Reads
+    /// pin segments they may need before looking into base, so segments
+    /// removed by Collect() are closed only once such reads are done.
+    ///
+    /// Writes fail until Open() succeeds. Segment files are kept through
+    /// env (leveldb::Env), so tests and custom environments apply to them
+    /// as they do to leveldb itself.
+    ///
+    /// \note Log is written before base. Set sync to get log on disk
+    ///       before pointers to it show up in base.
+    template <typename Base = AnyDB>
+    class ValueLogDB final : public AnyDB
+    {
+        static constexpr char inlineTag = '\0';
+        static constexpr char pointerTag = '\x01';
+        static constexpr size_t headerSize = 12;
+        static constexpr size_t pointerSize = 17;
+        static constexpr uint64_t readGap = 4 << 10; // read through to next record
+        static constexpr uint64_t readSpan = 1 << 20; // at most at once
+
+        struct Segment
+        {
+            std::string path;
+            std::atomic<uint64_t> size { 0 };
+            std::unique_ptr<WritableFile> log; // active one only
+
+            // file for reads sees segment as it was when opened (Env may
+            // map it), so it is reopened to read what was appended later
+            std::mutex reading;
+            std::shared_ptr<RandomAccessFile> file;
+            uint64_t covered = 0; // by file
+        };
+
+        struct Pointer
+        {
+            uint32_t segment;
+            uint64_t offset;
+            uint32_t length; // of the whole record
+
+            void encode(char *out) const
+            {
+                out[0] = pointerTag;
+                std::memcpy(out + 1, &segment, 4);
+                std::memcpy(out + 5, &offset, 8);
+                std::memcpy(out + 13, &length, 4);
+            }
+
+            bool decode(const Slice &s)
+            {
+                if (s.size() != pointerSize || s[0] != pointerTag) return false;
+                std::memcpy(&segment, s.data() + 1, 4);
+                std::memcpy(&offset, s.data() + 5, 8);
+                std::memcpy(&length, s.data() + 13, 4);
+                return true;
+            }
+
+            bool operator<(const Pointer &other) const
+            { return segment != other.segment ? segment < other.segment : offset < other.offset; }
+        };
+
+        Base &base;
+        size_t threshold;
+        uint64_t segmentSize;
+
+        using SegmentMap = std::map<uint32_t, std::shared_ptr<Segment>>;
+
+        std::string dir;
+        std::atomic<bool> opened { false };
+        mutable std::mutex lock; // guards segments and appends
+        SegmentMap segments; // last is active
+        // copy of segments for readers, replaced on each change of them
+        std::shared_ptr<const SegmentMap> published = std::make_shared<SegmentMap>();
+
+        std::string PathOf(uint32_t id) const
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/%06u.vlog", id);
+            return dir + name;
+        }
+
+        Status OpenSegment(uint32_t id, bool create)
+        {
+            auto segment = std::make_shared<Segment>();
+            segment->path = PathOf(id);
+            Status s;
+            if (create)
+            {
+                if (env->FileExists(segment->path))
+                { return Status::IOError(segment->path, "Value log segment already exists"); }
+                WritableFile *log;
+                s = env->NewWritableFile(segment->path, &log);
+                if (!s.ok()) return s;
+                segment->log.reset(log);
+            }
+            else
+            {
+                uint64_t size;
+                s = env->GetFileSize(segment->path, &size);
+                if (!s.ok()) return s;
+                segment->size = size;
+                s = Reopen(*segment, size);
+                if (!s.ok()) return s;
+            }
+            segments[id] = std::move(segment);
+            Publish();
+            return Status::OK();
+        }
+
+        // let file of segment see at least its first end octets
+        Status Reopen(Segment &segment, uint64_t end) const
+        {
+            std::lock_guard<std::mutex> guard { segment.reading };
+            if (segment.file && segment.covered >= end) return Status::OK();
+            const uint64_t size = segment.size;
+            RandomAccessFile *file;
+            Status s = env->NewRandomAccessFile(segment.path, &file);
+            if (!s.ok()) return s;
+            segment.file.reset(file);
+            segment.covered = size;
+            return Status::OK();
+        }
+
+        // read n octets of segment at offset into scratch of that size
+        Status Fetch(Segment &segment, uint64_t offset, size_t n, char *scratch, Slice &data) const
+        {
+            std::shared_ptr<RandomAccessFile> file;
+            {
+                std::lock_guard<std::mutex> guard { segment.reading };
+                if (segment.covered >= offset + n) file = segment.file;
+            }
+            if (!file)
+            {
+                Status s = Reopen(segment, offset + n);
+                if (!s.ok()) return s;
+                std::lock_guard<std::mutex> guard { segment.reading };
+                file = segment.file;
+            }
+            Status s = file->Read(offset, n, &data, scratch);
+            if (s.ok() && data.size() != n)
+            { return Status::Corruption("Truncated value log record", segment.path); }
+            return s;
+        }
+
+        // stop appending to active segment, so it can be read as a whole
+        // (under lock)
+        Status Seal(Segment &segment)
+        {
+            if (!segment.log) return Status::OK();
+            Status s = segment.log->Close();
+            segment.log.reset();
+            if (!s.ok()) return s;
+            return Reopen(segment, segment.size);
+        }
+
+        // under lock
+        void Publish()
+        { std::atomic_store(&published, std::shared_ptr<const SegmentMap>(std::make_shared<SegmentMap>(segments))); }
+
+        // segments a read may need, taken before reading pointers from base
+        std::shared_ptr<const SegmentMap> Pin() const
+        { return std::atomic_load(&published); }
+
+        // segment from pinned ones or current one for segments started
+        // after pinning
+        std::shared_ptr<Segment> SegmentOf(const SegmentMap &pinned, uint32_t id) const
+        {
+            auto it = pinned.find(id);
+            if (it != pinned.end()) return it->second;
+            std::lock_guard<std::mutex> guard { lock };
+            auto current = segments.find(id);
+            return current == segments.end() ? nullptr : current->second;
+        }
+
+        static Status NotOpen()
+        { return Status::IOError("Value log isn't open"); }
+
+        // append record and fill pointer to it (under lock)
+        Status Append(const Slice &key, const Slice &value, Pointer &pointer)
+        {
+            std::string record(headerSize, '\0');
+            const uint32_t ksize = static_cast<uint32_t>(key.size());
+            const uint32_t vsize = static_cast<uint32_t>(value.size());
+            std::memcpy(&record[4], &ksize, 4);
+            std::memcpy(&record[8], &vsize, 4);
+            record.append(key.data(), key.size());
+            record.append(value.data(), value.size());
+            const uint32_t crc = crc32c(record.data() + 4, record.size() - 4);
+            std::memcpy(&record[0], &crc, 4);
+
+            // segment that failed append may hold a torn record, so the
+            // next one starts a fresh segment
+            if (segments.empty() || !segments.rbegin()->second->log ||
+                segments.rbegin()->second->size >= segmentSize)
+            {
+                Status s;
+                if (!segments.empty()) s = Seal(*segments.rbegin()->second);
+                const uint32_t id = segments.empty() ? 1 : segments.rbegin()->first + 1;
+                if (s.ok()) s = OpenSegment(id, true);
+                if (!s.ok()) return s;
+            }
+            Segment &active = *segments.rbegin()->second;
+            // flushed right away for readers that reopen segment
+            Status s = active.log->Append(record);
+            if (s.ok()) s = active.log->Flush();
+            if (!s.ok())
+            {
+                (void) active.log->Close();
+                active.log.reset();
+                return s;
+            }
+            pointer = { segments.rbegin()->first, active.size, static_cast<uint32_t>(record.size()) };
+            active.size += record.size();
+            return Status::OK();
+        }
+
+        // (under lock)
+        Status SyncActive(bool force = false)
+        {
+            if (!(sync || force) || segments.empty()) return Status::OK();
+            Segment &active = *segments.rbegin()->second;
+            return active.log ? active.log->Sync() : Status::OK();
+        }
+
+        // encode value for base, appending it to log if it is big enough
+        Status Encode(const Slice &key, const Slice &value, std::string &stored)
+        {
+            if (value.size() < threshold)
+            {
+                stored.assign(1, inlineTag);
+                stored.append(value.data(), value.size());
+                return Status::OK();
+            }
+            Pointer pointer;
+            Status s = Append(key, value, pointer);
+            if (!s.ok()) return s;
+            stored.resize(pointerSize);
+            pointer.encode(&stored[0]);
+            return Status::OK();
+        }
+
+        Status Read(const SegmentMap &pinned, const Pointer &pointer, const Slice &key,
+                    std::string &value) const
+        {
+            auto segment = SegmentOf(pinned, pointer.segment);
+            if (!segment) return Status::Corruption("Missing value log segment", PathOf(pointer.segment));
+            std::string scratch(pointer.length, '\0');
+            Slice record;
+            Status s = Fetch(*segment, pointer.offset, pointer.length, &scratch[0], record);
+            if (!s.ok()) return s;
+            return Extract(*segment, record, key, value);
+        }
+
+        // value of record that should belong to key
+        static Status Extract(const Segment &segment, const Slice &record, const Slice &key,
+                              std::string &value)
+        {
+            Slice recordKey, recordValue;
+            if (!Parse(record, recordKey, recordValue) || recordKey != key)
+            { return Status::Corruption("Bad value log record", segment.path); }
+            value.assign(recordValue.data(), recordValue.size());
+            return Status::OK();
+        }
+
+        static bool Parse(const Slice &record, Slice &key, Slice &value)
+        {
+            if (record.size() < headerSize) return false;
+            uint32_t crc, ksize, vsize;
+            std::memcpy(&crc, record.data(), 4);
+            std::memcpy(&ksize, record.data() + 4, 4);
+            std::memcpy(&vsize, record.data() + 8, 4);
+            if (record.size() != headerSize + uint64_t(ksize) + vsize) return false;
+            if (crc32c(record.data() + 4, record.size() - 4) != crc) return false;
+            key = Slice(record.data() + headerSize, ksize);
+            value = Slice(record.data() + headerSize + ksize, vsize);
+            return true;
+        }
+
+        // turn stored value into user one
+        Status Decode(const SegmentMap &pinned, const Slice &key, const Slice &stored,
+                      std::string &value) const
+        {
+            if (!stored.empty() && stored[0] == inlineTag)
+            {
+                value.assign(stored.data() + 1, stored.size() - 1);
+                return Status::OK();
+            }
+            Pointer pointer;
+            if (!pointer.decode(stored)) return Status::Corruption("Bad value log pointer", key);
+            return Read(pinned, pointer, key, value);
+        }
+
+    public:
+        /// Whether to sync log before writing pointers to base.
+        bool sync = false;
+
+        /// Environment that keeps segment files (set before Open()).
+        Env *env = Env::Default();
+
+        /// \param threshold    values of that size and bigger go to log
+        /// \param segmentSize  size after which new log segment is started
+        ValueLogDB(Base &origin, size_t threshold = 4096, uint64_t segmentSize = 64 << 20) :
+            base(origin),
+            threshold(std::max<size_t>(threshold, 1)),
+            segmentSize(segmentSize)
+        {}
+
+        ~ValueLogDB() noexcept override = default;
+
+        /// Open (or create) directory with log segments. New values always
+        /// go to a fresh segment.
+        Status Open(const std::string &path)
+        {
+            std::lock_guard<std::mutex> guard { lock };
+            opened = false;
+            dir = path;
+            segments.clear();
+            Publish();
+            (void) env->CreateDir(dir); // may exist already
+            std::vector<std::string> names;
+            Status listed = env->GetChildren(dir, &names);
+            if (!listed.ok()) return listed;
+            std::vector<uint32_t> ids;
+            for (const auto &name : names)
+            {
+                unsigned id;
+                char suffix[8];
+                if (std::sscanf(name.c_str(), "%u.%7s", &id, suffix) == 2 && std::strcmp(suffix, "vlog") == 0)
+                { ids.push_back(id); }
+            }
+            for (auto id : ids)
+            {
+                Status s = OpenSegment(id, false);
+                if (!s.ok()) return s;
+            }
+            const uint32_t next = segments.empty() ? 1 : segments.rbegin()->first + 1;
+            Status s = OpenSegment(next, true);
+            opened = s.ok();
+            return s;
+        }
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        {
+            const auto pinned = Pin();
+            std::string stored;
+            Status s = base.Get(key, stored);
+            if (!s.ok()) return s;
+            return Decode(*pinned, key, stored, value);
+        }
+
+        Status Put(const Slice &key, const Slice &value) noexcept override
+        {
+            std::string stored;
+            {
+                std::lock_guard<std::mutex> guard { lock };
+                if (!opened) return NotOpen();
+                Status s = Encode(key, value, stored);
+                if (s.ok() && stored[0] == pointerTag) s = SyncActive();
+                if (!s.ok()) return s;
+            }
+            return base.Put(key, stored);
+        }
+
+        Status Delete(const Slice &key) noexcept override
+        {
+            if (!opened) return NotOpen();
+            return base.Delete(key);
+        }
+
+        Status Write(WriteBatch &updates)
+        {
+            struct Encoder : WriteBatch::Handler
+            {
+                ValueLogDB &db;
+                WriteBatch batch;
+                Status status;
+                bool logged = false;
+                std::string stored;
+                Encoder(ValueLogDB &origin) : db(origin) {}
+
+                void Put(const Slice &key, const Slice &value) override
+                {
+                    if (!status.ok()) return;
+                    status = db.Encode(key, value, stored);
+                    logged = logged || (status.ok() && stored[0] == pointerTag);
+                    batch.Put(key, stored);
+                }
+
+                void Delete(const Slice &key) override
+                { batch.Delete(key); }
+
+            } encoder { *this };
+            {
+                std::lock_guard<std::mutex> guard { lock };
+                if (!opened) return NotOpen();
+                Status s = updates.Iterate(&encoder);
+                if (s.ok()) s = encoder.status;
+                if (s.ok() && encoder.logged) s = SyncActive();
+                if (!s.ok()) return s;
+            }
+            return base.Write(encoder.batch);
+        }
+
+        /// Rewrite live values from up to n oldest segments (except the
+        /// active one) to the end of log and remove those segments.
+        /// Returns NotFound if there is nothing to collect.
+        Status Collect(size_t n = 1)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                std::shared_ptr<Segment> victim;
+                uint32_t id;
+                {
+                    std::lock_guard<std::mutex> guard { lock };
+                    if (segments.size() < 2) return i > 0 ? Status::OK() : Status::NotFound("Nothing to collect");
+                    id = segments.begin()->first;
+                    victim = segments.begin()->second;
+                }
+
+                std::string scratch(victim->size, '\0');
+                Slice data;
+                Status s = Fetch(*victim, 0, scratch.size(), &scratch[0], data);
+                if (!s.ok()) return s;
+
+                // move records still referenced by base
+                WriteBatch moved;
+                std::string stored, pointerValue(pointerSize, '\0');
+                for (uint64_t offset = 0; offset + headerSize <= data.size(); )
+                {
+                    uint32_t ksize, vsize;
+                    std::memcpy(&ksize, data.data() + offset + 4, 4);
+                    std::memcpy(&vsize, data.data() + offset + 8, 4);
+                    const uint64_t length = headerSize + uint64_t(ksize) + vsize;
+                    Slice key, value;
+                    if (offset + length > data.size() ||
+                        !Parse(Slice(data.data() + offset, length), key, value))
+                    { break; } // torn tail of crashed writer
+
+                    Pointer current;
+                    s = base.Get(key, stored);
+                    if (s.ok() && current.decode(stored) && current.segment == id && current.offset == offset)
+                    {
+                        Pointer pointer;
+                        {
+                            std::lock_guard<std::mutex> guard { lock };
+                            s = Append(key, value, pointer);
+                        }
+                        if (!s.ok()) return s;
+                        pointer.encode(&pointerValue[0]);
+                        moved.Put(key, pointerValue);
+                    }
+                    else if (!s.ok() && !s.IsNotFound()) return s;
+                    offset += length;
+                }
+
+                {
+                    std::lock_guard<std::mutex> guard { lock };
+                    s = SyncActive(true);
+                }
+                if (!s.ok()) return s;
+                s = base.Write(moved);
+                if (!s.ok()) return s;
+
+                // readers that pinned the segment keep it open
+                std::lock_guard<std::mutex> guard { lock };
+                segments.erase(id);
+                Publish();
+                s = env->DeleteFile(victim->path);
+                if (!s.ok()) return s;
+            }
+            return Status::OK();
+        }
+
+        /// Amount of log segments (including the active one).
+        size_t Segments() const
+        {
+            std::lock_guard<std::mutex> guard { lock };
+            return segments.size();
+        }
+
+        class Walker
+        {
+            const ValueLogDB *db;
+            std::shared_ptr<const SegmentMap> pinned; // before impl reads anything
+            typename Base::Walker impl;
+            bool keysOnly = false;
+            mutable std::string resolved;
+            mutable Status error;
+            std::vector<std::string> values; // of the last batch
+            std::string chunk; // of log read at once
+
+        public:
+            /// Whether key() and value() stay valid after moving walker.
+            static constexpr bool stable = false;
+
+            Walker(ValueLogDB<Base> &origin) :
+                db(&origin), pinned(origin.Pin()), impl(origin.base)
+            {}
+
+            /// Restrict walker to range of keys [lower, upper).
+            /// Takes effect with next positioning (Seek, SeekToFirst etc).
+            void SetBounds(const Slice &lower, const Slice &upper)
+            { impl.SetBounds(lower, upper); }
+
+            /// Hint that all keys within bounds share first n octets.
+            void SetCommonPrefix(size_t n)
+            { impl.SetCommonPrefix(n); }
+
+            /// Hint that value() won't be used, so log is never read.
+            void SetKeysOnly(bool only)
+            {
+                keysOnly = only;
+                impl.SetKeysOnly(only);
+            }
+
+            bool Valid() const { return impl.Valid(); }
+            Slice key() const { return impl.key(); }
+
+            /// Value read from log if needed. Read errors are reported with
+            /// status().
+            Slice value() const
+            {
+                const Slice stored = impl.value();
+                if (!stored.empty() && stored[0] == inlineTag)
+                { return Slice(stored.data() + 1, stored.size() - 1); }
+                Status s = db->Decode(*pinned, key(), stored, resolved);
+                if (!s.ok())
+                {
+                    error = s;
+                    resolved.clear();
+                }
+                return resolved;
+            }
+
+            Status status() const { return error.ok() ? impl.status() : error; }
+
+            void SeekToFirst() { impl.SeekToFirst(); }
+            void SeekToLast() { impl.SeekToLast(); }
+            void Seek(const Slice &target) { impl.Seek(target); }
+            void Next() { impl.Next(); }
+            void Prev() { impl.Prev(); }
+
+            /// Take up to n entries starting from current one and move past
+            /// them. Logged values of the batch are read in log order and
+            /// records close to each other in log are read at once, so
+            /// values written together are read ahead together.
+            size_t NextBatch(KeyValue *out, size_t n)
+            {
+                const size_t k = impl.NextBatch(out, n);
+                if (keysOnly) return k;
+
+                std::vector<std::pair<Pointer, size_t>> pending;
+                for (size_t i = 0; i < k; ++i)
+                {
+                    Slice &stored = out[i].value;
+                    if (!stored.empty() && stored[0] == inlineTag)
+                    {
+                        stored.remove_prefix(1);
+                        continue;
+                    }
+                    Pointer pointer;
+                    if (!pointer.decode(stored))
+                    {
+                        error = Status::Corruption("Bad value log pointer", out[i].key);
+                        return i;
+                    }
+                    pending.emplace_back(pointer, i);
+                }
+                if (pending.empty()) return k;
+
+                std::sort(pending.begin(), pending.end(),
+                          [](const std::pair<Pointer, size_t> &a, const std::pair<Pointer, size_t> &b)
+                          { return a.first < b.first; });
+                if (values.size() < k) values.resize(k);
+                size_t valid = k;
+                for (size_t from = 0; from < pending.size(); )
+                {
+                    // run of records with small gaps in the same segment
+                    const Pointer &first = pending[from].first;
+                    uint64_t end = first.offset + first.length;
+                    size_t to = from + 1;
+                    for (; to < pending.size(); ++to)
+                    {
+                        const Pointer &next = pending[to].first;
+                        if (next.segment != first.segment || next.offset < end ||
+                            next.offset - end > readGap || next.offset + next.length - first.offset > readSpan)
+                        { break; }
+                        end = next.offset + next.length;
+                    }
+
+                    Status s;
+                    auto segment = db->SegmentOf(*pinned, first.segment);
+                    if (!segment) s = Status::Corruption("Missing value log segment", db->PathOf(first.segment));
+                    Slice run;
+                    if (s.ok())
+                    {
+                        if (chunk.size() < end - first.offset) chunk.resize(end - first.offset);
+                        s = db->Fetch(*segment, first.offset, end - first.offset, &chunk[0], run);
+                    }
+                    for (; from < to; ++from)
+                    {
+                        const Pointer &pointer = pending[from].first;
+                        const size_t i = pending[from].second;
+                        if (s.ok())
+                        {
+                            const Slice record { run.data() + (pointer.offset - first.offset), pointer.length };
+                            s = Extract(*segment, record, out[i].key, values[i]);
+                        }
+                        if (!s.ok())
+                        {
+                            error = s;
+                            valid = std::min(valid, i);
+                            continue;
+                        }
+                        out[i].value = values[i];
+                    }
+                }
+                return valid;
+            }
+        };
+
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return asIterator(Walker(*this)); }
+
+        template <typename T = Base>
+        auto CompactRange(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().CompactRange(lower, upper))
+        { return base.CompactRange(lower, upper); }
+
+        template <typename T = Base>
+        auto GetApproximateSize(const Slice &lower, const Slice &upper)
+            -> decltype(std::declval<T&>().GetApproximateSize(lower, upper))
+        { return base.GetApproximateSize(lower, upper); }
+    };
+}
@@ -16,4 +16,36 @@ namespace leveldb
     template <typename T>
     constexpr typename T::Walker walker(const T &collection)
     { return { collection }; }
+
+    /// Walker over keys of collection that never touches values.
+    /// Layers that load values eagerly (i.e. prefetch them) are switched into
+    /// key-only mode so scans like counting or existence checks do not pay
+    /// for values at all.
+    template <typename W>
+    class KeysOf : private W
+    {
+    public:
+        template <typename... Args>
+        KeysOf(Args &&... args) : W(std::forward<Args>(args)...)
+        { W::SetKeysOnly(true); }
+
+        using W::SetBounds;
+        using W::SetCommonPrefix;
+        using W::Valid;
+        using W::SeekToFirst;
+        using W::SeekToLast;
+        using W::Seek;
+        using W::Next;
+        using W::Prev;
+        using W::key;
+        using W::status;
+    };
+
+    template <typename T>
+    constexpr KeysOf<typename T::Walker> walkKeys(T &collection)
+    { return { collection }; }
+
+    template <typename T>
+    constexpr KeysOf<typename T::Walker> walkKeys(const T &collection)
+    { return { collection }; }
 }
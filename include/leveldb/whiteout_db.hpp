@@ -5,19 +5,28 @@
 
 namespace leveldb
 {
-    class WhiteoutDB : protected std::set<std::string>
+    /// Set of deleted keys ordered by KeyOrder (see BytewiseOrder).
+    template <typename KeyOrder = BytewiseOrder>
+    class BasicWhiteoutDB : protected std::set<std::string, KeyLess<KeyOrder>>
     {
+        using Set = std::set<std::string, KeyLess<KeyOrder>>;
+        using typename Set::iterator;
+        using Set::find;
+        using Set::emplace;
+        using Set::erase;
+        using Set::clear;
+
         size_t rev = 0;
     public:
-        WhiteoutDB() = default;
-        using std::set<std::string>::set;
+        BasicWhiteoutDB() = default;
+        using Set::Set;
 
-        using set::begin;
-        using set::end;
-        using set::empty;
+        using Set::begin;
+        using Set::end;
+        using Set::empty;
 
         bool Check(const Slice &key)
-        { return find(key.ToString()) != end(); }
+        { return find(key) != end(); }
 
         template <typename... Args>
         bool Insert(Args &&... args)
@@ -36,7 +45,13 @@ namespace leveldb
         }
 
         Status Delete(const Slice &key)
-        { return Delete(key.ToString()); }
+        {
+            auto it = find(key);
+            if (it == end()) return Status::OK();
+            erase(it);
+            ++rev;
+            return Status::OK();
+        }
 
         Status Delete()
         {
@@ -47,8 +62,8 @@ namespace leveldb
 
         class Walker
         {
-            WhiteoutDB &rows;
-            WhiteoutDB::iterator impl;
+            BasicWhiteoutDB &rows;
+            iterator impl;
 
             size_t rev;
             std::string savepoint;
@@ -75,18 +90,18 @@ namespace leveldb
                 { savepoint = *impl; }
             }
 
-            void SeekImpl(const std::string &target)
+            void SeekImpl(const Slice &target)
             { impl = rows.lower_bound(target); }
 
         public:
-            Walker(WhiteoutDB &origin) : rows(origin), rev(origin.rev)
+            Walker(BasicWhiteoutDB &origin) : rows(origin), rev(origin.rev)
             {}
 
             bool Valid() const { return rev == rows.rev && impl != rows.end(); }
 
             void SeekToFirst() { impl = rows.begin(); Synced(); }
             void SeekToLast() { impl = rows.end(); if (impl != rows.begin()) --impl; Synced(); }
-            void Seek(const Slice &target) { SeekImpl(target.ToString()); Synced(); }
+            void Seek(const Slice &target) { SeekImpl(target); Synced(); }
 
             void Next()
             {
@@ -110,4 +125,6 @@ namespace leveldb
             Status status() const { return Valid() ? Status::OK() : Status::NotFound("invalid iterator"); }
         };
     };
+
+    using WhiteoutDB = BasicWhiteoutDB<>;
 }
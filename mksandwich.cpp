@@ -16,27 +16,102 @@
 //
 // LICENSE@@@
 
-#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <deque>
+#include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "leveldb/sandwich_db.hpp"
 #include "leveldb/bottom_db.hpp"
 
 using namespace std;
 
+typedef leveldb::SandwichDB<leveldb::BottomDB> Sandwich;
+
 void usage()
 {
 	cerr << "Usage: combine [options...] <DEST> <PART...>" << endl
 	     << "Options:" << endl
-	     << "    -s<SUFFIX>  Append <SUFFIX> to each part name during open" << endl;
+	     << "    -s<SUFFIX>  Append <SUFFIX> to each part name during open" << endl
+	     << "    -j<N>       Read <N> parts concurrently (default: number of cores)" << endl
+	     << "    -b<MiB>     Size of write batches (default: 4)" << endl
+	     << "    -w<MiB>     Write buffer size of destination (default: 64)" << endl
+	     << "    -y          Sync each write (default: sync only at the end)" << endl
+	     << "    -c          Compact destination after load" << endl
+	     << "    -q          Don't report progress" << endl;
 }
 
+// Batches prepared by readers waiting for the single writer.
+// Bounded to keep memory usage under control.
+class WriteQueue
+{
+	mutex lock;
+	condition_variable changed;
+	deque<Sandwich::Part::Batch> batches;
+	size_t limit;
+	size_t producers;
+	bool failed = false;
+
+public:
+	WriteQueue(size_t limit, size_t producers) :
+		limit(limit), producers(producers)
+	{}
+
+	// false if writer gave up
+	bool push(Sandwich::Part::Batch &&batch)
+	{
+		unique_lock<mutex> guard { lock };
+		changed.wait(guard, [this] { return failed || batches.size() < limit; });
+		if (failed) return false;
+		batches.push_back(move(batch));
+		changed.notify_all();
+		return true;
+	}
+
+	void done()
+	{
+		lock_guard<mutex> guard { lock };
+		--producers;
+		changed.notify_all();
+	}
+
+	// take all pending batches (false when producers are done and
+	// nothing left)
+	bool pop(deque<Sandwich::Part::Batch> &out)
+	{
+		unique_lock<mutex> guard { lock };
+		changed.wait(guard, [this] { return !batches.empty() || producers == 0; });
+		if (batches.empty()) return false;
+		out.swap(batches);
+		changed.notify_all();
+		return true;
+	}
+
+	void fail()
+	{
+		lock_guard<mutex> guard { lock };
+		failed = true;
+		changed.notify_all();
+	}
+};
+
 int main(int argc, char *argv[])
 {
 	string suffix = "";
 	deque<string> parts;
 	string dest;
+	size_t threads = thread::hardware_concurrency();
+	size_t batchSize = 4 << 20;
+	size_t writeBuffer = 64 << 20;
+	bool syncWrites = false;
+	bool compact = false;
+	bool quiet = false;
 
 	for (int n = 1; n < argc; ++n)
 	{
@@ -48,6 +123,30 @@ int main(int argc, char *argv[])
 				suffix = argv[n] + 2;
 				break;
 
+			case 'j':
+				threads = strtoul(argv[n] + 2, nullptr, 10);
+				break;
+
+			case 'b':
+				batchSize = strtoul(argv[n] + 2, nullptr, 10) << 20;
+				break;
+
+			case 'w':
+				writeBuffer = strtoul(argv[n] + 2, nullptr, 10) << 20;
+				break;
+
+			case 'y':
+				syncWrites = true;
+				break;
+
+			case 'c':
+				compact = true;
+				break;
+
+			case 'q':
+				quiet = true;
+				break;
+
 			default:
 				cerr << "Wrong argument " << argv[n] << endl;
 				usage();
@@ -71,10 +170,14 @@ int main(int argc, char *argv[])
 		usage();
 		return 1;
 	}
+	if (threads == 0) threads = 1;
+	if (batchSize == 0) batchSize = 1;
 
-	leveldb::SandwichDB<leveldb::BottomDB> cdb;
+	Sandwich cdb;
 	cdb->options.create_if_missing = true;
 	cdb->options.error_if_exists = true;
+	if (writeBuffer > 0) cdb->options.write_buffer_size = writeBuffer;
+	cdb->writeOptions.sync = syncWrites;
 	auto s = cdb->Open(dest.c_str());
 
 	if (!s.ok())
@@ -83,27 +186,112 @@ int main(int argc, char *argv[])
 		return 2;
 	}
 
-	for (const auto &part : parts)
-	{
-		cerr << "Processing part " << part << endl;
-		leveldb::BottomDB db;
-		s = db.Open((part + suffix).c_str());
+	// few batches per reader in flight
+	WriteQueue queue { threads * 2, threads };
+	atomic<size_t> next { 0 };
+	atomic<bool> failed { false };
+	mutex output;
 
-		if (!s.ok())
+	auto read = [&] {
+		for (size_t i; !failed && (i = next++) < parts.size(); )
 		{
-			cerr << "Failed to open destination database " << dest  << ": " << s.ToString() << endl;
-			return 2;
+			const auto &part = parts[i];
+			if (!quiet)
+			{
+				lock_guard<mutex> guard { output };
+				cerr << "Processing part " << part << endl;
+			}
+
+			leveldb::BottomDB db;
+			db.readOptions.fill_cache = false; // each record is read once
+			auto ps = db.Open((part + suffix).c_str());
+			auto pdb = cdb.use(part);
+			if (ps.ok() && !pdb.Valid())
+			{ ps = leveldb::Status::IOError("Failed to allocate cookie", part); }
+
+			if (!ps.ok())
+			{
+				lock_guard<mutex> guard { output };
+				cerr << "Failed to open part " << part << ": " << ps.ToString() << endl;
+				failed = true;
+				queue.fail();
+				break;
+			}
+
+			decltype(db)::Walker it { db };
+			Sandwich::Part::Batch batch { pdb };
+			for (it.SeekToFirst(); it.Valid(); it.Next())
+			{
+				batch.Put(it.key(), it.value());
+				if (batch.ApproximateSize() < batchSize) continue;
+				if (!queue.push(move(batch))) break;
+				batch = Sandwich::Part::Batch { pdb };
+			}
+			if (!queue.push(move(batch))) break;
 		}
+		queue.done();
+	};
 
-		auto pdb = cdb.use(part);
-		decltype(db)::Walker it { db };
+	vector<thread> readers;
+	for (size_t i = 0; i < threads; ++i) readers.emplace_back(read);
 
-		for (it.SeekToFirst(); it.Valid(); it.Next())
+	// single writer keeps leveldb from serializing concurrent writes itself
+	const auto start = chrono::steady_clock::now();
+	auto reported = start;
+	size_t written = 0;
+	deque<Sandwich::Part::Batch> pending;
+	while (!failed && queue.pop(pending))
+	{
+		for (auto &batch : pending)
 		{
-			pdb.Put(it.key(), it.value());
+			written += batch.ApproximateSize();
+			s = cdb.Write(batch);
+			if (!s.ok())
+			{
+				cerr << "Failed to write into destination database " << dest << ": " << s.ToString() << endl;
+				failed = true;
+				queue.fail();
+				break;
+			}
+		}
+		pending.clear();
+
+		const auto now = chrono::steady_clock::now();
+		if (!quiet && now - reported >= chrono::seconds(1))
+		{
+			const chrono::duration<double> spent = now - start;
+			lock_guard<mutex> guard { output };
+			cerr << "Written " << (written >> 20) << " MiB, "
+			     << size_t(double(written >> 20) / spent.count()) << " MiB/s" << endl;
+			reported = now;
 		}
 	}
+	for (auto &reader : readers) reader.join();
+	if (failed) return 2;
+
+	// meta-data and durability of everything loaded so far
+	cdb->writeOptions.sync = true;
+	s = cdb.Sync();
+	leveldb::WriteBatch nothing;
+	if (s.ok()) s = cdb->Write(nothing);
+	if (!s.ok())
+	{
+		cerr << "Failed to sync destination database " << dest << ": " << s.ToString() << endl;
+		return 2;
+	}
 
+	if (compact)
+	{
+		if (!quiet) cerr << "Compacting" << endl;
+		cdb->CompactRange(leveldb::Slice(), leveldb::Slice());
+	}
+
+	if (!quiet)
+	{
+		const chrono::duration<double> spent = chrono::steady_clock::now() - start;
+		cerr << "Written " << (written >> 20) << " MiB from " << parts.size() << " parts in "
+		     << spent.count() << " s" << endl;
+	}
 	cerr << "Done" << endl;
 
 	return 0;
@@ -0,0 +1,255 @@
+#include "leveldb/sandwich_db.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/ref_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/walker.hpp"
+#include "leveldb/parallel_scan.hpp"
+#include "leveldb/mapped_db.hpp"
+#include "leveldb/value_log_db.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+// Micro-benchmarks. Disabled by default, use "make check-disabled" to run.
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    template <typename F>
+    void measure(const char *name, size_t n, F &&f)
+    {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) f(i);
+        chrono::duration<double, nano> spent = chrono::steady_clock::now() - start;
+        cout << "[ BENCH    ] " << name << ": " << spent.count() / double(n) << " ns/op" << endl;
+    }
+
+    string numKey(size_t i)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "key%016zu", i);
+        return buf;
+    }
+}
+
+TEST(Bench, DISABLED_miss_heavy_get)
+{
+    const size_t n = 100000;
+    SandwichDB<MemoryDB> sdb;
+    auto part = sdb.use("alpha");
+    for (size_t i = 0; i < n; i += 10) ASSERT_OK( part.Put(numKey(i), "value") );
+
+    auto txn = sdb.ref<TxnDB>();
+    auto tpart = part.ref(txn);
+    for (size_t i = 5; i < n; i += 100) ASSERT_OK( tpart.Put(numKey(i), "value") );
+
+    vector<string> keys;
+    for (size_t i = 0; i < n; ++i) keys.push_back(numKey(i));
+
+    string v;
+    size_t found = 0;
+    measure("Part<TxnDB>::Get (90% misses)", n, [&](size_t i) {
+        if (tpart.Get(keys[i], v).ok()) ++found;
+    });
+
+    size_t found2 = 0;
+    Status s;
+    measure("Part<TxnDB>::Lookup (90% misses)", n, [&](size_t i) {
+        if (tpart.Lookup(keys[i], v, s) == GetResult::Found) ++found2;
+    });
+    EXPECT_EQ( found, found2 );
+    EXPECT_OK( s );
+}
+
+TEST(Bench, DISABLED_key_only_scan)
+{
+    const size_t n = 20000;
+    MemoryDB db;
+    SandwichDB<RefDB<MemoryDB>> sdb { db };
+    auto part = sdb.use("alpha");
+    const string big(4096, 'v');
+    for (size_t i = 0; i < n; ++i) ASSERT_OK( part.Put(numKey(i), big) );
+
+    auto txn = sdb.ref<TxnDB>();
+    auto tpart = part.ref(txn);
+    for (size_t i = 0; i < n; i += 10) ASSERT_OK( tpart.Put(numKey(i), big) );
+
+    // both consume keys only: these layers read values lazily anyway, so
+    // this compares virtual iterator against walker
+    size_t count = 0;
+    measure("Part<TxnDB> keys through iterator (4KiB values)", 10, [&](size_t) {
+        auto it = tpart.NewIterator();
+        string k;
+        for (it->SeekToFirst(); it->Valid(); it->Next())
+        {
+            k.assign(it->key().data(), it->key().size());
+            ++count;
+        }
+    });
+
+    size_t keysCount = 0;
+    measure("Part<TxnDB> walkKeys (4KiB values)", 10, [&](size_t) {
+        auto w = walkKeys(tpart);
+        string k;
+        for (w.SeekToFirst(); w.Valid(); w.Next())
+        {
+            k.assign(w.key().data(), w.key().size());
+            ++keysCount;
+        }
+    });
+    EXPECT_EQ( count, keysCount );
+
+    // value log reads values of a batch eagerly unless told otherwise
+    char path[] = "/tmp/bench_vlog.XXXXXX";
+    ASSERT_TRUE( mkdtemp(path) );
+    MemoryDB mem;
+    {
+        ValueLogDB<MemoryDB> vlog { mem, 1024 };
+        ASSERT_OK( vlog.Open(path) );
+        for (size_t i = 0; i < n; ++i) ASSERT_OK( vlog.Put(numKey(i), big) );
+
+        for (bool keysOnly : { false, true })
+        {
+            size_t keys = 0;
+            measure(keysOnly ? "ValueLogDB keys in batches, keys only (4KiB values)"
+                             : "ValueLogDB keys in batches, values read (4KiB values)", 10, [&](size_t) {
+                ValueLogDB<MemoryDB>::Walker w { vlog };
+                w.SetKeysOnly(keysOnly);
+                KeyValue batch[64];
+                w.SeekToFirst();
+                while (size_t k = w.NextBatch(batch, 64))
+                {
+                    for (size_t i = 0; i < k; ++i) keys += batch[i].key.size();
+                }
+            });
+            EXPECT_EQ( 10 * n * numKey(0).size(), keys );
+        }
+    }
+    (void) system((string("rm -rf ") + path).c_str());
+}
+
+TEST(Bench, DISABLED_batch_scan)
+{
+    const size_t n = 200000;
+    MemoryDB db;
+    SandwichDB<RefDB<MemoryDB>> sdb { db };
+    auto part = sdb.use("alpha");
+    for (size_t i = 0; i < n; ++i) ASSERT_OK( part.Put(numKey(i), "value") );
+
+    auto txn = sdb.ref<TxnDB>();
+    auto tpart = part.ref(txn);
+    for (size_t i = 0; i < n; i += 10) ASSERT_OK( tpart.Put(numKey(i), "other") );
+    for (size_t i = 5; i < n; i += 10) ASSERT_OK( tpart.Delete(numKey(i)) );
+
+    size_t count = 0, bytes = 0;
+    measure("Part<TxnDB> scan through iterator", 10, [&](size_t) {
+        auto it = tpart.NewIterator();
+        for (it->SeekToFirst(); it->Valid(); it->Next())
+        {
+            bytes += it->key().size() + it->value().size();
+            ++count;
+        }
+    });
+
+    size_t count2 = 0, bytes2 = 0;
+    measure("Part<TxnDB> scan through walker", 10, [&](size_t) {
+        auto w = walker(tpart);
+        for (w.SeekToFirst(); w.Valid(); w.Next())
+        {
+            bytes2 += w.key().size() + w.value().size();
+            ++count2;
+        }
+    });
+
+    size_t count3 = 0, bytes3 = 0;
+    measure("Part<TxnDB> scan through NextBatch(256)", 10, [&](size_t) {
+        auto w = walker(tpart);
+        KeyValue batch[256];
+        size_t k;
+        for (w.SeekToFirst(); (k = w.NextBatch(batch, 256)) > 0; )
+        {
+            for (size_t x = 0; x < k; ++x)
+            { bytes3 += batch[x].key.size() + batch[x].value.size(); }
+            count3 += k;
+        }
+    });
+    EXPECT_EQ( count, count2 );
+    EXPECT_EQ( count, count3 );
+    EXPECT_EQ( bytes, bytes3 );
+}
+
+TEST(Bench, DISABLED_parallel_scan)
+{
+    const size_t n = 1000000;
+    MemoryDB db;
+    SandwichDB<RefDB<MemoryDB>> sdb { db };
+    auto part = sdb.use("alpha");
+    for (size_t i = 0; i < n; ++i) ASSERT_OK( part.Put(numKey(i), "value") );
+
+    for (size_t threads : { 1, 2, 4, 8 })
+    {
+        const string name = "Part scan with parallelScan(" + to_string(threads) + ")";
+        atomic<size_t> count { 0 };
+        measure(name.c_str(), 5, [&](size_t) {
+            ASSERT_OK( parallelScan(part, Slice(), Slice(), threads,
+                [&](const Slice &key, const Slice &value) {
+                    // make callback a bit heavier than just counting
+                    size_t h = 0;
+                    for (size_t i = 0; i < key.size(); ++i) h = h * 31 + size_t(key[i]);
+                    if (h + value.size() != 0) count.fetch_add(1, memory_order_relaxed);
+                }) );
+        });
+        EXPECT_EQ( n * 5, count );
+    }
+
+    size_t ordered = 0;
+    measure("Part scan with orderedScan(4)", 5, [&](size_t) {
+        ASSERT_OK( orderedScan(part, Slice(), Slice(), 4,
+            [&](const Slice &, const Slice &) { ++ordered; }) );
+    });
+    EXPECT_EQ( n * 5, ordered );
+}
+
+TEST(Bench, DISABLED_mapped)
+{
+    const size_t n = 1000000;
+    const string path = "/tmp/bench_mapped.map";
+    MemoryDB mem;
+    for (size_t i = 0; i < n; ++i) ASSERT_OK( mem.Put(numKey(i), "value" + to_string(i)) );
+    {
+        MemoryDB::Walker w { mem };
+        ASSERT_OK( buildMapped(w, path) );
+    }
+
+    MappedDB db;
+    measure("MappedDB::Open()", 1, [&](size_t) { ASSERT_OK( db.Open(path) ); });
+
+    mt19937 gen { 42 };
+    vector<string> keys;
+    for (size_t i = 0; i < 100000; ++i) keys.push_back(numKey(gen() % n));
+    string v;
+    measure("MemoryDB::Get()", keys.size(), [&](size_t i) { ASSERT_OK( mem.Get(keys[i], v) ); });
+    measure("MappedDB::Get()", keys.size(), [&](size_t i) { ASSERT_OK( db.Get(keys[i], v) ); });
+
+    size_t bytes = 0;
+    measure("MemoryDB walk over 1M entries", 1, [&](size_t) {
+        MemoryDB::Walker w { mem };
+        for (w.SeekToFirst(); w.Valid(); w.Next()) bytes += w.key().size() + w.value().size();
+    });
+    measure("MappedDB walk over 1M entries", 1, [&](size_t) {
+        MappedDB::Walker w { db };
+        for (w.SeekToFirst(); w.Valid(); w.Next()) bytes += w.key().size() + w.value().size();
+    });
+    EXPECT_LT( 0u, bytes );
+
+    db.Close();
+    remove(path.c_str());
+}
@@ -6,6 +6,10 @@
 #include "leveldb/txn_db.hpp"
 #include "leveldb/ref_db.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 #include <gtest/gtest.h>
 
 #include "util.hpp"
@@ -227,6 +231,40 @@ TEST(Simple, walkCover)
 
 }
 
+TEST(Simple, walkKeys)
+{
+    leveldb::MemoryDB mem {
+        { "b", "1" },
+        { "a", "2" },
+        { "c", "3" },
+    };
+
+    auto txn = leveldb::transaction(mem);
+    EXPECT_OK( txn.Delete("b") );
+    EXPECT_OK( txn.Put("d", "4") );
+
+    auto w = leveldb::walkKeys(txn);
+    vector<string> keys;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) keys.push_back(w.key().ToString());
+    EXPECT_EQ( (vector<string>{"a", "c", "d"}), keys );
+
+    w.SeekToLast();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "d", w.key() );
+
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+    auto a = sdb.use("alpha");
+    EXPECT_OK( a.Put("x", "1") );
+    EXPECT_OK( sdb.use("beta").Put("y", "2") );
+
+    auto wa = leveldb::walkKeys(a);
+    wa.SeekToFirst();
+    ASSERT_TRUE( wa.Valid() );
+    EXPECT_EQ( "x", wa.key() );
+    wa.Next();
+    EXPECT_FALSE( wa.Valid() );
+}
+
 TEST(Simple, transaction)
 {
     leveldb::MemoryDB db {
@@ -289,6 +327,83 @@ TEST(Simple, transaction)
     EXPECT_EQ( "5", v );
 }
 
+TEST(Simple, lookup)
+{
+    leveldb::MemoryDB db {
+        { "a", "1" },
+        { "b", "2" },
+    };
+    leveldb::TxnDB<leveldb::MemoryDB> txn(db);
+    leveldb::Status s;
+    string v;
+
+    EXPECT_TRUE( leveldb::GetResult::Found == db.Lookup("a", v, s) );
+    EXPECT_EQ( "1", v );
+    EXPECT_TRUE( leveldb::GetResult::NotFound == db.Lookup("c", v, s) );
+
+    ASSERT_OK( txn.Put("c", "3") );
+    ASSERT_OK( txn.Delete("a") );
+
+    EXPECT_TRUE( leveldb::GetResult::NotFound == txn.Lookup("a", v, s) );
+    EXPECT_TRUE( leveldb::GetResult::Found == txn.Lookup("b", v, s) );
+    EXPECT_EQ( "2", v );
+    EXPECT_TRUE( leveldb::GetResult::Found == txn.Lookup("c", v, s) );
+    EXPECT_EQ( "3", v );
+    EXPECT_TRUE( leveldb::GetResult::NotFound == txn.Lookup("d", v, s) );
+
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+    auto p = sdb.use("alpha");
+    ASSERT_OK( p.Put("x", "4") );
+    EXPECT_TRUE( leveldb::GetResult::Found == p.Lookup("x", v, s) );
+    EXPECT_EQ( "4", v );
+    EXPECT_TRUE( leveldb::GetResult::NotFound == p.Lookup("y", v, s) );
+    EXPECT_TRUE( leveldb::GetResult::NotFound == sdb.use("beta").Lookup("x", v, s) );
+    EXPECT_OK( s );
+}
+
+TEST(Simple, pinned)
+{
+    leveldb::MemoryDB db {
+        { "a", "1" },
+        { "b", "2" },
+    };
+    leveldb::TxnDB<leveldb::MemoryDB> txn(db);
+    leveldb::PinnedSlice v;
+
+    ASSERT_OK( db.GetPinned("a", v) );
+    EXPECT_EQ( "1", v );
+    EXPECT_TRUE( v.IsPinned() );
+    EXPECT_EQ( db.begin()->second.data(), v.data() );
+    EXPECT_FAIL( db.GetPinned("c", v) );
+
+    ASSERT_OK( txn.Put("c", "3") );
+    ASSERT_OK( txn.Delete("a") );
+
+    EXPECT_FAIL( txn.GetPinned("a", v) );
+    ASSERT_OK( txn.GetPinned("b", v) );
+    EXPECT_EQ( "2", v );
+    ASSERT_OK( txn.GetPinned("c", v) );
+    EXPECT_EQ( "3", v );
+    EXPECT_TRUE( v.IsPinned() );
+
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+    auto p = sdb.use("alpha");
+    ASSERT_OK( p.Put("x", "4") );
+    ASSERT_OK( p.GetPinned("x", v) );
+    EXPECT_EQ( "4", v );
+    EXPECT_FAIL( p.GetPinned("y", v) );
+
+    // generic implementation copies value
+    leveldb::AnyDB &any = p;
+    ASSERT_OK( any.AnyDB::GetPinned("x", v) );
+    EXPECT_EQ( "4", v );
+    EXPECT_FALSE( v.IsPinned() );
+
+    auto moved = std::move(v);
+    EXPECT_EQ( "4", moved );
+    EXPECT_TRUE( v.empty() );
+}
+
 TEST(Simple, sequence)
 {
     leveldb::MemoryDB db;
@@ -329,6 +444,455 @@ TEST(Simple, host_order)
     EXPECT_EQ( "\x42\x44", leveldb::Slice(x) );
 }
 
+TEST(Simple, varint_order)
+{
+    using Cookie = leveldb::varint_order<unsigned short>;
+    EXPECT_EQ( leveldb::Slice("\x00", 1), leveldb::Slice(Cookie(0)) );
+    EXPECT_EQ( "\x7f", leveldb::Slice(Cookie(127)) );
+    EXPECT_EQ( leveldb::Slice("\x80\x00", 2), leveldb::Slice(Cookie(128)) );
+    EXPECT_EQ( "\xbf\xff", leveldb::Slice(Cookie(16511)) );
+    EXPECT_EQ( leveldb::Slice("\xc0\x00\x00", 3), leveldb::Slice(Cookie(16512)) );
+
+    string prev;
+    for (unsigned n = 0; n <= 0xffff; ++n)
+    {
+        const Cookie x { static_cast<unsigned short>(n) };
+        const string cur = leveldb::Slice(x).ToString();
+        ASSERT_FALSE( Cookie::corrupted(cur) ) << n;
+        ASSERT_EQ( n, Cookie(leveldb::Slice(cur)) );
+        ASSERT_EQ( cur.size(), Cookie::prefix_size(cur + "key") );
+        if (n > 0)
+        {
+            ASSERT_LT( prev, cur ) << n;
+            ASSERT_NE( 0, cur.compare(0, prev.size(), prev) ) << n;
+        }
+        prev = cur;
+    }
+
+    EXPECT_TRUE( Cookie::corrupted("") );
+    EXPECT_TRUE( Cookie::corrupted("\x80") );
+    EXPECT_TRUE( Cookie::corrupted("\x01\x02") );
+    EXPECT_TRUE( Cookie::corrupted("\xe0\x00\x00\x00") );
+    EXPECT_TRUE( Cookie::corrupted("\xdf\xff\xff") ); // doesn't fit
+
+    using BigCookie = leveldb::varint_order<unsigned long long>;
+    const auto max = numeric_limits<unsigned long long>::max();
+    EXPECT_EQ( 9, BigCookie(max).size() );
+    EXPECT_EQ( max, BigCookie(leveldb::Slice(BigCookie(max))) );
+    EXPECT_EQ( max - 1, BigCookie(leveldb::Slice(BigCookie(max - 1))) );
+}
+
+TEST(Simple, varint_sandwich)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>, unsigned short, leveldb::varint_order> sdb { db };
+
+    auto a = sdb.use("alpha");
+    ASSERT_TRUE( a.Valid() );
+    EXPECT_EQ( 1, leveldb::Slice(a.Cookie()).size() );
+
+    // cross the boundary of single octet cookies
+    for (size_t i = 1; i < 0x0100; ++i) (void) sdb.use(to_string(i));
+    auto b = sdb.use("beta");
+    ASSERT_TRUE( b.Valid() );
+    EXPECT_EQ( 2, leveldb::Slice(b.Cookie()).size() );
+
+    EXPECT_OK( a.Put("a", "1") );
+    EXPECT_OK( a.Put("b", "2") );
+    EXPECT_OK( b.Put("c", "3") );
+    EXPECT_OK( sdb.use("200").Put("d", "4") );
+    EXPECT_OK( sdb.Sync() );
+
+    string v;
+    ASSERT_OK( a.Get("b", v) );
+    EXPECT_EQ( "2", v );
+    EXPECT_FAIL( b.Get("b", v) );
+
+    auto w = walker(a);
+    w.SeekToLast();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "b", w.key() );
+    w.Next();
+    EXPECT_FALSE( w.Valid() );
+
+    auto wb = walker(b);
+    wb.SeekToFirst();
+    ASSERT_TRUE( wb.Valid() );
+    EXPECT_EQ( "c", wb.key() );
+    wb.Next();
+    EXPECT_FALSE( wb.Valid() );
+
+    // same mapping after re-open
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>, unsigned short, leveldb::varint_order> sdb2 { db };
+    EXPECT_EQ( b.Cookie(), sdb2.use("beta").Cookie() );
+}
+
+TEST(Simple, migrate)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> from;
+    from.use("alpha").Put("a", "1");
+    from.use("alpha").Put("b", "2");
+    from.use("beta").Put("c", "3");
+    EXPECT_OK( from.Sync() );
+
+    leveldb::SandwichDB<leveldb::MemoryDB, unsigned, leveldb::varint_order> to;
+    ASSERT_OK( leveldb::migrate(from, to) );
+
+    string v;
+    ASSERT_OK( to.use("alpha").Get("a", v) );
+    EXPECT_EQ( "1", v );
+    ASSERT_OK( to.use("alpha").Get("b", v) );
+    EXPECT_EQ( "2", v );
+    ASSERT_OK( to.use("beta").Get("c", v) );
+    EXPECT_EQ( "3", v );
+    EXPECT_FAIL( to.use("beta").Get("a", v) );
+
+    vector<string> names;
+    EXPECT_OK( to.forEachPart([&names](const leveldb::Slice &name, unsigned) {
+        names.push_back(name.ToString());
+    }) );
+    EXPECT_EQ( (vector<string>{"alpha", "beta"}), names );
+}
+
+TEST(Simple, part_dictionary)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> from;
+    auto a = from.use("alpha");
+    string dict;
+    EXPECT_STATUS( NotFound, a.Dictionary(dict) );
+    ASSERT_OK( a.SetDictionary("dict") );
+    ASSERT_OK( a.SetDictionary("dict") ); // same one again is fine
+    EXPECT_STATUS( InvalidArgument, a.SetDictionary("other") );
+    ASSERT_OK( a.Dictionary(dict) );
+    EXPECT_EQ( "dict", dict );
+    EXPECT_STATUS( NotFound, from.use("beta").Dictionary(dict) );
+    ASSERT_OK( a.Put("a", "1") );
+
+    // goes along with keys
+    leveldb::SandwichDB<leveldb::MemoryDB, unsigned, leveldb::varint_order> to;
+    ASSERT_OK( leveldb::migrate(from, to) );
+    ASSERT_OK( to.use("alpha").Dictionary(dict) );
+    EXPECT_EQ( "dict", dict );
+
+    // but not with name
+    ASSERT_OK( from.truncate("alpha") );
+    EXPECT_STATUS( NotFound, from.use("alpha").Dictionary(dict) );
+    ASSERT_OK( from.use("alpha").SetDictionary("other") );
+}
+
+TEST(Simple, sandwich_drop)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+
+    auto a = sdb.use("alpha");
+    for (size_t i = 0; i < 10; ++i) ASSERT_OK( a.Put(to_string(i), "x") );
+    ASSERT_OK( sdb.use("beta").Put("b", "y") );
+    const auto before = db.size();
+
+    ASSERT_OK( sdb.drop("alpha") );
+    EXPECT_EQ( before, db.size() ); // nothing is deleted yet
+    EXPECT_OK( sdb.drop("alpha") ); // already dropped
+
+    auto a2 = sdb.use("alpha");
+    ASSERT_TRUE( a2.Valid() );
+    EXPECT_NE( a.Cookie(), a2.Cookie() );
+    const auto after = db.size();
+    string v;
+    EXPECT_STATUS( NotFound, a2.Get("0", v) );
+
+    vector<string> names;
+    EXPECT_OK( sdb.forEachPart([&names](const leveldb::Slice &name, unsigned short) {
+        names.push_back(name.ToString());
+    }) );
+    EXPECT_EQ( (vector<string>{"alpha", "beta"}), names );
+
+    // throttled reclaiming
+    EXPECT_OK( sdb.reclaim(4) );
+    EXPECT_EQ( after - 4, db.size() );
+    EXPECT_OK( sdb.reclaim(4) );
+    EXPECT_OK( sdb.reclaim(4) );
+    EXPECT_STATUS( NotFound, sdb.reclaim(4) );
+    EXPECT_EQ( after - 10 - 1, db.size() ); // including retired entry
+
+    ASSERT_OK( sdb.use("beta").Get("b", v) );
+    EXPECT_EQ( "y", v );
+}
+
+TEST(Simple, sandwich_truncate)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+
+    ASSERT_OK( sdb.use("alpha").Put("a", "1") );
+    ASSERT_OK( sdb.use("alpha").Put("b", "2") );
+    const auto cookie = sdb.use("alpha").Cookie();
+
+    ASSERT_OK( sdb.truncate("alpha") );
+    EXPECT_NE( cookie, sdb.use("alpha").Cookie() );
+
+    auto part = sdb.use("alpha");
+    auto w = walker(part);
+    w.SeekToFirst();
+    EXPECT_FALSE( w.Valid() );
+
+    ASSERT_OK( sdb.use("alpha").Put("c", "3") );
+    ASSERT_OK( sdb.Sync() );
+
+    // another sandwich over the same database sees the same
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb2 { db };
+    EXPECT_EQ( sdb.use("alpha").Cookie(), sdb2.use("alpha").Cookie() );
+
+    while (sdb2.reclaim().ok());
+
+    string v;
+    EXPECT_STATUS( NotFound, sdb2.use("alpha").Get("a", v) );
+    ASSERT_OK( sdb2.use("alpha").Get("c", v) );
+    EXPECT_EQ( "3", v );
+    EXPECT_STATUS( NotFound, sdb2.reclaim() );
+}
+
+TEST(Simple, sandwich_reclaimer)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+
+    for (size_t i = 0; i < 100; ++i) ASSERT_OK( sdb.use("alpha").Put(to_string(i), "x") );
+    ASSERT_OK( sdb.use("beta").Put("b", "y") );
+    ASSERT_OK( sdb.Sync() );
+    const auto base = db.size() - 100 - 1; // with name entry
+
+    // MemoryDB isn't thread-safe so no updates while reclaimer works
+    ASSERT_OK( sdb.drop("alpha") );
+    leveldb::Reclaimer<decltype(sdb)> reclaimer { sdb, 16, chrono::milliseconds(1) };
+
+    for (size_t i = 0; i < 1000 && !reclaimer.idle(); ++i)
+    { this_thread::sleep_for(chrono::milliseconds(1)); }
+    ASSERT_TRUE( reclaimer.idle() );
+    EXPECT_OK( reclaimer.status() );
+    EXPECT_EQ( base, db.size() );
+}
+
+TEST(Simple, sandwich_rename)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+
+    ASSERT_OK( sdb.use("alpha").Put("a", "1") );
+    ASSERT_OK( sdb.use("beta").Put("b", "2") );
+    const auto cookie = sdb.use("alpha").Cookie();
+
+    EXPECT_STATUS( InvalidArgument, sdb.rename("alpha", "beta") );
+    EXPECT_STATUS( NotFound, sdb.rename("gamma", "delta") );
+
+    ASSERT_OK( sdb.rename("alpha", "gamma") );
+    EXPECT_EQ( cookie, sdb.use("gamma").Cookie() );
+
+    string v;
+    ASSERT_OK( sdb.use("gamma").Get("a", v) );
+    EXPECT_EQ( "1", v );
+    EXPECT_STATUS( NotFound, sdb.use("alpha").Get("a", v) );
+    EXPECT_NE( cookie, sdb.use("alpha").Cookie() );
+
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb2 { db };
+    EXPECT_EQ( cookie, sdb2.use("gamma").Cookie() );
+}
+
+TEST(Simple, sandwich_swap)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+
+    ASSERT_OK( sdb.use("live").Put("k", "old") );
+    const auto before = db.size();
+
+    // blue/green reload
+    ASSERT_OK( sdb.use("shadow").Put("k", "new") );
+    ASSERT_OK( sdb.swap("live", "shadow") );
+    ASSERT_OK( sdb.drop("shadow") );
+    while (sdb.reclaim().ok());
+
+    string v;
+    ASSERT_OK( sdb.use("live").Get("k", v) );
+    EXPECT_EQ( "new", v );
+    EXPECT_EQ( before, db.size() );
+
+    EXPECT_STATUS( NotFound, sdb.swap("live", "missing") );
+    ASSERT_OK( sdb.use("live").Get("k", v) );
+    EXPECT_EQ( "new", v );
+}
+
+TEST(Simple, sandwich_drop_through_ref)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+    auto other = sdb.ref();
+
+    // both sandwiches know the name before it is dropped
+    ASSERT_OK( sdb.use("alpha").Put("a", "1") );
+    ASSERT_OK( other.use("alpha").Put("b", "2") );
+
+    ASSERT_OK( sdb.drop("alpha") );
+    ASSERT_OK( other.use("alpha").Put("c", "3") ); // lands in a fresh part
+    EXPECT_EQ( sdb.use("alpha").Cookie(), other.use("alpha").Cookie() );
+    while (sdb.reclaim().ok());
+
+    string v;
+    EXPECT_STATUS( NotFound, sdb.use("alpha").Get("a", v) );
+    EXPECT_STATUS( NotFound, sdb.use("alpha").Get("b", v) );
+    ASSERT_OK( sdb.use("alpha").Get("c", v) );
+    EXPECT_EQ( "3", v );
+
+    ASSERT_OK( other.use("beta").Put("k", "beta") );
+    ASSERT_OK( other.swap("alpha", "beta") );
+    ASSERT_OK( sdb.use("beta").Get("c", v) );
+    EXPECT_EQ( "3", v );
+    ASSERT_OK( other.rename("beta", "gamma") );
+    EXPECT_STATUS( NotFound, sdb.use("beta").Get("c", v) );
+    ASSERT_OK( sdb.use("gamma").Get("c", v) );
+
+    // transaction sandwich hands its changes over once it is done
+    {
+        auto txn = sdb.ref<leveldb::TxnDB>();
+        ASSERT_OK( txn.drop("gamma") );
+        ASSERT_OK( sdb.use("gamma").Get("c", v) ); // not committed yet
+        EXPECT_OK( txn->commit() );
+    }
+    ASSERT_OK( sdb.use("gamma").Put("d", "4") );
+    while (sdb.reclaim().ok());
+    EXPECT_STATUS( NotFound, other.use("gamma").Get("c", v) );
+    ASSERT_OK( other.use("gamma").Get("d", v) );
+    EXPECT_EQ( "4", v );
+}
+
+TEST(Simple, sandwich_stats)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+    sdb.trackStats();
+
+    auto a = sdb.use("alpha");
+    ASSERT_OK( a.Put("a", "1") );
+    ASSERT_OK( a.Put("b", "22") );
+    ASSERT_OK( a.Put("b", "333") ); // overwrite
+    ASSERT_OK( a.Delete("x") ); // missing
+    ASSERT_OK( sdb.use("beta").Put("c", "4") );
+
+    leveldb::PartStats stats;
+    ASSERT_OK( a.Stats(stats) );
+    EXPECT_EQ( 2, stats.keys );
+    EXPECT_EQ( 2 + 4, stats.bytes );
+    EXPECT_EQ( 0, stats.physical ); // MemoryDB doesn't know
+
+    leveldb::WriteBatch batch;
+    batch.Put("c", "1");
+    batch.Put("c", "22");
+    batch.Delete("a");
+    batch.Delete("a");
+    batch.Put("a", "1");
+    batch.Delete("b");
+    ASSERT_OK( a.Write(batch) );
+    ASSERT_OK( a.Stats(stats) );
+    EXPECT_EQ( 2, stats.keys );
+    EXPECT_EQ( 2 + 3, stats.bytes );
+
+    ASSERT_OK( a.Delete("c") );
+    ASSERT_OK( sdb.Sync() );
+
+    // persisted in meta part
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb2 { db };
+    ASSERT_OK( sdb2.use("alpha").Stats(stats) );
+    EXPECT_EQ( 1, stats.keys );
+    EXPECT_EQ( 2, stats.bytes );
+    ASSERT_OK( sdb2.use("beta").Stats(stats) );
+    EXPECT_EQ( 1, stats.keys );
+
+    // not tracked updates
+    ASSERT_OK( sdb2.use("beta").Put("d", "55") );
+    ASSERT_OK( sdb2.use("beta").Stats(stats) );
+    EXPECT_EQ( 1, stats.keys );
+    ASSERT_OK( sdb2.recount("beta") );
+    ASSERT_OK( sdb2.use("beta").Stats(stats) );
+    EXPECT_EQ( 2, stats.keys );
+    EXPECT_EQ( 2 + 3, stats.bytes );
+
+    // statistics go along with the part
+    ASSERT_OK( sdb.swap("alpha", "beta") );
+    ASSERT_OK( sdb.use("alpha").Stats(stats) );
+    EXPECT_EQ( 2, stats.keys );
+    ASSERT_OK( sdb.truncate("alpha") );
+    ASSERT_OK( sdb.use("alpha").Stats(stats) );
+    EXPECT_EQ( 0, stats.keys );
+    EXPECT_EQ( 0, stats.bytes );
+}
+
+TEST(Simple, sandwich_stats_without_sync)
+{
+    leveldb::MemoryDB db;
+    {
+        leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+        sdb.trackStats();
+        ASSERT_OK( sdb.use("alpha").Put("a", "1") );
+
+        // pending changes and tracking go along with moved sandwich
+        auto moved = std::move(sdb);
+        EXPECT_TRUE( moved.trackingStats() );
+        ASSERT_OK( moved.use("alpha").Put("b", "22") );
+        leveldb::PartStats stats;
+        ASSERT_OK( moved.use("alpha").Stats(stats) );
+        EXPECT_EQ( 2, stats.keys );
+    }
+
+    // stored on destruction
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb { db };
+    leveldb::PartStats stats;
+    ASSERT_OK( sdb.use("alpha").Stats(stats) );
+    EXPECT_EQ( 2, stats.keys );
+    EXPECT_EQ( 2 + 3, stats.bytes );
+}
+
+TEST(Simple, part_write)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+    auto a = sdb.use("alpha");
+    ASSERT_OK( a.Put("a", "0") );
+
+    leveldb::WriteBatch batch;
+    batch.Put("b", "1");
+    batch.Delete("a");
+    ASSERT_OK( a.Write(batch) );
+
+    string v;
+    EXPECT_STATUS( NotFound, a.Get("a", v) );
+    ASSERT_OK( a.Get("b", v) );
+    EXPECT_EQ( "1", v );
+    EXPECT_STATUS( NotFound, sdb.use("beta").Get("b", v) );
+}
+
+TEST(Simple, part_batch)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+    auto alpha = sdb.use("alpha");
+    ASSERT_OK( alpha.Put("a", "0") );
+
+    decltype(sdb)::Part::Batch batch { alpha };
+    batch.Put("b", "1");
+    batch.Delete("a");
+    EXPECT_LT( 0, batch.ApproximateSize() );
+
+    // may be written from other thread
+    leveldb::Status s;
+    thread writer { [&] { s = sdb.Write(batch); } };
+    writer.join();
+    ASSERT_OK( s );
+
+    string v;
+    EXPECT_STATUS( NotFound, alpha.Get("a", v) );
+    ASSERT_OK( alpha.Get("b", v) );
+    EXPECT_EQ( "1", v );
+    EXPECT_STATUS( NotFound, sdb.use("beta").Get("b", v) );
+}
+
 TEST(Simple, sandwich_move_issue14)
 {
     auto db = std::move(leveldb::SandwichDB<leveldb::MemoryDB> {});
@@ -396,6 +960,47 @@ TEST(Simple, sandwich)
     EXPECT_FAIL( w.status() );
 }
 
+TEST(Simple, sandwich_cookies)
+{
+    leveldb::MemoryDB db;
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb1 { db };
+
+    auto a = sdb1.use("alpha");
+    auto b = sdb1.use("beta");
+    ASSERT_TRUE( a.Valid() );
+    ASSERT_TRUE( b.Valid() );
+    EXPECT_NE( a.Cookie(), b.Cookie() );
+    EXPECT_EQ( a.Cookie(), sdb1.use("alpha").Cookie() );
+    EXPECT_OK( sdb1.Sync() );
+
+    // another sandwich loads existing mapping
+    leveldb::SandwichDB<leveldb::RefDB<leveldb::MemoryDB>> sdb2 { db };
+    EXPECT_EQ( b.Cookie(), sdb2.use("beta").Cookie() );
+    EXPECT_EQ( a.Cookie(), sdb2.use("alpha").Cookie() );
+
+    // and picks up entries cooked elsewhere after loading
+    auto c = sdb2.use("gamma");
+    ASSERT_TRUE( c.Valid() );
+    EXPECT_OK( sdb2.Sync() );
+    EXPECT_EQ( c.Cookie(), sdb1.use("gamma").Cookie() );
+
+    // lookups of known names from many threads
+    vector<thread> threads;
+    atomic<size_t> mismatches { 0 };
+    for (size_t t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&] {
+            for (size_t i = 0; i < 1000; ++i)
+            {
+                if (sdb2.use("alpha").Cookie() != a.Cookie()) ++mismatches;
+                if (sdb2.use("gamma").Cookie() != c.Cookie()) ++mismatches;
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    EXPECT_EQ( 0, mismatches );
+}
+
 TEST(Simple, big_sandwich)
 {
     leveldb::SandwichDB<leveldb::MemoryDB> sdb;
@@ -525,6 +1130,42 @@ TEST(Simple, ref)
     EXPECT_FAIL( w.status() );
 }
 
+TEST(Simple, DISABLED_bottom_pinned)
+{
+    leveldb::BottomDB db;
+    db.options.create_if_missing = true;
+    ASSERT_OK( db.Open("/tmp/test_pinned.ldb") );
+
+    EXPECT_OK( db.Put("a", "1") );
+    EXPECT_OK( db.Put("b", "2") );
+
+    leveldb::PinnedSlice v;
+    ASSERT_OK( db.GetPinned("a", v) );
+    EXPECT_EQ( "1", v );
+    EXPECT_TRUE( v.IsPinned() );
+    EXPECT_STATUS( NotFound, db.GetPinned("aa", v) );
+    EXPECT_STATUS( NotFound, db.GetPinned("c", v) );
+}
+
+TEST(Simple, DISABLED_bottom_stats)
+{
+    leveldb::SandwichDB<leveldb::BottomDB> sdb;
+    sdb->options.create_if_missing = true;
+    ASSERT_OK( sdb->Open("/tmp/test_stats.ldb") );
+    sdb.trackStats();
+
+    auto alpha = sdb.use("alpha");
+    for (size_t i = 0; i < 10000; ++i)
+    { ASSERT_OK( alpha.Put(to_string(i), string(100, 'x')) ); }
+    sdb->CompactRange(leveldb::Slice(), leveldb::Slice());
+
+    leveldb::PartStats stats;
+    ASSERT_OK( alpha.Stats(stats) );
+    EXPECT_EQ( 10000, stats.keys );
+    EXPECT_LT( 0, stats.physical );
+    EXPECT_OK( sdb.Sync() );
+}
+
 TEST(Simple, DISABLED_dummy)
 {
     leveldb::SandwichDB<leveldb::BottomDB> sdb;
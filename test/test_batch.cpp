@@ -0,0 +1,150 @@
+#include "leveldb/txn_db.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/sandwich_db.hpp"
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+class TestBatch : public ::testing::TestWithParam<string>
+{
+protected:
+    MemoryDB db;
+    AnyDB &anyDB = db;
+
+    TxnDB<MemoryDB> txn { db }; // stable entries
+    TxnDB<AnyDB> anyTxn { anyDB }; // entries copied from iterator
+
+    using Expectation = vector<pair<string,string>>;
+    Expectation e; // expected key/val
+
+    template <typename W>
+    Expectation collect(W &w, size_t n)
+    {
+        Expectation result;
+        vector<KeyValue> batch(n);
+        size_t k;
+        while ((k = w.NextBatch(batch.data(), n)) > 0)
+        {
+            EXPECT_LE( k, n );
+            for (size_t x = 0; x < k; ++x)
+            { result.emplace_back(batch[x].key.ToString(), batch[x].value.ToString()); }
+        }
+        EXPECT_FALSE( w.Valid() );
+        return result;
+    }
+
+private:
+    void SetUp()
+    {
+        string k = "a";
+        string v = "0";
+        // fill database and expected view
+        for (char c : GetParam())
+        {
+            switch (c)
+            {
+            case '<': db.Put(k, v); break;
+            case '>': db.Put(k, v); break;
+            case '-':
+                db.Put(k, v); ++v[0];
+                txn.Put(k, v); anyTxn.Put(k, v);
+                break;
+            case 'x':
+                db.Put(k, v); ++v[0];
+                txn.Delete(k); anyTxn.Delete(k);
+                break;
+            case 'X': txn.Delete(k); anyTxn.Delete(k); break;
+            case '+': txn.Put(k, v); anyTxn.Put(k, v); break;
+            }
+            if (c != 'x' && c != 'X') e.emplace_back(k,v);
+
+            ++k[0]; ++v[0];
+        }
+    }
+};
+
+namespace {
+    template <size_t n>
+    const vector<string> &genCases()
+    {
+        static vector<string> ys;
+        if (!ys.empty()) return ys;
+
+        for (auto x : genCases<n-1>())
+        {
+            for (char c : { '<', '-', 'x', 'X', '+' })
+                ys.push_back(x + c);
+        }
+
+        return ys;
+    }
+
+    template<>
+    const vector<string> &genCases<0>()
+    {
+        static const vector<string> ys { string{} };
+        return ys;
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(Comb0, TestBatch, ::testing::ValuesIn(genCases<0>()));
+INSTANTIATE_TEST_CASE_P(Comb1, TestBatch, ::testing::ValuesIn(genCases<1>()));
+INSTANTIATE_TEST_CASE_P(Comb3, TestBatch, ::testing::ValuesIn(genCases<3>()));
+INSTANTIATE_TEST_CASE_P(Comb5, TestBatch, ::testing::ValuesIn(genCases<5>()));
+
+TEST_P(TestBatch, forward)
+{
+    for (size_t n : { 1, 2, 3, 64 })
+    {
+        SCOPED_TRACE("Batch size: " + to_string(n));
+
+        auto w = walker(txn);
+        w.SeekToFirst();
+        EXPECT_EQ( e, collect(w, n) );
+
+        auto aw = walker(anyTxn);
+        aw.SeekToFirst();
+        EXPECT_EQ( e, collect(aw, n) );
+    }
+}
+
+TEST_P(TestBatch, after_reverse)
+{
+    if (e.size() < 2) return;
+
+    const Expectation tail { e.end() - 2, e.end() };
+    for (size_t n : { 1, 2, 64 })
+    {
+        SCOPED_TRACE("Batch size: " + to_string(n));
+
+        auto w = walker(txn);
+        w.SeekToLast();
+        w.Prev();
+        EXPECT_EQ( tail, collect(w, n) );
+
+        auto aw = walker(anyTxn);
+        aw.SeekToLast();
+        aw.Prev();
+        EXPECT_EQ( tail, collect(aw, n) );
+    }
+}
+
+TEST_P(TestBatch, part)
+{
+    SandwichDB<TxnDB<MemoryDB>> sdb { db };
+    auto a = sdb.use("alpha");
+    auto b = sdb.use("beta");
+    for (const auto &kv : e)
+    {
+        EXPECT_OK( a.Put(kv.first, kv.second) );
+        EXPECT_OK( b.Put(kv.first, "b") );
+    }
+
+    auto w = walker(a);
+    w.SeekToFirst();
+    EXPECT_EQ( e, collect(w, 3) );
+}
@@ -0,0 +1,257 @@
+#include "leveldb/memory_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/sandwich_db.hpp"
+#include "leveldb/ref_db.hpp"
+#include "leveldb/walker.hpp"
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    template <typename W>
+    void expectWalk(W &w, const vector<string> &keys)
+    {
+        w.SeekToFirst();
+        for (const auto &k : keys)
+        {
+            ASSERT_TRUE( w.Valid() );
+            EXPECT_EQ( k, w.key() );
+            w.Next();
+        }
+        EXPECT_FALSE( w.Valid() ) << "Walker still points to " << w.key().ToString();
+
+        w.SeekToLast();
+        for (auto i = keys.rbegin(); i != keys.rend(); ++i)
+        {
+            ASSERT_TRUE( w.Valid() );
+            EXPECT_EQ( *i, w.key() );
+            w.Prev();
+        }
+        EXPECT_FALSE( w.Valid() ) << "Walker still points to " << w.key().ToString();
+    }
+
+    template <typename W>
+    void expectSeek(W &w, const Slice &target, const char *expected)
+    {
+        w.Seek(target);
+        if (expected == nullptr)
+        {
+            EXPECT_FALSE( w.Valid() ) << "Walker still points to " << w.key().ToString();
+        }
+        else
+        {
+            ASSERT_TRUE( w.Valid() );
+            EXPECT_EQ( expected, w.key() );
+        }
+    }
+
+    MemoryDB sample()
+    {
+        return {
+            { "a", "1" },
+            { "b", "2" },
+            { "c", "3" },
+            { "d", "4" },
+            { "e", "5" },
+        };
+    }
+}
+
+TEST(TestBounds, memory)
+{
+    MemoryDB mem = sample();
+    auto w = walker(mem);
+
+    w.SetBounds("b", "d");
+    expectWalk(w, {"b", "c"});
+    expectSeek(w, "a", "b");
+    expectSeek(w, "bb", "c");
+    expectSeek(w, "d", nullptr);
+
+    w.SetBounds("", "c");
+    expectWalk(w, {"a", "b"});
+
+    w.SetBounds("c", "");
+    expectWalk(w, {"c", "d", "e"});
+
+    w.SetBounds("bb", "bc");
+    expectWalk(w, {});
+}
+
+TEST(TestBounds, iterator)
+{
+    MemoryDB mem = sample();
+    AnyDB &db = mem;
+    auto w = walker(db);
+
+    w.SetBounds("b", "d");
+    expectWalk(w, {"b", "c"});
+    expectSeek(w, "a", "b");
+    expectSeek(w, "bb", "c");
+    expectSeek(w, "d", nullptr);
+
+    w.SetBounds("", "c");
+    expectWalk(w, {"a", "b"});
+
+    w.SetBounds("c", "");
+    expectWalk(w, {"c", "d", "e"});
+}
+
+TEST(TestBounds, subtract)
+{
+    MemoryDB mem = sample();
+    WhiteoutDB wh { "a", "c" };
+    auto w = walker(subtract(mem, wh));
+
+    w.SetBounds("a", "e");
+    expectWalk(w, {"b", "d"});
+    expectSeek(w, "c", "d");
+}
+
+TEST(TestBounds, cover)
+{
+    MemoryDB mem1 = sample();
+    MemoryDB mem2 {
+        { "bb", "6" },
+        { "d", "7" },
+        { "f", "8" },
+    };
+    auto w = walker(cover(mem1, mem2));
+
+    w.SetBounds("b", "e");
+    expectWalk(w, {"b", "bb", "c", "d"});
+    expectSeek(w, "d", "d");
+    EXPECT_EQ( "7", w.value() );
+    expectSeek(w, "e", nullptr);
+}
+
+TEST(TestBounds, txn)
+{
+    MemoryDB mem = sample();
+    auto txn = transaction(mem);
+    auto w = walker(txn);
+
+    w.SetBounds("b", "d");
+    w.SeekToFirst();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "b", w.key() );
+
+    // changes outside of bounds shouldn't affect walker
+    EXPECT_OK( txn.Put("0", "x") );
+    EXPECT_OK( txn.Put("dd", "x") );
+    EXPECT_OK( txn.Delete("a") );
+    EXPECT_OK( txn.Put("bb", "x") );
+
+    w.Next();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "bb", w.key() );
+    w.Next();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "c", w.key() );
+    w.Next();
+    EXPECT_FALSE( w.Valid() );
+
+    expectWalk(w, {"b", "bb", "c"});
+}
+
+TEST(TestBounds, part)
+{
+    MemoryDB mem;
+    AnyDB &db = mem;
+    SandwichDB<RefDB<AnyDB>> sdb { db };
+
+    auto a = sdb.use("alpha");
+    auto b = sdb.use("beta");
+    auto c = sdb.use("gamma");
+
+    for (auto x : { "a", "b", "c" })
+    {
+        EXPECT_OK( a.Put(x, "1") );
+        EXPECT_OK( c.Put(x, "3") );
+    }
+    EXPECT_OK( b.Put("b", "2") );
+
+    auto w = walker(b);
+    expectWalk(w, {"b"});
+    expectSeek(w, "c", nullptr);
+
+    auto wa = walker(a);
+    expectWalk(wa, {"a", "b", "c"});
+    wa.SetBounds("b", "");
+    expectWalk(wa, {"b", "c"});
+    wa.SetBounds("", "b");
+    expectWalk(wa, {"a"});
+}
+
+TEST(TestBounds, common_prefix)
+{
+    MemoryDB mem1 {
+        { "pa", "1" },
+        { "pc", "3" },
+        { "qa", "x" },
+    };
+    MemoryDB mem2 {
+        { "oc", "x" },
+        { "pb", "2" },
+        { "pc", "4" },
+        { "qb", "x" },
+    };
+    auto w = walker(cover(mem1, mem2));
+    w.SetBounds("p", "q");
+    w.SetCommonPrefix(1);
+    expectWalk(w, {"pa", "pb", "pc"});
+    expectSeek(w, "pc", "pc");
+    EXPECT_EQ( "4", w.value() );
+    w.Prev();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "pb", w.key() );
+    w.Next();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "pc", w.key() );
+}
+
+TEST(TestBounds, part_txn)
+{
+    // neighbour parts hold the same suffixes in base, overlay and whiteouts
+    MemoryDB mem;
+    {
+        SandwichDB<RefDB<MemoryDB>> sdb { mem };
+        for (auto name : { "alpha", "beta", "gamma" })
+        {
+            auto part = sdb.use(name);
+            for (auto x : { "a", "b", "c", "d" }) EXPECT_OK( part.Put(x, name) );
+        }
+    }
+
+    auto txn = transaction(mem);
+    SandwichDB<RefDB<TxnDB<MemoryDB>>> sdb { txn };
+    auto a = sdb.use("alpha");
+    auto b = sdb.use("beta");
+    auto c = sdb.use("gamma");
+
+    EXPECT_OK( a.Delete("d") );
+    EXPECT_OK( a.Put("e", "x") );
+    EXPECT_OK( b.Delete("a") );
+    EXPECT_OK( b.Put("bb", "2") );
+    EXPECT_OK( b.Put("c", "3") );
+    EXPECT_OK( c.Delete("b") );
+    EXPECT_OK( c.Put("a", "x") );
+
+    auto w = walker(b);
+    expectWalk(w, {"b", "bb", "c", "d"});
+    expectSeek(w, "a", "b");
+    expectSeek(w, "c", "c");
+    EXPECT_EQ( "3", w.value() );
+
+    w.SetBounds("bb", "");
+    expectWalk(w, {"bb", "c", "d"});
+
+    auto wa = walker(a);
+    expectWalk(wa, {"a", "b", "c", "e"});
+    auto wc = walker(c);
+    expectWalk(wc, {"a", "c", "d"});
+}
@@ -0,0 +1,193 @@
+#include "leveldb/buffered_db.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/walker.hpp"
+
+#include <mutex>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    // memory database that counts batches and tolerates concurrent access
+    struct BatchedDB : AnyDB
+    {
+        MemoryDB impl;
+        mutex lock;
+        size_t writes = 0;
+        bool failing = false;
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        {
+            lock_guard<mutex> guard { lock };
+            return impl.Get(key, value);
+        }
+        Status Put(const Slice &key, const Slice &value) noexcept override
+        {
+            lock_guard<mutex> guard { lock };
+            ++writes;
+            return impl.Put(key, value);
+        }
+        Status Delete(const Slice &key) noexcept override
+        {
+            lock_guard<mutex> guard { lock };
+            ++writes;
+            return impl.Delete(key);
+        }
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return impl.NewIterator(); }
+
+        Status Write(WriteBatch &updates)
+        {
+            lock_guard<mutex> guard { lock };
+            if (failing) return Status::IOError("failing");
+            ++writes;
+            return updates.Iterate(&handler);
+        }
+
+        struct Handler : WriteBatch::Handler
+        {
+            MemoryDB &db;
+            Handler(MemoryDB &origin) : db(origin) {}
+            void Put(const Slice &key, const Slice &value) override { (void) db.Put(key, value); }
+            void Delete(const Slice &key) override { (void) db.Delete(key); }
+        } handler { impl };
+
+        size_t size()
+        {
+            lock_guard<mutex> guard { lock };
+            return impl.size();
+        }
+    };
+}
+
+TEST(TestBuffer, coalesce)
+{
+    BatchedDB db;
+    ASSERT_OK( db.impl.Put("gone", "x") );
+    {
+        BufferedDB<BatchedDB> buffer { db };
+        for (size_t i = 0; i < 100; ++i)
+        {
+            ASSERT_OK( buffer.Put("key" + to_string(i % 10), to_string(i)) );
+        }
+        ASSERT_OK( buffer.Delete("gone") );
+
+        string v;
+        ASSERT_OK( buffer.Get("key3", v) );
+        EXPECT_EQ( "93", v );
+        EXPECT_STATUS( NotFound, buffer.Get("gone", v) );
+        EXPECT_EQ( 0, db.writes );
+        EXPECT_EQ( 1, db.size() );
+
+        ASSERT_OK( buffer.Flush() );
+        EXPECT_EQ( 1, db.writes );
+        EXPECT_EQ( 0, buffer.Pending() );
+        ASSERT_OK( buffer.Flush() ); // nothing to do
+        EXPECT_EQ( 1, db.writes );
+    }
+    EXPECT_EQ( 10, db.size() );
+    string v;
+    ASSERT_OK( db.impl.Get("key9", v) );
+    EXPECT_EQ( "99", v );
+}
+
+TEST(TestBuffer, thresholds)
+{
+    BatchedDB db;
+    {
+        BufferedDB<BatchedDB> buffer { db, 1000 };
+        for (size_t i = 0; i < 100; ++i) ASSERT_OK( buffer.Put("key" + to_string(i), string(50, 'x')) );
+        EXPECT_LT( 1, db.writes );
+        EXPECT_GT( 20, db.writes );
+        EXPECT_GT( 1000, buffer.Pending() );
+    }
+    EXPECT_EQ( 100, db.size() );
+
+    BufferedDB<BatchedDB> aged { db, 1 << 20, chrono::milliseconds(1) };
+    const size_t before = db.writes;
+    ASSERT_OK( aged.Put("a", "1") );
+    this_thread::sleep_for(chrono::milliseconds(5));
+    EXPECT_EQ( before, db.writes ); // age is checked on write only
+    ASSERT_OK( aged.Put("b", "2") ); // too late for buffering
+    EXPECT_EQ( before + 1, db.writes );
+    EXPECT_EQ( 0, aged.Pending() );
+}
+
+TEST(TestBuffer, walker)
+{
+    MemoryDB db { { "a", "1" }, { "c", "3" } };
+    BufferedDB<MemoryDB> buffer { db };
+    ASSERT_OK( buffer.Put("b", "2") );
+    ASSERT_OK( buffer.Delete("c") );
+
+    auto keys = [&] {
+        string result;
+        auto w = walker(buffer);
+        for (w.SeekToFirst(); w.Valid(); w.Next()) result += w.key().ToString();
+        return result;
+    };
+    EXPECT_EQ( "ab", keys() );
+    ASSERT_OK( buffer.Flush() );
+    EXPECT_EQ( "ab", keys() );
+    ASSERT_OK( buffer.Put("d", "4") );
+    EXPECT_EQ( "abd", keys() );
+}
+
+TEST(TestBuffer, background)
+{
+    BatchedDB db;
+    BufferedDB<BatchedDB> buffer { db, 500, chrono::seconds(10), true };
+    string v;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        ASSERT_OK( buffer.Put("key" + to_string(i), to_string(i)) );
+        // everything written so far stays visible while batches are in flight
+        ASSERT_OK( buffer.Get("key" + to_string(i / 2), v) );
+        ASSERT_EQ( to_string(i / 2), v );
+    }
+    ASSERT_OK( buffer.Flush() );
+    EXPECT_EQ( 1000, db.size() );
+    EXPECT_LT( 10, db.writes );
+}
+
+TEST(TestBuffer, failure)
+{
+    BatchedDB db;
+    BufferedDB<BatchedDB> buffer { db };
+    ASSERT_OK( buffer.Put("a", "1") );
+    db.failing = true;
+    EXPECT_STATUS( IOError, buffer.Flush() );
+
+    // still visible and retried with the next flush
+    string v;
+    ASSERT_OK( buffer.Get("a", v) );
+    ASSERT_OK( buffer.Put("b", "2") );
+    EXPECT_STATUS( IOError, buffer.Flush() );
+    db.failing = false;
+    ASSERT_OK( buffer.Flush() );
+    EXPECT_EQ( 2, db.size() );
+}
+
+TEST(TestBuffer, failure_on_write)
+{
+    for (bool background : { false, true })
+    {
+        BatchedDB db;
+        BufferedDB<BatchedDB> buffer { db, 10, chrono::seconds(10), background };
+        db.failing = true;
+        ASSERT_OK( buffer.Put("a", string(10, 'a')) ); // flush fails, not the write
+        ASSERT_OK( buffer.Put("b", string(10, 'b')) ); // the same retried
+        EXPECT_STATUS( IOError, buffer.status() );
+        EXPECT_LT( 0, buffer.Pending() );
+
+        db.failing = false;
+        ASSERT_OK( buffer.Flush() );
+        EXPECT_OK( buffer.status() );
+        EXPECT_EQ( 2, db.size() );
+    }
+}
@@ -0,0 +1,203 @@
+#include "leveldb/cached_db.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/walker.hpp"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    // memory database that counts reads reaching it
+    struct CountingDB : AnyDB
+    {
+        MemoryDB impl;
+        size_t reads = 0;
+
+        Status Get(const Slice &key, std::string &value) noexcept override
+        { ++reads; return impl.Get(key, value); }
+        GetResult Lookup(const Slice &key, std::string &value, Status &status) noexcept override
+        { ++reads; return impl.Lookup(key, value, status); }
+        Status Put(const Slice &key, const Slice &value) noexcept override
+        { return impl.Put(key, value); }
+        Status Delete(const Slice &key) noexcept override
+        { return impl.Delete(key); }
+        std::unique_ptr<Iterator> NewIterator() noexcept override
+        { return impl.NewIterator(); }
+
+        using AnyDB::Write;
+    };
+}
+
+TEST(TestCache, read_through)
+{
+    CountingDB db;
+    ASSERT_OK( db.Put("a", "1") );
+    CachedDB<CountingDB> cache { db };
+
+    string v;
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_OK( cache.Get("a", v) );
+        EXPECT_EQ( "1", v );
+        EXPECT_STATUS( NotFound, cache.Get("b", v) );
+    }
+    EXPECT_EQ( 2, db.reads );
+
+    PinnedSlice pinned;
+    ASSERT_OK( cache.GetPinned("a", pinned) );
+    EXPECT_EQ( "1", pinned );
+    EXPECT_EQ( 2, db.reads );
+
+    const CacheStats stats = cache.cacheStats();
+    EXPECT_EQ( 5, stats.hits );
+    EXPECT_EQ( 2, stats.misses );
+}
+
+TEST(TestCache, invalidation)
+{
+    CountingDB db;
+    CachedDB<CountingDB> cache { db };
+    string v;
+
+    EXPECT_STATUS( NotFound, cache.Get("a", v) );
+    ASSERT_OK( cache.Put("a", "1") );
+    ASSERT_OK( cache.Get("a", v) );
+    EXPECT_EQ( "1", v );
+
+    ASSERT_OK( cache.Put("a", "2") );
+    ASSERT_OK( cache.Get("a", v) );
+    EXPECT_EQ( "2", v );
+
+    ASSERT_OK( cache.Delete("a") );
+    EXPECT_STATUS( NotFound, cache.Get("a", v) );
+
+    WriteBatch batch;
+    batch.Put("a", "3");
+    batch.Put("b", "4");
+    EXPECT_STATUS( NotFound, cache.Get("a", v) ); // cached miss
+    ASSERT_OK( cache.Write(batch) );
+    ASSERT_OK( cache.Get("a", v) );
+    EXPECT_EQ( "3", v );
+    ASSERT_OK( cache.Get("b", v) );
+    EXPECT_EQ( "4", v );
+
+    // change behind our back
+    ASSERT_OK( db.Put("b", "5") );
+    ASSERT_OK( cache.Get("b", v) );
+    EXPECT_EQ( "4", v );
+    cache.Clear();
+    ASSERT_OK( cache.Get("b", v) );
+    EXPECT_EQ( "5", v );
+}
+
+TEST(TestCache, scan_resistance)
+{
+    CountingDB db;
+    for (size_t i = 0; i < 10000; ++i) ASSERT_OK( db.Put("key" + to_string(i), string(100, 'x')) );
+
+    // room for about 50 entries in a single shard
+    CachedDB<CountingDB> cache { db, 50 * 170, 0 };
+    string v;
+    for (int round = 0; round < 3; ++round)
+    {
+        for (size_t i = 0; i < 30; ++i) ASSERT_OK( cache.Get("key" + to_string(i), v) );
+    }
+
+    // one-off scan over cold keys while hot ones are still in use
+    size_t hotMisses = 0;
+    for (size_t i = 100; i < 10000; ++i)
+    {
+        ASSERT_OK( cache.Get("key" + to_string(i), v) );
+        const size_t before = db.reads;
+        ASSERT_OK( cache.Get("key" + to_string(i % 30), v) );
+        hotMisses += db.reads - before;
+    }
+    EXPECT_LT( 0, cache.cacheStats().rejections );
+    EXPECT_GT( 100, hotMisses ) << "hot keys were evicted by scan";
+}
+
+TEST(TestCache, bounded)
+{
+    CountingDB db;
+    CachedDB<CountingDB> cache { db, 100 * 80, 2 };
+    string v;
+    // repeatedly requested keys get admitted in place of older ones
+    for (int round = 0; round < 4; ++round)
+    {
+        for (size_t i = 0; i < 1000; ++i) (void) cache.Get("key" + to_string(i), v);
+    }
+    EXPECT_LT( 0, cache.cacheStats().evictions + cache.cacheStats().rejections );
+    EXPECT_GT( 4000, cache.cacheStats().hits + 1000 ); // surely not everything fits
+}
+
+TEST(TestCache, walker)
+{
+    MemoryDB db { { "a", "1" }, { "b", "2" } };
+    CachedDB<MemoryDB> cache { db };
+    ASSERT_OK( cache.Put("c", "3") );
+
+    string keys;
+    auto w = walker(cache);
+    for (w.SeekToFirst(); w.Valid(); w.Next()) keys += w.key().ToString();
+    EXPECT_EQ( "abc", keys );
+
+    auto it = cache.NewIterator();
+    it->SeekToLast();
+    ASSERT_TRUE( it->Valid() );
+    EXPECT_EQ( "c", it->key() );
+}
+
+TEST(TestCache, under_txn)
+{
+    MemoryDB db { { "a", "1" }, { "b", "2" } };
+    CachedDB<MemoryDB> cache { db };
+    string v;
+    ASSERT_OK( cache.Get("a", v) );
+
+    auto txn = transaction(cache);
+    ASSERT_OK( txn.Put("a", "x") );
+    ASSERT_OK( txn.Delete("b") );
+    ASSERT_OK( txn.Get("a", v) );
+    EXPECT_EQ( "x", v );
+    ASSERT_OK( cache.Get("a", v) );
+    EXPECT_EQ( "1", v );
+
+    ASSERT_OK( txn.commit() );
+    ASSERT_OK( cache.Get("a", v) );
+    EXPECT_EQ( "x", v );
+    EXPECT_STATUS( NotFound, cache.Get("b", v) );
+
+    string keys;
+    auto w = walker(txn);
+    for (w.SeekToFirst(); w.Valid(); w.Next()) keys += w.key().ToString();
+    EXPECT_EQ( "a", keys );
+}
+
+TEST(TestCache, concurrent)
+{
+    MemoryDB db;
+    for (size_t i = 0; i < 100; ++i) ASSERT_OK( db.Put("key" + to_string(i), to_string(i)) );
+    CachedDB<MemoryDB> cache { db, 4096, 2 };
+
+    vector<thread> readers;
+    vector<size_t> wrong(4, 0);
+    for (size_t t = 0; t < 4; ++t)
+    {
+        readers.emplace_back([&cache, &wrong, t] {
+            string v;
+            for (size_t i = 0; i < 10000; ++i)
+            {
+                const size_t k = (i * 7 + t) % 100;
+                if (!cache.Get("key" + to_string(k), v).ok() || v != to_string(k)) ++wrong[t];
+            }
+        });
+    }
+    for (auto &r : readers) r.join();
+    EXPECT_EQ( (vector<size_t>(4, 0)), wrong );
+}
@@ -0,0 +1,225 @@
+#include "leveldb/key_codec.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/walker.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <tuple>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    template <typename T>
+    string encoded(T x)
+    { return Slice(key_order<T>(x)).ToString(); }
+
+    // check that encodings of sorted values are sorted and decode back
+    template <typename T>
+    void expectOrdered(vector<T> values)
+    {
+        sort(values.begin(), values.end());
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            const string k = encoded<T>(values[i]);
+            ASSERT_EQ( key_order<T>::size(), k.size() );
+            EXPECT_EQ( values[i], T(key_order<T>(Slice(k))) );
+            if (i > 0 && values[i - 1] < values[i])
+            { EXPECT_LT( encoded<T>(values[i - 1]), k ) << values[i - 1] << " < " << values[i]; }
+        }
+    }
+
+    template <typename T>
+    vector<T> randomInts(mt19937_64 &gen)
+    {
+        vector<T> values { numeric_limits<T>::min(), numeric_limits<T>::max(), T(0), T(1) };
+        if (is_signed<T>::value) values.push_back(T(-1));
+        for (size_t i = 0; i < 200; ++i) values.push_back(static_cast<T>(gen()));
+        return values;
+    }
+}
+
+TEST(TestCodec, integers)
+{
+    mt19937_64 gen { 1 };
+    expectOrdered(randomInts<uint8_t>(gen));
+    expectOrdered(randomInts<uint16_t>(gen));
+    expectOrdered(randomInts<uint32_t>(gen));
+    expectOrdered(randomInts<uint64_t>(gen));
+    expectOrdered(randomInts<int8_t>(gen));
+    expectOrdered(randomInts<int16_t>(gen));
+    expectOrdered(randomInts<int32_t>(gen));
+    expectOrdered(randomInts<int64_t>(gen));
+    expectOrdered(vector<bool>{ true, false });
+
+    EXPECT_EQ( string("\x00\x00\x01\x02", 4), encoded(uint32_t(0x102)) );
+    EXPECT_EQ( string("\x7f\xff", 2), encoded(int16_t(-1)) );
+    EXPECT_EQ( string("\x80\x00", 2), encoded(int16_t(0)) );
+
+    // usable at compile time
+    constexpr key_order<uint16_t> k { 0x1234 };
+    static_assert(uint16_t(k) == 0x1234, "round trip");
+    static_assert(fixedKeySize<uint32_t, int64_t, bool>() == 13, "sizes");
+}
+
+TEST(TestCodec, floats)
+{
+    mt19937_64 gen { 2 };
+    uniform_real_distribution<double> dist { -1e6, 1e6 };
+    vector<double> doubles {
+        -numeric_limits<double>::infinity(), numeric_limits<double>::infinity(),
+        numeric_limits<double>::lowest(), numeric_limits<double>::max(),
+        numeric_limits<double>::denorm_min(), -numeric_limits<double>::denorm_min(),
+        0.0, 1.0, -1.0, 0.5, -0.5,
+    };
+    for (size_t i = 0; i < 200; ++i) doubles.push_back(dist(gen));
+    expectOrdered(doubles);
+
+    vector<float> floats;
+    for (double x : doubles) floats.push_back(static_cast<float>(x));
+    expectOrdered(floats);
+
+    EXPECT_LT( encoded(-0.0), encoded(0.0) );
+    EXPECT_TRUE( signbit(double(key_order<double>(Slice(encoded(-0.0))))) );
+}
+
+TEST(TestCodec, strings)
+{
+    const vector<string> values {
+        "", string(1, '\0'), string(2, '\0'), string("\0\xff", 2), string("\0\x01", 2),
+        "a", string("a\0", 2), string("a\0b", 3), "a\x01", "ab", "b", "\xff", "\xff\xff",
+    };
+    vector<string> sorted = values;
+    sort(sorted.begin(), sorted.end());
+
+    vector<string> keys;
+    for (const auto &s : sorted)
+    {
+        KeyWriter<> k { Slice(s) };
+        ASSERT_TRUE( k.ok() );
+        keys.push_back(k.ToString());
+
+        string back;
+        ASSERT_TRUE( decodeKey(k, back) );
+        EXPECT_EQ( s, back );
+    }
+    EXPECT_TRUE( is_sorted(keys.begin(), keys.end()) );
+    EXPECT_EQ( keys.end(), adjacent_find(keys.begin(), keys.end()) );
+
+    EXPECT_EQ( string("a\0\xff" "b\0\x01", 6), KeyWriter<>(Slice("a\0b", 3)).ToString() );
+
+    string s;
+    EXPECT_FALSE( decodeKey("abc", s) ); // no terminator
+    EXPECT_FALSE( decodeKey(Slice("a\0", 2), s) );
+    EXPECT_FALSE( decodeKey(Slice("a\0\x02", 3), s) );
+}
+
+TEST(TestCodec, tuples)
+{
+    using Row = tuple<string, int32_t, double>;
+    mt19937_64 gen { 3 };
+    vector<Row> rows;
+    for (size_t i = 0; i < 500; ++i)
+    {
+        string name(gen() % 3, 'a');
+        for (auto &c : name) c = static_cast<char>(gen() % 3); // lots of zeroes
+        rows.emplace_back(name, static_cast<int32_t>(gen() % 7) - 3, double(gen() % 5) / 2 - 1);
+    }
+    sort(rows.begin(), rows.end());
+
+    string prev;
+    for (const auto &row : rows)
+    {
+        KeyWriter<64> k { get<0>(row), get<1>(row), get<2>(row) };
+        ASSERT_TRUE( k.ok() );
+        EXPECT_LE( prev, k.ToString() );
+        prev = k.ToString();
+
+        Row back;
+        ASSERT_TRUE( decodeKey(k, get<0>(back), get<1>(back), get<2>(back)) );
+        EXPECT_EQ( row, back );
+    }
+
+    int32_t x;
+    EXPECT_FALSE( decodeKey(KeyWriter<>(int32_t(1), uint8_t(2)), x) ); // leftovers
+    EXPECT_FALSE( decodeKey(Slice("\x80\x00", 2), x) ); // truncated
+}
+
+TEST(TestCodec, overflow)
+{
+    KeyWriter<8> k;
+    k.add(uint32_t(1));
+    EXPECT_TRUE( k.ok() );
+    k.add("abcd");
+    EXPECT_FALSE( k.ok() );
+    EXPECT_EQ( 4, k.size() );
+    k.add(uint8_t(1)); // sticky
+    EXPECT_FALSE( k.ok() );
+    EXPECT_EQ( 4, k.size() );
+
+    k.clear();
+    k.add("ab", uint16_t(7));
+    EXPECT_TRUE( k.ok() );
+    EXPECT_EQ( 6, k.size() );
+}
+
+TEST(TestCodec, successor)
+{
+    KeyWriter<> k { uint16_t(0x12ff) };
+    ASSERT_TRUE( k.successor() );
+    EXPECT_EQ( "\x13", k.ToString() );
+
+    KeyWriter<> top { uint16_t(0xffff) };
+    EXPECT_FALSE( top.successor() );
+}
+
+TEST(TestCodec, scan)
+{
+    // (user, timestamp) -> event
+    MemoryDB db;
+    for (const string user : { "ann", "bob", "bobby" })
+    {
+        for (int64_t t : { -5, 0, 3, 100 })
+        { ASSERT_OK( db.Put(KeyWriter<>(user, t), user + to_string(t)) ); }
+    }
+
+    // events of bob within [0, 100)
+    auto w = walker(db);
+    w.SetBounds(KeyWriter<>("bob", int64_t(0)), KeyWriter<>("bob", int64_t(100)));
+    vector<int64_t> times;
+    for (w.SeekToFirst(); w.Valid(); w.Next())
+    {
+        string user;
+        int64_t t;
+        ASSERT_TRUE( decodeKey(w.key(), user, t) );
+        EXPECT_EQ( "bob", user );
+        EXPECT_EQ( user + to_string(t), w.value() );
+        times.push_back(t);
+    }
+    EXPECT_EQ( (vector<int64_t>{ 0, 3 }), times );
+
+    // all events of users starting with "bo"
+    KeyWriter<> lower, upper;
+    lower.addPrefix("bo");
+    upper.addPrefix("bo");
+    ASSERT_TRUE( upper.successor() );
+    w.SetBounds(lower, upper);
+    size_t n = 0;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) ++n;
+    EXPECT_EQ( 8, n );
+
+    // all events of exactly "bob"
+    KeyWriter<> bob { "bob" };
+    KeyWriter<> afterBob { "bob" };
+    ASSERT_TRUE( afterBob.successor() );
+    w.SetBounds(bob, afterBob);
+    n = 0;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) ++n;
+    EXPECT_EQ( 4, n );
+}
@@ -0,0 +1,282 @@
+#include "leveldb/compressed_db.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/sandwich_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/walker.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    // small JSON-like documents that look alike
+    string document(size_t i)
+    {
+        static const char *statuses[] = { "active", "suspended", "pending", "deleted" };
+        char buf[256];
+        snprintf(buf, sizeof(buf),
+                 "{\"id\":%zu,\"user\":\"user%zu\",\"status\":\"%s\",\"score\":%zu.%02zu,"
+                 "\"tags\":[\"alpha\",\"beta\"],\"created\":\"2024-%02zu-%02zuT12:00:00Z\"}",
+                 i, i * 7919 % 10007, statuses[i % 4], i % 100, i * 31 % 100, i % 12 + 1, i % 28 + 1);
+        return buf;
+    }
+
+    vector<string> documents(size_t n, size_t from = 0)
+    {
+        vector<string> result;
+        for (size_t i = from; i < from + n; ++i) result.push_back(document(i));
+        return result;
+    }
+
+    // total size of values as stored in base
+    size_t storedSize(MemoryDB &db)
+    {
+        size_t size = 0;
+        MemoryDB::Walker w { db };
+        for (w.SeekToFirst(); w.Valid(); w.Next()) size += w.value().size();
+        return size;
+    }
+}
+
+TEST(TestCompress, round_trip)
+{
+    MemoryDB mem;
+    CompressedDB<MemoryDB> db { mem };
+
+    const string repetitive(4096, 'x');
+    mt19937 gen { 42 };
+    string noise(4096, '\0');
+    for (auto &c : noise) c = static_cast<char>(gen());
+
+    ASSERT_OK( db.Put("empty", "") );
+    ASSERT_OK( db.Put("short", "abc") );
+    ASSERT_OK( db.Put("repetitive", repetitive) );
+    ASSERT_OK( db.Put("noise", noise) );
+
+    string value;
+    ASSERT_OK( db.Get("empty", value) );
+    EXPECT_EQ( "", value );
+    ASSERT_OK( db.Get("short", value) );
+    EXPECT_EQ( "abc", value );
+    ASSERT_OK( db.Get("repetitive", value) );
+    EXPECT_EQ( repetitive, value );
+    ASSERT_OK( db.Get("noise", value) );
+    EXPECT_EQ( noise, value );
+    EXPECT_STATUS( NotFound, db.Get("missing", value) );
+
+    // incompressible values grow by a single octet
+    ASSERT_OK( mem.Get("noise", value) );
+    EXPECT_EQ( noise.size() + 1, value.size() );
+    ASSERT_OK( mem.Get("repetitive", value) );
+    EXPECT_GT( 100u, value.size() );
+
+    PinnedSlice pinned;
+    ASSERT_OK( db.GetPinned("repetitive", pinned) );
+    EXPECT_EQ( repetitive, pinned.ToString() );
+
+    ASSERT_OK( db.Delete("repetitive") );
+    EXPECT_STATUS( NotFound, db.Get("repetitive", value) );
+}
+
+TEST(TestCompress, never_grows)
+{
+    MemoryDB mem;
+    CompressedDB<MemoryDB> db { mem };
+
+    // values that deflate to just a couple of octets less than their size,
+    // which doesn't pay off with 4 octets of tag and varint size
+    for (size_t size = 16384; size < 16384 + 64; ++size)
+    {
+        mt19937 gen { static_cast<uint32_t>(size) };
+        string v(size, '\0');
+        for (auto &c : v) c = static_cast<char>(gen() % 252);
+        const string key = to_string(size);
+        ASSERT_OK( db.Put(key, v) );
+
+        string stored, value;
+        ASSERT_OK( mem.Get(key, stored) );
+        ASSERT_GE( size + 1, stored.size() ) << key;
+        ASSERT_OK( db.Get(key, value) );
+        ASSERT_EQ( v, value );
+    }
+}
+
+TEST(TestCompress, dictionary)
+{
+    const string dict = trainDictionary(documents(1000), 4096);
+    EXPECT_GE( 4096u, dict.size() );
+    EXPECT_LT( 1000u, dict.size() );
+
+    MemoryDB plainMem, dictMem;
+    CompressedDB<MemoryDB> plain { plainMem }, withDict { dictMem, dict };
+    size_t raw = 0;
+    for (size_t i = 1000; i < 2000; ++i)
+    {
+        const string v = document(i);
+        raw += v.size();
+        ASSERT_OK( plain.Put(to_string(i), v) );
+        ASSERT_OK( withDict.Put(to_string(i), v) );
+    }
+
+    string value;
+    ASSERT_OK( withDict.Get("1500", value) );
+    EXPECT_EQ( document(1500), value );
+
+    // individual documents barely compress without dictionary
+    EXPECT_LT( raw * 7 / 10, storedSize(plainMem) );
+    EXPECT_GT( raw / 2, storedSize(dictMem) );
+
+    // dictionary is needed to read them back
+    CompressedDB<MemoryDB> noDict { dictMem };
+    EXPECT_STATUS( Corruption, noDict.Get("1500", value) );
+}
+
+TEST(TestCompress, corruption)
+{
+    MemoryDB mem;
+    CompressedDB<MemoryDB> db { mem };
+    ASSERT_OK( db.Put("a", string(1000, 'a')) );
+
+    string stored;
+    ASSERT_OK( mem.Get("a", stored) );
+    stored[stored.size() / 2] = static_cast<char>(stored[stored.size() / 2] ^ 0x55);
+    stored.pop_back();
+    ASSERT_OK( mem.Put("a", stored) );
+    ASSERT_OK( mem.Put("b", "\x07garbage") );
+    ASSERT_OK( mem.Put("c", "") );
+    ASSERT_OK( mem.Put("d", "\x01\xff\xff\xff\xff\x0f" "abc") ); // size of 4 GiB
+
+    string value;
+    EXPECT_STATUS( Corruption, db.Get("a", value) );
+    EXPECT_STATUS( Corruption, db.Get("b", value) );
+    EXPECT_STATUS( Corruption, db.Get("c", value) );
+    EXPECT_STATUS( Corruption, db.Get("d", value) );
+    EXPECT_TRUE( value.empty() );
+}
+
+TEST(TestCompress, lazy_walker)
+{
+    MemoryDB mem;
+    CompressedDB<MemoryDB> db { mem };
+    const auto docs = documents(10);
+    for (size_t i = 0; i < docs.size(); ++i) ASSERT_OK( db.Put(to_string(i), docs[i] + docs[i]) );
+    ASSERT_OK( db.Put("x", "tiny") );
+    ASSERT_OK( mem.Put("y", "\x01garbage") ); // fails only when decompressed
+
+    CompressedDB<MemoryDB>::Walker w { db };
+    w.SetKeysOnly(true);
+    KeyValue batch[16];
+    w.SeekToFirst();
+    EXPECT_EQ( 12u, w.NextBatch(batch, 16) );
+    EXPECT_STATUS( NotFound, w.status() ); // just walked past the end
+
+    w.SetKeysOnly(false);
+    w.SeekToFirst();
+    ASSERT_EQ( 11u, w.NextBatch(batch, 16) );
+    for (size_t i = 0; i < docs.size(); ++i) EXPECT_EQ( docs[i] + docs[i], batch[i].value.ToString() );
+    EXPECT_EQ( "tiny", batch[10].value.ToString() );
+    EXPECT_STATUS( Corruption, w.status() );
+
+    CompressedDB<MemoryDB>::Walker w2 { db };
+    size_t n = 0;
+    for (w2.SeekToFirst(); w2.Valid() && w2.key() != "y"; w2.Next())
+    {
+        if (w2.key() == "x") EXPECT_EQ( "tiny", w2.value().ToString() );
+        else EXPECT_EQ( docs[n] + docs[n], w2.value().ToString() );
+        EXPECT_EQ( w2.value().ToString(), w2.value().ToString() );
+        ++n;
+    }
+    EXPECT_EQ( 11u, n );
+
+    auto it = db.NewIterator();
+    it->Seek("3");
+    ASSERT_TRUE( it->Valid() );
+    EXPECT_EQ( docs[3] + docs[3], it->value().ToString() );
+}
+
+TEST(TestCompress, batch_and_part)
+{
+    SandwichDB<MemoryDB> sdb;
+    auto part = sdb.use("docs");
+
+    string dict;
+    Status s = part.Dictionary(dict);
+    if (s.IsNotFound()) s = part.SetDictionary(dict = trainDictionary(documents(200)));
+    ASSERT_OK( s );
+
+    CompressedDB<decltype(part)> db { part, dict };
+    WriteBatch batch;
+    batch.Put("a", document(1));
+    batch.Put("b", document(2));
+    batch.Delete("a");
+    ASSERT_OK( db.Write(batch) );
+
+    TxnDB<CompressedDB<decltype(part)>> txn { db };
+    ASSERT_OK( txn.Put("c", document(3)) );
+    ASSERT_OK( txn.commit() );
+
+    string value;
+    EXPECT_STATUS( NotFound, db.Get("a", value) );
+    ASSERT_OK( db.Get("b", value) );
+    EXPECT_EQ( document(2), value );
+
+    // another instance over the same part
+    string stored;
+    ASSERT_OK( part.Dictionary(stored) );
+    CompressedDB<decltype(part)> again { part, stored };
+    ASSERT_OK( again.Get("c", value) );
+    EXPECT_EQ( document(3), value );
+}
+
+// Ratio and throughput. Disabled by default, use "make check-disabled" to run.
+TEST(TestCompress, DISABLED_bench)
+{
+    const size_t n = 100000;
+    const auto docs = documents(n);
+    size_t raw = 0;
+    for (const auto &d : docs) raw += d.size();
+
+    const auto samples = documents(2000, n);
+    for (size_t dictSize : { size_t(0), size_t(4 << 10), size_t(16 << 10) })
+    {
+        auto start = chrono::steady_clock::now();
+        const string dict = dictSize ? trainDictionary(samples, dictSize) : string();
+        chrono::duration<double, milli> trained = chrono::steady_clock::now() - start;
+        if (dictSize) cout << "[ BENCH    ] train " << dict.size() << " octets: " << trained.count() << " ms" << endl;
+
+        for (int level : { 1, 6 })
+        {
+            MemoryDB mem;
+            CompressedDB<MemoryDB> db { mem, dict, level };
+            start = chrono::steady_clock::now();
+            for (size_t i = 0; i < n; ++i) ASSERT_OK( db.Put(to_string(i), docs[i]) );
+            chrono::duration<double, nano> put = chrono::steady_clock::now() - start;
+
+            string value;
+            start = chrono::steady_clock::now();
+            for (size_t i = 0; i < n; ++i) ASSERT_OK( db.Get(to_string(i), value) );
+            chrono::duration<double, nano> get = chrono::steady_clock::now() - start;
+
+            CompressedDB<MemoryDB>::Walker w { db };
+            w.SetKeysOnly(true);
+            size_t keys = 0;
+            start = chrono::steady_clock::now();
+            for (w.SeekToFirst(); w.Valid(); w.Next()) keys += w.key().size();
+            chrono::duration<double, nano> scan = chrono::steady_clock::now() - start;
+            EXPECT_LT( 0u, keys );
+
+            cout << "[ BENCH    ] dictionary " << dict.size() << ", level " << level
+                 << ": ratio " << double(raw) / double(storedSize(mem))
+                 << ", put " << put.count() / double(n) << " ns/op"
+                 << ", get " << get.count() / double(n) << " ns/op"
+                 << ", keys-only scan " << scan.count() / double(n) << " ns/op" << endl;
+        }
+    }
+}
@@ -4,6 +4,11 @@
 #include "leveldb/txn_db.hpp"
 #include "leveldb/walker.hpp"
 
+#include <atomic>
+#include <map>
+#include <set>
+#include <thread>
+
 #include <gtest/gtest.h>
 
 #include "util.hpp"
@@ -358,6 +363,204 @@ TEST(TestSequence, sequence_overflow)
     EXPECT_STATUS( NotFound, seq.Next(overflow) );
 }
 
+TEST(TestSequence, concurrent_next)
+{
+    leveldb::MemoryDB db;
+    leveldb::Sequence<unsigned short> seq {db, "x"};
+
+    const size_t n = 1000;
+    vector<vector<unsigned short>> taken(4);
+    vector<thread> threads;
+    for (auto &values : taken)
+    {
+        threads.emplace_back([&seq, &values] {
+            for (size_t i = 0; i < n; ++i)
+            {
+                unsigned short x;
+                if (seq.Next(x).ok()) values.push_back(x);
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    set<unsigned short> all;
+    for (const auto &values : taken)
+    {
+        EXPECT_EQ( n, values.size() );
+        all.insert(values.begin(), values.end());
+    }
+    EXPECT_EQ( n * taken.size(), all.size() ) << "Some values were taken twice";
+    EXPECT_OK( seq.Sync() );
+}
+
+TEST(TestSequence, concurrent_sync)
+{
+    leveldb::MemoryDB db;
+    set<uint32_t> all;
+    {
+        leveldb::Sequence<uint32_t> seq {db, "x"};
+
+        const size_t n = 100000;
+        vector<vector<uint32_t>> taken(4);
+        atomic<size_t> running { taken.size() };
+        vector<thread> threads;
+        for (auto &values : taken)
+        {
+            threads.emplace_back([&] {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    uint32_t x;
+                    if (seq.Next(x).ok()) values.push_back(x);
+                }
+                --running;
+            });
+        }
+        // gives back the rest of page while others take values from it
+        leveldb::Status synced;
+        thread syncer { [&] { while (running > 0 && synced.ok()) synced = seq.Sync(); } };
+        for (auto &thread : threads) thread.join();
+        syncer.join();
+        EXPECT_OK( synced );
+
+        for (const auto &values : taken)
+        {
+            EXPECT_EQ( n, values.size() );
+            all.insert(values.begin(), values.end());
+        }
+        EXPECT_EQ( n * taken.size(), all.size() ) << "Some values were taken twice";
+        EXPECT_OK( seq.Sync() );
+    }
+
+    // values given back are free indeed
+    leveldb::Sequence<uint32_t> other {db, "x"};
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        uint32_t x;
+        ASSERT_OK( other.Next(x) );
+        EXPECT_EQ( 0u, all.count(x) ) << x << " was taken twice";
+    }
+}
+
+TEST(TestSandwichIterator, concurrent_cook)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+
+    const size_t n = 50;
+    vector<map<string, unsigned short>> cooked(4);
+    vector<thread> threads;
+    for (auto &cookies : cooked)
+    {
+        threads.emplace_back([&sdb, &cookies] {
+            // all threads race for the same names
+            for (size_t i = 0; i < n; ++i)
+            {
+                decltype(sdb)::Cookie cookie;
+                if (sdb.cook("part" + to_string(i), cookie).ok())
+                { cookies["part" + to_string(i)] = cookie; }
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    set<unsigned short> unique;
+    for (const auto &cookies : cooked)
+    {
+        EXPECT_EQ( cooked.front(), cookies );
+        for (const auto &entry : cookies) unique.insert(entry.second);
+    }
+    EXPECT_EQ( n, unique.size() );
+    EXPECT_EQ( 0, unique.count(0) ) << "Meta part cookie was handed out";
+    EXPECT_OK( sdb.Sync() );
+}
+
+TEST(TestSandwichIterator, cook_across_table_growth)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+
+    // table of names is added to in place and reallocated when full
+    const size_t n = 1000;
+    vector<decltype(sdb)::Cookie> first(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        ASSERT_OK( sdb.cook("part" + to_string(i), first[i]) );
+        decltype(sdb)::Cookie again;
+        ASSERT_OK( sdb.cook("part" + to_string(i / 2), again) );
+        EXPECT_EQ( first[i / 2], again );
+    }
+
+    // fresh sandwich over same data loads the same mapping
+    auto other = sdb.ref();
+    for (size_t i = 0; i < n; ++i)
+    {
+        decltype(other)::Cookie cookie;
+        ASSERT_OK( other.cook("part" + to_string(i), cookie) );
+        EXPECT_EQ( first[i], cookie );
+    }
+}
+
+TEST(TestSandwichIterator, drop_and_truncate_among_many)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+
+    const size_t n = 100;
+    vector<decltype(sdb)::Cookie> first(n);
+    for (size_t i = 0; i < n; ++i) ASSERT_OK( sdb.cook("part" + to_string(i), first[i]) );
+
+    // table is patched rather than loaded again
+    for (size_t i = 0; i < n; i += 3) ASSERT_OK( sdb.drop("part" + to_string(i)) );
+    for (size_t i = 1; i < n; i += 3) ASSERT_OK( sdb.truncate("part" + to_string(i)) );
+
+    set<unsigned short> unique;
+    for (size_t i = 0; i < n; ++i)
+    {
+        decltype(sdb)::Cookie cookie;
+        ASSERT_OK( sdb.cook("part" + to_string(i), cookie) );
+        if (i % 3 == 2) EXPECT_EQ( first[i], cookie );
+        else EXPECT_NE( first[i], cookie );
+        unique.insert(cookie);
+    }
+    EXPECT_EQ( n, unique.size() );
+}
+
+TEST(TestSandwichIterator, cook_while_renaming)
+{
+    leveldb::SandwichDB<leveldb::MemoryDB> sdb;
+
+    decltype(sdb)::Cookie a, b;
+    ASSERT_OK( sdb.cook("a", a) );
+    ASSERT_OK( sdb.cook("b", b) );
+
+    // table is changed in place under readers
+    atomic<bool> done { false };
+    vector<size_t> strays(2, 0);
+    vector<thread> threads;
+    for (auto &stray : strays)
+    {
+        threads.emplace_back([&] {
+            while (!done)
+            {
+                decltype(sdb)::Cookie cookie;
+                if (!sdb.cook("a", cookie).ok() || (cookie != a && cookie != b)) ++stray;
+            }
+        });
+    }
+    for (size_t i = 0; i < 200; ++i)
+    {
+        ASSERT_OK( sdb.swap("a", "b") );
+        ASSERT_OK( sdb.rename("b", "c" + to_string(i)) );
+        ASSERT_OK( sdb.rename("c" + to_string(i), "b") );
+    }
+    done = true;
+    for (auto &thread : threads) thread.join();
+    EXPECT_EQ( (vector<size_t>{ 0, 0 }), strays );
+
+    decltype(sdb)::Cookie cookie;
+    ASSERT_OK( sdb.cook("a", cookie) );
+    EXPECT_EQ( a, cookie );
+    ASSERT_OK( sdb.cook("b", cookie) );
+    EXPECT_EQ( b, cookie );
+}
+
 TEST(TestSandwichIterator, stuff_sandwich_to_overflow)
 {
     leveldb::SandwichDB<leveldb::MemoryDB, unsigned char> sdb;
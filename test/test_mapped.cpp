@@ -0,0 +1,252 @@
+#include "leveldb/mapped_db.hpp"
+#include "leveldb/cover_walker.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/walker.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    class TestMapped : public ::testing::TestWithParam<uint32_t> // index interval
+    {
+    protected:
+        const string path = "/tmp/test_mapped_" + to_string(GetParam()) + ".map";
+        MemoryDB source;
+        MappedDB db;
+
+        // even keys only, so there are gaps to look for
+        void build(size_t n)
+        {
+            for (size_t i = 0; i < n; ++i) ASSERT_OK( source.Put(key(2 * i), "v" + to_string(i)) );
+            MemoryDB::Walker w { source };
+            ASSERT_OK( buildMapped(w, path, GetParam()) );
+            ASSERT_OK( db.Open(path) );
+        }
+
+        static string key(size_t i)
+        {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "k%05zu", i);
+            return buf;
+        }
+
+        void TearDown() override
+        {
+            db.Close();
+            remove(path.c_str());
+        }
+    };
+}
+
+TEST_P(TestMapped, get)
+{
+    build(100);
+    EXPECT_EQ( 100u, db.size() );
+
+    string value;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        ASSERT_OK( db.Get(key(2 * i), value) );
+        EXPECT_EQ( "v" + to_string(i), value );
+        EXPECT_STATUS( NotFound, db.Get(key(2 * i + 1), value) );
+    }
+    EXPECT_STATUS( NotFound, db.Get("", value) );
+    EXPECT_STATUS( NotFound, db.Get("a", value) );
+    EXPECT_STATUS( NotFound, db.Get("z", value) );
+
+    Status s;
+    EXPECT_EQ( GetResult::Found, db.Lookup(key(42), value, s) );
+    EXPECT_EQ( "v21", value );
+    EXPECT_EQ( GetResult::NotFound, db.Lookup(key(43), value, s) );
+
+    PinnedSlice pinned;
+    ASSERT_OK( db.GetPinned(key(198), pinned) );
+    EXPECT_EQ( "v99", pinned.ToString() );
+    EXPECT_STATUS( NotFound, db.GetPinned(key(199), pinned) );
+
+    EXPECT_STATUS( NotSupportedError, db.Put("a", "b") );
+    EXPECT_STATUS( NotSupportedError, db.Delete(key(0)) );
+    WriteBatch batch;
+    batch.Put("a", "b");
+    EXPECT_STATUS( NotSupportedError, db.Write(batch) );
+
+    EXPECT_LT( 0u, db.GetApproximateSize(key(0), key(100)) );
+    EXPECT_LT( db.GetApproximateSize(key(0), key(100)), db.GetApproximateSize("", "") );
+    EXPECT_EQ( 0u, db.GetApproximateSize("z", "") );
+}
+
+TEST_P(TestMapped, walker)
+{
+    build(50);
+
+    MappedDB::Walker w { db };
+    vector<string> forward, backward;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) forward.push_back(w.key().ToString());
+    EXPECT_STATUS( NotFound, w.status() ); // just walked past the end
+    for (w.SeekToLast(); w.Valid(); w.Prev()) backward.push_back(w.key().ToString());
+    ASSERT_EQ( 50u, forward.size() );
+    EXPECT_EQ( vector<string>(forward.rbegin(), forward.rend()), backward );
+
+    w.Seek(key(21));
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( key(22), w.key().ToString() );
+    EXPECT_EQ( "v11", w.value().ToString() );
+    w.Prev();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( key(20), w.key().ToString() );
+    w.Seek(key(99));
+    EXPECT_FALSE( w.Valid() );
+    w.Prev(); // from the end
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( key(98), w.key().ToString() );
+
+    // bounds
+    w.SetBounds(key(11), key(20));
+    vector<string> bounded;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) bounded.push_back(w.key().ToString());
+    EXPECT_EQ( (vector<string>{ key(12), key(14), key(16), key(18) }), bounded );
+    w.SeekToLast();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( key(18), w.key().ToString() );
+    w.Seek(key(0));
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( key(12), w.key().ToString() );
+    w.Prev();
+    EXPECT_FALSE( w.Valid() );
+
+    // batches point right into the mapping
+    w.SetBounds("", "");
+    KeyValue batch[8];
+    vector<KeyValue> all;
+    w.SeekToFirst();
+    while (size_t n = w.NextBatch(batch, 8)) all.insert(all.end(), batch, batch + n);
+    ASSERT_EQ( 50u, all.size() );
+    for (size_t i = 0; i < all.size(); ++i)
+    {
+        EXPECT_EQ( key(2 * i), all[i].key.ToString() );
+        EXPECT_EQ( "v" + to_string(i), all[i].value.ToString() );
+    }
+
+    auto it = db.NewIterator();
+    it->Seek(key(30));
+    ASSERT_TRUE( it->Valid() );
+    EXPECT_EQ( "v15", it->value().ToString() );
+}
+
+TEST_P(TestMapped, empty)
+{
+    build(0);
+    EXPECT_EQ( 0u, db.size() );
+
+    string value;
+    EXPECT_STATUS( NotFound, db.Get("a", value) );
+    MappedDB::Walker w { db };
+    w.SeekToFirst();
+    EXPECT_FALSE( w.Valid() );
+    w.SeekToLast();
+    EXPECT_FALSE( w.Valid() );
+    w.Seek("a");
+    EXPECT_FALSE( w.Valid() );
+}
+
+TEST_P(TestMapped, txn_and_cover)
+{
+    build(10);
+
+    TxnDB<MappedDB> txn { db };
+    ASSERT_OK( txn.Put(key(1), "new") );
+    ASSERT_OK( txn.Put(key(2), "changed") );
+    ASSERT_OK( txn.Delete(key(4)) );
+
+    string value;
+    ASSERT_OK( txn.Get(key(1), value) );
+    EXPECT_EQ( "new", value );
+    ASSERT_OK( txn.Get(key(2), value) );
+    EXPECT_EQ( "changed", value );
+    EXPECT_STATUS( NotFound, txn.Get(key(4), value) );
+    ASSERT_OK( txn.Get(key(6), value) );
+    EXPECT_EQ( "v3", value );
+
+    map<string, string> seen;
+    TxnDB<MappedDB>::Walker tw { txn };
+    for (tw.SeekToFirst(); tw.Valid(); tw.Next()) seen[tw.key().ToString()] = tw.value().ToString();
+    EXPECT_EQ( 10u, seen.size() );
+    EXPECT_EQ( "new", seen[key(1)] );
+    EXPECT_EQ( 0u, seen.count(key(4)) );
+
+    EXPECT_STATUS( NotSupportedError, txn.commit() );
+
+    MemoryDB overlay;
+    ASSERT_OK( overlay.Put(key(0), "over") );
+    ASSERT_OK( overlay.Put(key(3), "three") );
+    auto w = walker(cover(db, overlay));
+    vector<string> values;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) values.push_back(w.value().ToString());
+    ASSERT_EQ( 11u, values.size() );
+    EXPECT_EQ( "over", values[0] );
+    EXPECT_EQ( "v1", values[1] );
+    EXPECT_EQ( "three", values[2] );
+}
+
+INSTANTIATE_TEST_CASE_P(Interval, TestMapped, ::testing::Values(1u, 3u, 16u));
+
+TEST(TestMappedBuild, unordered)
+{
+    const string path = "/tmp/test_mapped_unordered.map";
+    {
+        MappedBuilder builder { path };
+        ASSERT_OK( builder.Add("b", "1") );
+        EXPECT_STATUS( InvalidArgument, builder.Add("a", "2") );
+        EXPECT_STATUS( InvalidArgument, builder.Add("c", "3") ); // sticky
+        EXPECT_STATUS( InvalidArgument, builder.Finish() );
+    }
+    ifstream f { path };
+    EXPECT_FALSE( f.is_open() );
+    ifstream temp { path + ".tmp" };
+    EXPECT_FALSE( temp.is_open() );
+}
+
+TEST(TestMappedBuild, corruption)
+{
+    const string path = "/tmp/test_mapped_corrupted.map";
+    MappedDB db;
+    EXPECT_STATUS( IOError, db.Open(path + ".missing") );
+
+    {
+        ofstream f { path };
+        f << "definitely not a mapped table, just some text";
+    }
+    EXPECT_STATUS( Corruption, db.Open(path) );
+    EXPECT_FALSE( db.IsOpen() );
+
+    // entry sizes that run past the end of entries
+    {
+        MappedBuilder builder { path, 1 };
+        ASSERT_OK( builder.Add("a", string(100, 'a')) );
+        ASSERT_OK( builder.Finish() );
+    }
+    {
+        fstream f { path, ios::in | ios::out | ios::binary };
+        f.seekp(1);
+        f.put('\x7f');
+    }
+    ASSERT_OK( db.Open(path) );
+    string value;
+    EXPECT_STATUS( Corruption, db.Get("a", value) );
+    MappedDB::Walker w { db };
+    w.SeekToFirst();
+    EXPECT_FALSE( w.Valid() );
+    EXPECT_STATUS( Corruption, w.status() );
+
+    db.Close();
+    remove(path.c_str());
+}
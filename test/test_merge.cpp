@@ -0,0 +1,163 @@
+#include "leveldb/memory_db.hpp"
+#include "leveldb/sandwich_db.hpp"
+#include "leveldb/ref_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/merge_walker.hpp"
+
+#include <random>
+#include <tuple>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    using Entry = tuple<string, size_t, string>; // key, source, value
+
+    class TestMerge : public ::testing::TestWithParam<unsigned>
+    {
+    protected:
+        MemoryDB db;
+        SandwichDB<RefDB<MemoryDB>> sdb { db };
+        vector<SandwichDB<RefDB<MemoryDB>>::Cookie> cookies;
+        vector<Entry> expected; // in merged order
+
+        void SetUp() override
+        {
+            mt19937 gen { GetParam() };
+            const size_t parts = 1 + gen() % 5;
+            for (size_t p = 0; p < parts; ++p)
+            {
+                auto part = sdb.use("part" + to_string(p));
+                cookies.push_back(part.Cookie());
+                const size_t n = gen() % 20;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    const string k(1, char('a' + gen() % 16));
+                    const string v = to_string(p) + k;
+                    ASSERT_OK( part.Put(k, v) );
+                }
+                auto w = walker(part);
+                for (w.SeekToFirst(); w.Valid(); w.Next())
+                { expected.emplace_back(w.key().ToString(), p, w.value().ToString()); }
+            }
+            // some other part that shouldn't show up
+            ASSERT_OK( sdb.use("other").Put("b", "other") );
+            sort(expected.begin(), expected.end());
+        }
+
+        Entry current(const SandwichDB<RefDB<MemoryDB>>::MergedWalker &w)
+        { return Entry { w.key().ToString(), w.source(), w.value().ToString() }; }
+    };
+}
+
+TEST_P(TestMerge, forward)
+{
+    SandwichDB<RefDB<MemoryDB>>::MergedWalker w { sdb, cookies };
+    vector<Entry> seen;
+    for (w.SeekToFirst(); w.Valid(); w.Next())
+    {
+        seen.push_back(current(w));
+        EXPECT_EQ( cookies[w.source()], w.cookie() );
+    }
+    EXPECT_EQ( expected, seen );
+    EXPECT_STATUS( NotFound, w.status() );
+}
+
+TEST_P(TestMerge, backward)
+{
+    SandwichDB<RefDB<MemoryDB>>::MergedWalker w { sdb, cookies };
+    vector<Entry> seen;
+    for (w.SeekToLast(); w.Valid(); w.Prev()) seen.push_back(current(w));
+    EXPECT_EQ( vector<Entry>(expected.rbegin(), expected.rend()), seen );
+}
+
+TEST_P(TestMerge, zigzag)
+{
+    if (expected.size() < 2) return;
+    SandwichDB<RefDB<MemoryDB>>::MergedWalker w { sdb, cookies };
+    mt19937 gen { GetParam() };
+
+    size_t i = 0;
+    w.SeekToFirst();
+    for (size_t step = 0; step < 100; ++step)
+    {
+        ASSERT_TRUE( w.Valid() );
+        ASSERT_EQ( expected[i], current(w) ) << "step " << step;
+        if ((gen() % 2 == 0 && i > 0) || i + 1 == expected.size())
+        {
+            w.Prev();
+            --i;
+        }
+        else
+        {
+            w.Next();
+            ++i;
+        }
+    }
+}
+
+TEST_P(TestMerge, seek)
+{
+    SandwichDB<RefDB<MemoryDB>>::MergedWalker w { sdb, cookies };
+    for (char c = 'a'; c <= 'q'; ++c)
+    {
+        const string target(1, c);
+        w.Seek(target);
+        auto it = lower_bound(expected.begin(), expected.end(), Entry { target, 0, "" });
+        if (it == expected.end())
+        {
+            EXPECT_FALSE( w.Valid() );
+            continue;
+        }
+        ASSERT_TRUE( w.Valid() );
+        EXPECT_EQ( *it, current(w) );
+        if (it != expected.begin())
+        {
+            w.Prev();
+            ASSERT_TRUE( w.Valid() );
+            EXPECT_EQ( *prev(it), current(w) );
+        }
+    }
+}
+
+TEST_P(TestMerge, bounds)
+{
+    SandwichDB<RefDB<MemoryDB>>::MergedWalker w { sdb, cookies };
+    w.SetBounds("d", "k");
+    vector<Entry> seen;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) seen.push_back(current(w));
+
+    vector<Entry> inRange;
+    for (const auto &e : expected)
+    {
+        if (get<0>(e) >= "d" && get<0>(e) < "k") inRange.push_back(e);
+    }
+    EXPECT_EQ( inRange, seen );
+}
+
+INSTANTIATE_TEST_CASE_P(Random, TestMerge, ::testing::Range(0u, 50u));
+
+TEST(TestMergeTxn, overlay)
+{
+    // generic merge of walkers from different layers
+    MemoryDB a, b;
+    ASSERT_OK( a.Put("a", "1") );
+    ASSERT_OK( a.Put("c", "3") );
+    ASSERT_OK( b.Put("b", "2") );
+    TxnDB<MemoryDB> txn { b };
+    ASSERT_OK( txn.Put("d", "4") );
+    ASSERT_OK( txn.Delete("b") );
+
+    vector<AnyDB::Walker> ws;
+    ws.emplace_back(a);
+    ws.emplace_back(txn);
+    MergeWalker<AnyDB::Walker> w { move(ws) };
+
+    string keys;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) keys += w.key().ToString();
+    EXPECT_EQ( "acd", keys );
+}
@@ -0,0 +1,162 @@
+#include "leveldb/bottom_db.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/merge_walker.hpp"
+#include "leveldb/walker.hpp"
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    // order that disagrees with bytewise one
+    struct ReverseOrder
+    {
+        static int compare(const Slice &a, const Slice &b)
+        { return b.compare(a); }
+    };
+
+    string be64(uint64_t x)
+    {
+        string s(8, '\0');
+        for (size_t i = 8; i-- > 0; x >>= 8) s[i] = static_cast<char>(x & 0xff);
+        return s;
+    }
+
+    template <typename W>
+    vector<string> forward(W &w)
+    {
+        vector<string> keys;
+        for (w.SeekToFirst(); w.Valid(); w.Next()) keys.push_back(w.key().ToString());
+        return keys;
+    }
+
+    template <typename W>
+    vector<string> backward(W &w)
+    {
+        vector<string> keys;
+        for (w.SeekToLast(); w.Valid(); w.Prev()) keys.push_back(w.key().ToString());
+        return keys;
+    }
+}
+
+TEST(TestOrder, uint64)
+{
+    EXPECT_GT( 0, UInt64Order::compare(be64(1), be64(2)) );
+    EXPECT_LT( 0, UInt64Order::compare(be64(0x100), be64(0xff)) );
+    EXPECT_EQ( 0, UInt64Order::compare(be64(42), be64(42)) );
+    EXPECT_GT( 0, UInt64Order::compare(be64(~0ull - 1), be64(~0ull)) );
+    EXPECT_GT( 0, UInt64Order::compare("a", "b") ); // other lengths as bytewise
+
+    BasicMemoryDB<UInt64Order> mem;
+    for (uint64_t x : { 300, 1, 70000, 2 }) ASSERT_OK( mem.Put(be64(x), "v") );
+    auto w = walker(mem);
+    w.SetBounds(be64(2), be64(70000));
+    EXPECT_EQ( (vector<string>{ be64(2), be64(300) }), forward(w) );
+}
+
+TEST(TestOrder, memory)
+{
+    BasicMemoryDB<ReverseOrder> mem {
+        { "a", "1" },
+        { "b", "2" },
+        { "c", "3" },
+    };
+    auto w = walker(mem);
+    EXPECT_EQ( (vector<string>{ "c", "b", "a" }), forward(w) );
+
+    w.SetBounds("c", "a");
+    EXPECT_EQ( (vector<string>{ "c", "b" }), forward(w) );
+    EXPECT_EQ( (vector<string>{ "b", "c" }), backward(w) );
+    w.Seek("bb");
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "b", w.key() );
+}
+
+TEST(TestOrder, txn)
+{
+    BasicMemoryDB<ReverseOrder> mem {
+        { "a", "1" },
+        { "b", "2" },
+        { "d", "4" },
+    };
+    BasicTxnDB<BasicMemoryDB<ReverseOrder>, ReverseOrder> txn { mem };
+    ASSERT_OK( txn.Put("c", "3") );
+    ASSERT_OK( txn.Put("e", "5") );
+    ASSERT_OK( txn.Delete("b") );
+
+    auto w = walker(txn);
+    EXPECT_EQ( (vector<string>{ "e", "d", "c", "a" }), forward(w) );
+    EXPECT_EQ( (vector<string>{ "a", "c", "d", "e" }), backward(w) );
+
+    w.SetBounds("d", "a");
+    EXPECT_EQ( (vector<string>{ "d", "c" }), forward(w) );
+
+    // changes seen by walker in the middle of run
+    w.SetBounds(Slice(), Slice());
+    w.Seek("d");
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "d", w.key() );
+    ASSERT_OK( txn.Put("bb", "x") );
+    w.Next();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "c", w.key() );
+    w.Next();
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( "bb", w.key() );
+
+    KeyValue batch[8];
+    w.SeekToFirst();
+    ASSERT_EQ( 5, w.NextBatch(batch, 8) );
+    EXPECT_EQ( "e", batch[0].key );
+    EXPECT_EQ( "a", batch[4].key );
+
+    ASSERT_OK( txn.commit() );
+    auto m = walker(mem);
+    EXPECT_EQ( (vector<string>{ "e", "d", "c", "bb", "a" }), forward(m) );
+}
+
+TEST(TestOrder, merge)
+{
+    BasicMemoryDB<ReverseOrder> a { { "a", "1" }, { "c", "3" } };
+    BasicMemoryDB<ReverseOrder> b { { "b", "2" }, { "c", "4" } };
+    vector<BasicMemoryDB<ReverseOrder>::Walker> ws { walker(a), walker(b) };
+    MergeWalker<BasicMemoryDB<ReverseOrder>::Walker, ReverseOrder> w { move(ws) };
+    EXPECT_EQ( (vector<string>{ "c", "c", "b", "a" }), forward(w) );
+    EXPECT_EQ( (vector<string>{ "a", "b", "c", "c" }), backward(w) );
+}
+
+TEST(TestOrder, bottom)
+{
+    static const OrderComparator<ReverseOrder> reverse { "test.ReverseOrder" };
+    BottomDB db;
+    db.options.create_if_missing = true;
+    db.options.comparator = &reverse;
+    ASSERT_OK( db.Open("/tmp/test_order_reverse.ldb") );
+    for (const char *k : { "a", "b", "d" }) ASSERT_OK( db.Put(k, k) );
+
+    // bounds follow comparator of database
+    auto b = walker(db);
+    EXPECT_EQ( (vector<string>{ "d", "b", "a" }), forward(b) );
+    b.SetBounds("d", "a");
+    EXPECT_EQ( (vector<string>{ "d", "b" }), forward(b) );
+    EXPECT_EQ( (vector<string>{ "b", "d" }), backward(b) );
+    b.Seek("z"); // below lower bound in this order
+    ASSERT_TRUE( b.Valid() );
+    EXPECT_EQ( "d", b.key() );
+
+    // and so do layers above it with the same order
+    BasicTxnDB<BottomDB, ReverseOrder> txn { db };
+    ASSERT_OK( txn.Put("c", "c") );
+    ASSERT_OK( txn.Delete("b") );
+    auto w = walker(txn);
+    EXPECT_EQ( (vector<string>{ "d", "c", "a" }), forward(w) );
+    w.SetBounds("c", Slice());
+    EXPECT_EQ( (vector<string>{ "c", "a" }), forward(w) );
+    EXPECT_EQ( (vector<string>{ "a", "c" }), backward(w) );
+    w.SetBounds("d", "a");
+    EXPECT_EQ( (vector<string>{ "d", "c" }), forward(w) );
+}
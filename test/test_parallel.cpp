@@ -0,0 +1,197 @@
+#include "leveldb/memory_db.hpp"
+#include "leveldb/sandwich_db.hpp"
+#include "leveldb/ref_db.hpp"
+#include "leveldb/parallel_scan.hpp"
+#include "leveldb/txn_db.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    string numbered(size_t i)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "k%08zu", i);
+        return buf;
+    }
+
+    void fill(AnyDB &db, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+        { ASSERT_OK( db.Put(numbered(i * 7), to_string(i)) ); }
+    }
+
+    // collect entries of range with ordinary walker
+    template <typename DB>
+    map<string, string> sequential(DB &db, const Slice &lower, const Slice &upper)
+    {
+        map<string, string> entries;
+        typename DB::Walker w { db };
+        w.SetBounds(lower, upper);
+        for (w.SeekToFirst(); w.Valid(); w.Next())
+        { entries.emplace(w.key().ToString(), w.value().ToString()); }
+        return entries;
+    }
+}
+
+TEST(TestParallel, split)
+{
+    MemoryDB db;
+    fill(db, 1000);
+
+    vector<Bounds> ranges;
+    ASSERT_OK( splitRange(db, Slice(), Slice(), 4, ranges) );
+    ASSERT_EQ( 4, ranges.size() );
+    EXPECT_EQ( "", ranges.front().lower );
+    EXPECT_EQ( "", ranges.back().upper );
+    for (size_t i = 1; i < ranges.size(); ++i)
+    {
+        EXPECT_EQ( ranges[i - 1].upper, ranges[i].lower );
+        EXPECT_LT( ranges[i].lower, ranges[i].upper.empty() ? "\xff" : ranges[i].upper );
+    }
+
+    // evenly spread keys give roughly equal pieces
+    for (const auto &range : ranges)
+    {
+        const auto n = sequential(db, range.lower, range.upper).size();
+        EXPECT_LT( 150, n ) << range.lower << " - " << range.upper;
+        EXPECT_GT( 350, n ) << range.lower << " - " << range.upper;
+    }
+
+    ASSERT_OK( splitRange(db, numbered(100), numbered(200), 3, ranges) );
+    ASSERT_EQ( 3, ranges.size() );
+    EXPECT_EQ( numbered(100), ranges.front().lower );
+    EXPECT_EQ( numbered(200), ranges.back().upper );
+
+    ASSERT_OK( splitRange(db, Slice(), Slice(), 1, ranges) );
+    ASSERT_EQ( 1, ranges.size() );
+
+    ASSERT_OK( splitRange(db, "x", Slice(), 4, ranges) );
+    EXPECT_TRUE( ranges.empty() );
+
+    MemoryDB single;
+    ASSERT_OK( single.Put("a", "1") );
+    ASSERT_OK( splitRange(single, Slice(), Slice(), 4, ranges) );
+    ASSERT_EQ( 1, ranges.size() );
+}
+
+TEST(TestParallel, mismatch)
+{
+    const string a(100, 'x');
+    for (size_t n = 0; n <= a.size(); ++n)
+    {
+        for (size_t at = 0; at <= n; ++at)
+        {
+            string b = a;
+            if (at < n) b[at] = '\xf0'; // octet with high bit too
+            ASSERT_EQ( at, detail::mismatch(a.data(), b.data(), n) ) << n << " " << at;
+        }
+    }
+}
+
+TEST(TestParallel, unordered)
+{
+    MemoryDB db;
+    fill(db, 5000);
+
+    for (size_t threads : { 1, 2, 3, 8 })
+    {
+        mutex lock;
+        map<string, string> seen;
+        size_t duplicates = 0;
+        ASSERT_OK( parallelScan(db, numbered(10), numbered(30000), threads,
+            [&](const Slice &key, const Slice &value) {
+                lock_guard<mutex> guard { lock };
+                if (!seen.emplace(key.ToString(), value.ToString()).second) ++duplicates;
+            }) );
+        EXPECT_EQ( 0, duplicates );
+        EXPECT_EQ( sequential(db, numbered(10), numbered(30000)), seen ) << threads;
+    }
+}
+
+TEST(TestParallel, ordered)
+{
+    MemoryDB db;
+    fill(db, 5000);
+
+    for (size_t threads : { 1, 2, 8 })
+    {
+        vector<pair<string, string>> seen;
+        ASSERT_OK( orderedScan(db, Slice(), Slice(), threads,
+            [&](const Slice &key, const Slice &value) {
+                seen.emplace_back(key.ToString(), value.ToString());
+            }, 100) );
+        const auto entries = sequential(db, Slice(), Slice());
+        const vector<pair<string, string>> expected { entries.begin(), entries.end() };
+        EXPECT_EQ( expected, seen ) << threads;
+    }
+
+    size_t n = 0;
+    ASSERT_OK( orderedScan(db, "x", Slice(), 4, [&](const Slice &, const Slice &) { ++n; }) );
+    EXPECT_EQ( 0, n );
+}
+
+TEST(TestParallel, part)
+{
+    MemoryDB db;
+    SandwichDB<RefDB<MemoryDB>> sdb { db };
+    auto alpha = sdb.use("alpha");
+    auto beta = sdb.use("beta");
+    fill(alpha, 1000);
+    fill(beta, 10);
+
+    vector<string> keys;
+    ASSERT_OK( orderedScan(alpha, Slice(), Slice(), 4,
+        [&](const Slice &key, const Slice &) { keys.push_back(key.ToString()); }) );
+    ASSERT_EQ( 1000, keys.size() );
+    for (size_t i = 0; i < keys.size(); ++i) EXPECT_EQ( numbered(i * 7), keys[i] );
+
+    atomic<size_t> n { 0 };
+    ASSERT_OK( parallelScan(beta, Slice(), Slice(), 4,
+        [&](const Slice &, const Slice &) { ++n; }) );
+    EXPECT_EQ( 10, n );
+}
+
+TEST(TestParallel, txn)
+{
+    MemoryDB db;
+    fill(db, 2000);
+
+    // walkers of transaction register within it
+    TxnDB<MemoryDB> txn { db };
+    for (size_t i = 0; i < 2000; i += 10) ASSERT_OK( txn.Delete(numbered(i * 7)) );
+    for (size_t i = 0; i < 500; ++i) ASSERT_OK( txn.Put(numbered(i * 7 + 3), "new") );
+    const auto entries = sequential(txn, Slice(), Slice());
+
+    for (size_t threads : { 1, 4 })
+    {
+        mutex lock;
+        map<string, string> seen;
+        ASSERT_OK( parallelScan(txn, Slice(), Slice(), threads,
+            [&](const Slice &key, const Slice &value) {
+                lock_guard<mutex> guard { lock };
+                seen.emplace(key.ToString(), value.ToString());
+            }) );
+        EXPECT_EQ( entries, seen ) << threads;
+
+        vector<pair<string, string>> ordered;
+        ASSERT_OK( orderedScan(txn, Slice(), Slice(), threads,
+            [&](const Slice &key, const Slice &value) {
+                ordered.emplace_back(key.ToString(), value.ToString());
+            }, 100) );
+        EXPECT_EQ( (vector<pair<string, string>> { entries.begin(), entries.end() }), ordered ) << threads;
+    }
+
+    // walkers are gone along with the scan so updates are fine
+    ASSERT_OK( txn.Put(numbered(1), "after") );
+    EXPECT_EQ( entries.size() + 1, sequential(txn, Slice(), Slice()).size() );
+}
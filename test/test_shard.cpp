@@ -0,0 +1,185 @@
+#include "leveldb/sharded_db.hpp"
+#include "leveldb/memory_db.hpp"
+#include "leveldb/sandwich_db.hpp"
+#include "leveldb/ref_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/parallel_scan.hpp"
+#include "leveldb/walker.hpp"
+
+#include <algorithm>
+#include <map>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    class TestShard : public ::testing::TestWithParam<bool> // by range?
+    {
+    protected:
+        MemoryDB a, b, c;
+        ShardedDB<MemoryDB> db = GetParam()
+            ? ShardedDB<MemoryDB>({ &a, &b, &c }, { "key3", "key6" })
+            : ShardedDB<MemoryDB>({ &a, &b, &c });
+        map<string, string> expected;
+
+        void fill(size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                const string k = "key" + to_string(i);
+                ASSERT_OK( db.Put(k, to_string(i)) );
+                expected[k] = to_string(i);
+            }
+        }
+    };
+}
+
+TEST_P(TestShard, routing)
+{
+    fill(100);
+    EXPECT_EQ( 100, a.size() + b.size() + c.size() );
+    EXPECT_LT( 0, a.size() );
+    EXPECT_LT( 0, b.size() );
+    EXPECT_LT( 0, c.size() );
+    if (GetParam())
+    {
+        EXPECT_EQ( 0, db.shardOf("key1") );
+        EXPECT_EQ( 1, db.shardOf("key3") );
+        EXPECT_EQ( 2, db.shardOf("key99") );
+    }
+
+    string v;
+    for (const auto &kv : expected)
+    {
+        ASSERT_OK( db.Get(kv.first, v) );
+        EXPECT_EQ( kv.second, v );
+    }
+    ASSERT_OK( db.Delete("key42") );
+    EXPECT_STATUS( NotFound, db.Get("key42", v) );
+    EXPECT_EQ( 99, a.size() + b.size() + c.size() );
+}
+
+TEST_P(TestShard, batch)
+{
+    fill(10);
+    WriteBatch batch;
+    for (size_t i = 0; i < 50; ++i) batch.Put("new" + to_string(i), "x");
+    batch.Delete("key1");
+    batch.Delete("key7");
+    ASSERT_OK( db.Write(batch) );
+    EXPECT_EQ( 58, a.size() + b.size() + c.size() );
+
+    string v;
+    ASSERT_OK( db.Get("new33", v) );
+    EXPECT_STATUS( NotFound, db.Get("key7", v) );
+
+    WriteBatch empty;
+    ASSERT_OK( db.Write(empty) );
+}
+
+TEST_P(TestShard, many_batches)
+{
+    // small batches spanning shards go through the same writers each time
+    for (size_t i = 0; i < 300; ++i)
+    {
+        WriteBatch batch;
+        for (size_t k = 0; k < 4; ++k) batch.Put("key" + to_string(i * 4 + k), "x");
+        if (i > 0) batch.Delete("key" + to_string(i * 4 - 1));
+        ASSERT_OK( db.Write(batch) );
+    }
+    EXPECT_EQ( 901, a.size() + b.size() + c.size() );
+
+    // and moved database keeps them
+    ShardedDB<MemoryDB> moved { std::move(db) };
+    WriteBatch batch;
+    batch.Put("key0", "y");
+    batch.Put("key5", "y");
+    batch.Put("key9", "y");
+    ASSERT_OK( moved.Write(batch) );
+    string v;
+    ASSERT_OK( moved.Get("key5", v) );
+    EXPECT_EQ( "y", v );
+}
+
+TEST_P(TestShard, walker)
+{
+    fill(100);
+    const vector<pair<string, string>> all { expected.begin(), expected.end() };
+
+    auto w = walker(db);
+    vector<pair<string, string>> seen;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) seen.emplace_back(w.key().ToString(), w.value().ToString());
+    EXPECT_EQ( all, seen );
+
+    vector<pair<string, string>> reversed;
+    for (w.SeekToLast(); w.Valid(); w.Prev()) reversed.emplace_back(w.key().ToString(), w.value().ToString());
+    reverse(reversed.begin(), reversed.end());
+    EXPECT_EQ( all, reversed );
+
+    w.SetBounds("key5", "key6");
+    size_t n = 0;
+    for (w.SeekToFirst(); w.Valid(); w.Next()) ++n;
+    EXPECT_EQ( 11, n ); // key5, key50 .. key59
+
+    w.SetBounds(Slice(), Slice());
+    KeyValue entries[16];
+    n = 0;
+    w.SeekToFirst();
+    while (size_t k = w.NextBatch(entries, 16))
+    {
+        for (size_t i = 0; i < k; ++i, ++n) EXPECT_EQ( all[n].first, entries[i].key );
+    }
+    EXPECT_EQ( all.size(), n );
+
+    auto it = db.NewIterator();
+    it->Seek("key77");
+    ASSERT_TRUE( it->Valid() );
+    EXPECT_EQ( "key77", it->key() );
+    it->Next();
+    ASSERT_TRUE( it->Valid() );
+    EXPECT_EQ( "key78", it->key() );
+}
+
+TEST_P(TestShard, layers)
+{
+    SandwichDB<RefDB<ShardedDB<MemoryDB>>> sdb { db };
+    auto alpha = sdb.use("alpha");
+    auto beta = sdb.use("beta");
+    for (size_t i = 0; i < 100; ++i)
+    {
+        ASSERT_OK( alpha.Put("k" + to_string(i), "a") );
+        ASSERT_OK( beta.Put("k" + to_string(i), "b") );
+    }
+
+    auto txn = transaction(db);
+    SandwichDB<RefDB<TxnDB<ShardedDB<MemoryDB>>>> tsdb { txn };
+    auto talpha = alpha.ref(tsdb);
+    ASSERT_OK( talpha.Put("k5", "x") );
+    ASSERT_OK( talpha.Delete("k6") );
+
+    size_t n = 0;
+    auto w = walker(talpha);
+    for (w.SeekToFirst(); w.Valid(); w.Next())
+    {
+        EXPECT_EQ( w.key() == "k5" ? "x" : "a", w.value() ) << w.key().ToString();
+        ++n;
+    }
+    EXPECT_EQ( 99, n );
+
+    ASSERT_OK( txn.commit() );
+    string v;
+    ASSERT_OK( alpha.Get("k5", v) );
+    EXPECT_EQ( "x", v );
+
+    vector<string> keys;
+    ASSERT_OK( orderedScan(beta, Slice(), Slice(), 3,
+        [&](const Slice &key, const Slice &) { keys.push_back(key.ToString()); }) );
+    EXPECT_EQ( 100, keys.size() );
+    EXPECT_TRUE( is_sorted(keys.begin(), keys.end()) );
+}
+
+INSTANTIATE_TEST_CASE_P(Partitioning, TestShard, ::testing::Bool());
@@ -0,0 +1,338 @@
+#include "leveldb/memory_db.hpp"
+#include "leveldb/txn_db.hpp"
+#include "leveldb/value_log_db.hpp"
+#include "leveldb/walker.hpp"
+
+#include <cstdlib>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include "util.hpp"
+
+using namespace std;
+using namespace leveldb;
+
+namespace {
+    struct TestVLog : ::testing::Test
+    {
+        string dir;
+
+        void SetUp() override
+        {
+            char path[] = "/tmp/test_vlog.XXXXXX";
+            ASSERT_TRUE( mkdtemp(path) );
+            dir = path;
+        }
+
+        void TearDown() override
+        { (void) system(("rm -rf " + dir).c_str()); }
+
+        static string big(char c, size_t n = 8192)
+        { return string(n, c); }
+    };
+
+    // environment that can fail appends to new files
+    struct FailingEnv : EnvWrapper
+    {
+        bool failing = false;
+        size_t created = 0;
+
+        FailingEnv() : EnvWrapper(Env::Default()) {}
+
+        struct File : WritableFile
+        {
+            FailingEnv &env;
+            unique_ptr<WritableFile> impl;
+            File(FailingEnv &env, WritableFile *impl) : env(env), impl(impl) {}
+
+            Status Append(const Slice &data) override
+            {
+                if (!env.failing) return impl->Append(data);
+                (void) impl->Append(Slice(data.data(), data.size() / 2)); // torn
+                (void) impl->Flush();
+                return Status::IOError("failing");
+            }
+            Status Close() override { return impl->Close(); }
+            Status Flush() override { return impl->Flush(); }
+            Status Sync() override { return impl->Sync(); }
+        };
+
+        Status NewWritableFile(const string &name, WritableFile **result) override
+        {
+            WritableFile *impl;
+            Status s = target()->NewWritableFile(name, &impl);
+            if (!s.ok()) return s;
+            ++created;
+            *result = new File(*this, impl);
+            return s;
+        }
+    };
+}
+
+TEST_F(TestVLog, inline_and_logged)
+{
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024 };
+    ASSERT_OK( db.Open(dir) );
+
+    ASSERT_OK( db.Put("a", "small") );
+    ASSERT_OK( db.Put("b", big('b')) );
+
+    string raw;
+    ASSERT_OK( mem.Get("a", raw) );
+    EXPECT_EQ( string("\0small", 6), raw );
+    ASSERT_OK( mem.Get("b", raw) );
+    EXPECT_GT( 32u, raw.size() );
+
+    string value;
+    ASSERT_OK( db.Get("a", value) );
+    EXPECT_EQ( "small", value );
+    ASSERT_OK( db.Get("b", value) );
+    EXPECT_EQ( big('b'), value );
+    EXPECT_STATUS( NotFound, db.Get("c", value) );
+
+    Status s;
+    EXPECT_EQ( GetResult::Found, db.Lookup("b", value, s) );
+    EXPECT_EQ( big('b'), value );
+    PinnedSlice pinned;
+    ASSERT_OK( db.GetPinned("b", pinned) );
+    EXPECT_EQ( big('b'), pinned.ToString() );
+
+    ASSERT_OK( db.Delete("b") );
+    EXPECT_STATUS( NotFound, db.Get("b", value) );
+}
+
+TEST_F(TestVLog, reopen)
+{
+    MemoryDB mem;
+    {
+        ValueLogDB<MemoryDB> db { mem, 1024 };
+        ASSERT_OK( db.Open(dir) );
+        ASSERT_OK( db.Put("a", big('a')) );
+        EXPECT_EQ( 1u, db.Segments() );
+    }
+    ValueLogDB<MemoryDB> db { mem, 1024 };
+    ASSERT_OK( db.Open(dir) );
+    EXPECT_EQ( 2u, db.Segments() );
+    ASSERT_OK( db.Put("b", big('b')) );
+
+    string value;
+    ASSERT_OK( db.Get("a", value) );
+    EXPECT_EQ( big('a'), value );
+    ASSERT_OK( db.Get("b", value) );
+    EXPECT_EQ( big('b'), value );
+}
+
+TEST_F(TestVLog, corruption)
+{
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024 };
+    ASSERT_OK( db.Open(dir) );
+    ASSERT_OK( db.Put("a", big('a')) );
+
+    {
+        fstream f { dir + "/000001.vlog", ios::in | ios::out | ios::binary };
+        f.seekp(100);
+        f.put('x');
+    }
+
+    string value;
+    EXPECT_STATUS( Corruption, db.Get("a", value) );
+
+    // pointer to other key's record is caught as well
+    string raw;
+    ASSERT_OK( db.Put("b", big('b')) );
+    ASSERT_OK( mem.Get("b", raw) );
+    ASSERT_OK( mem.Put("c", raw) );
+    EXPECT_STATUS( Corruption, db.Get("c", value) );
+}
+
+TEST_F(TestVLog, walker)
+{
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024 };
+    ASSERT_OK( db.Open(dir) );
+    for (char c = 'a'; c < 'k'; ++c)
+    {
+        // logged in reverse order so prefetch has to sort pointers
+        const char k = static_cast<char>('a' + 'j' - c);
+        ASSERT_OK( db.Put(string(1, k), (k % 2) ? big(k) : string(1, k)) );
+    }
+
+    ValueLogDB<MemoryDB>::Walker w { db };
+    string seen;
+    for (w.SeekToFirst(); w.Valid(); w.Next())
+    {
+        const char k = w.key()[0];
+        EXPECT_EQ( (k % 2) ? big(k) : string(1, k), w.value().ToString() );
+        seen += k;
+    }
+    EXPECT_STATUS( NotFound, w.status() ); // just walked past the end
+    EXPECT_EQ( "abcdefghij", seen );
+
+    KeyValue batch[4];
+    seen.clear();
+    w.SeekToFirst();
+    while (size_t n = w.NextBatch(batch, 4))
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            const char k = batch[i].key[0];
+            EXPECT_EQ( (k % 2) ? big(k) : string(1, k), batch[i].value.ToString() );
+            seen += k;
+        }
+    }
+    EXPECT_STATUS( NotFound, w.status() ); // just walked past the end
+    EXPECT_EQ( "abcdefghij", seen );
+
+    auto it = db.NewIterator();
+    it->Seek("e");
+    ASSERT_TRUE( it->Valid() );
+    EXPECT_EQ( big('e'), it->value().ToString() );
+}
+
+TEST_F(TestVLog, batch)
+{
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024 };
+    ASSERT_OK( db.Open(dir) );
+    ASSERT_OK( db.Put("c", "gone") );
+
+    WriteBatch batch;
+    batch.Put("a", big('a'));
+    batch.Put("b", "b");
+    batch.Delete("c");
+    ASSERT_OK( db.Write(batch) );
+
+    string value;
+    ASSERT_OK( db.Get("a", value) );
+    EXPECT_EQ( big('a'), value );
+    ASSERT_OK( db.Get("b", value) );
+    EXPECT_EQ( "b", value );
+    EXPECT_STATUS( NotFound, db.Get("c", value) );
+
+    // over transaction
+    TxnDB<ValueLogDB<MemoryDB>> txn { db };
+    ASSERT_OK( txn.Put("d", big('d')) );
+    ASSERT_OK( txn.commit() );
+    ASSERT_OK( db.Get("d", value) );
+    EXPECT_EQ( big('d'), value );
+}
+
+TEST_F(TestVLog, collect)
+{
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024, 20000 };
+    ASSERT_OK( db.Open(dir) );
+    EXPECT_STATUS( NotFound, db.Collect() );
+
+    // two records per segment
+    for (char c = 'a'; c < 'g'; ++c) ASSERT_OK( db.Put(string(1, c), big(c, 10000)) );
+    EXPECT_EQ( 3u, db.Segments() );
+
+    // leave one live record in each of two oldest segments
+    ASSERT_OK( db.Delete("a") );
+    ASSERT_OK( db.Put("d", "short") );
+
+    ASSERT_OK( db.Collect(2) );
+    EXPECT_EQ( 2u, db.Segments() );
+    ifstream gone { dir + "/000001.vlog" };
+    EXPECT_FALSE( gone.is_open() );
+
+    string value;
+    EXPECT_STATUS( NotFound, db.Get("a", value) );
+    for (char c : string("bcef"))
+    {
+        ASSERT_OK( db.Get(string(1, c), value) );
+        EXPECT_EQ( big(c, 10000), value );
+    }
+    ASSERT_OK( db.Get("d", value) );
+    EXPECT_EQ( "short", value );
+
+    // survives reopen
+    ValueLogDB<MemoryDB> again { mem, 1024, 20000 };
+    ASSERT_OK( again.Open(dir) );
+    ASSERT_OK( again.Get("b", value) );
+    EXPECT_EQ( big('b', 10000), value );
+}
+
+TEST_F(TestVLog, collect_while_reading)
+{
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024, 20000 };
+    ASSERT_OK( db.Open(dir) );
+    for (char c = 'a'; c < 'e'; ++c) ASSERT_OK( db.Put(string(1, c), big(c, 10000)) );
+    string old;
+    ASSERT_OK( mem.Get("a", old) );
+
+    // walker pins segments before it reads any pointer
+    ValueLogDB<MemoryDB>::Walker w { db };
+    ASSERT_OK( db.Collect() );
+    ifstream gone { dir + "/000001.vlog" };
+    EXPECT_FALSE( gone.is_open() );
+
+    // pointer into collected segment as seen by a reader that looked into
+    // base before Collect() rewrote it
+    ASSERT_OK( mem.Put("a", old) );
+    w.Seek("a");
+    ASSERT_TRUE( w.Valid() );
+    EXPECT_EQ( big('a', 10000), w.value().ToString() );
+    EXPECT_OK( w.status() );
+
+    // readers that come later don't know that segment anymore
+    string value;
+    EXPECT_STATUS( Corruption, db.Get("a", value) );
+}
+
+TEST_F(TestVLog, not_open)
+{
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024 };
+
+    EXPECT_STATUS( IOError, db.Put("a", "small") );
+    EXPECT_STATUS( IOError, db.Put("b", big('b')) );
+    EXPECT_STATUS( IOError, db.Delete("a") );
+    WriteBatch batch;
+    batch.Put("c", big('c'));
+    EXPECT_STATUS( IOError, db.Write(batch) );
+    EXPECT_EQ( 0u, mem.size() );
+    EXPECT_EQ( 0u, db.Segments() );
+
+    // failed Open() doesn't help either
+    EXPECT_STATUS( IOError, db.Open(dir + "/missing/nested") );
+    EXPECT_STATUS( IOError, db.Put("b", big('b')) );
+
+    ASSERT_OK( db.Open(dir) );
+    ASSERT_OK( db.Put("b", big('b')) );
+}
+
+TEST_F(TestVLog, env)
+{
+    FailingEnv env;
+    MemoryDB mem;
+    ValueLogDB<MemoryDB> db { mem, 1024 };
+    db.env = &env;
+    ASSERT_OK( db.Open(dir) );
+    EXPECT_EQ( 1u, env.created );
+    ASSERT_OK( db.Put("a", big('a')) );
+
+    env.failing = true;
+    EXPECT_STATUS( IOError, db.Put("b", big('b')) );
+    string value;
+    EXPECT_STATUS( NotFound, db.Get("b", value) );
+
+    // torn record stays behind while appends go on in a fresh segment
+    env.failing = false;
+    ASSERT_OK( db.Put("b", big('b')) );
+    EXPECT_EQ( 2u, env.created );
+    EXPECT_EQ( 2u, db.Segments() );
+    ASSERT_OK( db.Get("a", value) );
+    EXPECT_EQ( big('a'), value );
+    ASSERT_OK( db.Get("b", value) );
+    EXPECT_EQ( big('b'), value );
+
+    ASSERT_OK( db.Collect() );
+    ASSERT_OK( db.Get("a", value) );
+    EXPECT_EQ( big('a'), value );
+}
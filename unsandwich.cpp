@@ -0,0 +1,229 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2014 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "leveldb/sandwich_db.hpp"
+#include "leveldb/bottom_db.hpp"
+
+using namespace std;
+
+typedef leveldb::SandwichDB<leveldb::BottomDB> Sandwich;
+
+void usage()
+{
+	cerr << "Usage: unsandwich [options...] <SOURCE> [PART...]" << endl
+	     << "Extract parts (all if none specified) into separate databases." << endl
+	     << "Options:" << endl
+	     << "    -s<SUFFIX>  Append <SUFFIX> to each part name to get its database" << endl
+	     << "    -j<N>       Extract <N> parts concurrently (default: number of cores)" << endl
+	     << "    -b<MiB>     Size of write batches (default: 4)" << endl
+	     << "    -w<MiB>     Write buffer size of extracted databases (default: 64)" << endl
+	     << "    -c          Compact each extracted database" << endl
+	     << "    -q          Don't report progress" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	string suffix = "";
+	vector<string> names;
+	string source;
+	size_t threads = thread::hardware_concurrency();
+	size_t batchSize = 4 << 20;
+	size_t writeBuffer = 64 << 20;
+	bool compact = false;
+	bool quiet = false;
+
+	for (int n = 1; n < argc; ++n)
+	{
+		if (argv[n][0] == '-')
+		{
+			switch (argv[n][1])
+			{
+			case 's':
+				suffix = argv[n] + 2;
+				break;
+
+			case 'j':
+				threads = strtoul(argv[n] + 2, nullptr, 10);
+				break;
+
+			case 'b':
+				batchSize = strtoul(argv[n] + 2, nullptr, 10) << 20;
+				break;
+
+			case 'w':
+				writeBuffer = strtoul(argv[n] + 2, nullptr, 10) << 20;
+				break;
+
+			case 'c':
+				compact = true;
+				break;
+
+			case 'q':
+				quiet = true;
+				break;
+
+			default:
+				cerr << "Wrong argument " << argv[n] << endl;
+				usage();
+				return 1;
+			}
+
+		}
+		else if (source.empty())
+		{
+			source = argv[n];
+		}
+		else
+		{
+			names.push_back(argv[n]);
+		}
+	}
+
+	if (source.empty())
+	{
+		cerr << "At least source database should be provided" << endl;
+		usage();
+		return 1;
+	}
+	if (threads == 0) threads = 1;
+	if (batchSize == 0) batchSize = 1;
+
+	Sandwich sdb;
+	sdb->readOptions.fill_cache = false; // each record is read once
+	auto s = sdb->Open(source.c_str());
+
+	if (!s.ok())
+	{
+		cerr << "Failed to open source database " << source << ": " << s.ToString() << endl;
+		return 2;
+	}
+
+	// resolve names without creating missing parts
+	vector<pair<string, Sandwich::Cookie>> known;
+	s = sdb.forEachPart([&known](const leveldb::Slice &name, Sandwich::Cookie cookie) {
+		known.emplace_back(name.ToString(), cookie);
+	});
+	if (!s.ok())
+	{
+		cerr << "Failed to list parts of " << source << ": " << s.ToString() << endl;
+		return 2;
+	}
+
+	vector<pair<string, Sandwich::Cookie>> parts;
+	if (names.empty())
+	{
+		parts = move(known);
+	}
+	else
+	{
+		for (const auto &name : names)
+		{
+			auto it = known.begin();
+			while (it != known.end() && it->first != name) ++it;
+			if (it == known.end())
+			{
+				cerr << "No part " << name << " in " << source << endl;
+				return 1;
+			}
+			parts.push_back(*it);
+		}
+	}
+
+	atomic<size_t> next { 0 };
+	atomic<bool> failed { false };
+	atomic<size_t> written { 0 };
+	mutex output;
+
+	auto extract = [&] {
+		for (size_t i; !failed && (i = next++) < parts.size(); )
+		{
+			const auto &name = parts[i].first;
+			const auto path = name + suffix;
+			if (!quiet)
+			{
+				lock_guard<mutex> guard { output };
+				cerr << "Extracting part " << name << " into " << path << endl;
+			}
+
+			leveldb::BottomDB db;
+			db.options.create_if_missing = true;
+			db.options.error_if_exists = true;
+			if (writeBuffer > 0) db.options.write_buffer_size = writeBuffer;
+			auto ps = db.Open(path);
+
+			// walker of part covers only its own key range
+			auto pdb = sdb.use(parts[i].second);
+			Sandwich::Part::Walker it { pdb };
+			leveldb::WriteBatch batch;
+			for (it.SeekToFirst(); ps.ok() && it.Valid(); it.Next())
+			{
+				batch.Put(it.key(), it.value());
+				if (batch.ApproximateSize() < batchSize) continue;
+				written += batch.ApproximateSize();
+				ps = db.Write(batch);
+				batch.Clear();
+			}
+			if (ps.ok())
+			{
+				auto ws = it.status();
+				if (!ws.ok() && !ws.IsNotFound()) ps = ws;
+			}
+			if (ps.ok())
+			{
+				written += batch.ApproximateSize();
+				db.writeOptions.sync = true; // the last one makes it durable
+				ps = db.Write(batch);
+			}
+			if (ps.ok() && compact) db.CompactRange(leveldb::Slice(), leveldb::Slice());
+
+			if (!ps.ok())
+			{
+				lock_guard<mutex> guard { output };
+				cerr << "Failed to extract part " << name << " into " << path << ": " << ps.ToString() << endl;
+				failed = true;
+			}
+		}
+	};
+
+	const auto start = chrono::steady_clock::now();
+	vector<thread> workers;
+	for (size_t i = 1; i < min(threads, parts.size()); ++i) workers.emplace_back(extract);
+	extract();
+	for (auto &worker : workers) worker.join();
+	if (failed) return 2;
+
+	if (!quiet)
+	{
+		const chrono::duration<double> spent = chrono::steady_clock::now() - start;
+		cerr << "Written " << (written >> 20) << " MiB into " << parts.size() << " databases in "
+		     << spent.count() << " s" << endl;
+	}
+	cerr << "Done" << endl;
+
+	return 0;
+}